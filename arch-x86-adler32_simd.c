@@ -0,0 +1,147 @@
+/* adler32_simd.c -- SSSE3 and AVX2 Adler-32
+ *
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * The data is processed in blocks of BLOCK bytes. For a block b[0..BLOCK-1],
+ *
+ *   s1' = s1 + sum(b[i])
+ *   s2' = s2 + BLOCK*s1 + sum((BLOCK-i)*b[i])
+ *
+ * The byte sums come from psadbw, and the weighted sums from pmaddubsw with
+ * the weights BLOCK..1 followed by pmaddwd with ones. The BLOCK*s1 terms are
+ * accumulated in v_ps, and multiplied by BLOCK once per NMAX bytes, where
+ * both sums are reduced modulo BASE as in adler32_c.
+ *
+ * The kernels are compiled with target attributes; functable.c selects them
+ * at runtime.
+ */
+
+#include "zbuild.h"
+#include "zutil.h"
+#include <immintrin.h>
+
+#define BASE 65521U     /* largest prime smaller than 65536 */
+#define NMAX 5552
+
+extern uint32_t adler32_c(uint32_t adler, const unsigned char *buf, size_t len);
+
+/* adler32_tail adds len < NMAX bytes to the sums, and reduces them. */
+static inline uint32_t adler32_tail(uint32_t s1, uint32_t s2, const unsigned char *buf, size_t len) {
+    while (len--) {
+        s1 += *buf++;
+        s2 += s1;
+    }
+    return (s1 % BASE) | ((s2 % BASE) << 16);
+}
+
+#ifdef X86_SSSE3_ADLER32
+__attribute__((target("ssse3")))
+ZLIB_INTERNAL uint32_t adler32_ssse3(uint32_t adler, const unsigned char *buf, size_t len) {
+    enum { BLOCK = 32 };
+    uint32_t s1 = adler & 0xffff;
+    uint32_t s2 = adler >> 16;
+    size_t blocks;
+
+    if (buf == NULL || len < 64)
+        return adler32_c(adler, buf, len);
+
+    const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+    const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+
+    blocks = len / BLOCK;
+    len -= blocks * BLOCK;
+    while (blocks) {
+        unsigned n = NMAX / BLOCK;
+        if (n > blocks)
+            n = (unsigned)blocks;
+        blocks -= n;
+
+        __m128i v_ps = _mm_setr_epi32((int)(s1 * n), 0, 0, 0);
+        __m128i v_s2 = _mm_setr_epi32((int)s2, 0, 0, 0);
+        __m128i v_s1 = zero;
+        do {
+            const __m128i b1 = _mm_loadu_si128((const __m128i *)buf);
+            const __m128i b2 = _mm_loadu_si128((const __m128i *)(buf + 16));
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b1, zero));
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b2, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(b1, tap1), ones));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(b2, tap2), ones));
+            buf += BLOCK;
+        } while (--n);
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+        /* Horizontal sums. */
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(2, 3, 0, 1)));
+        s1 += (uint32_t)_mm_cvtsi128_si32(v_s1);
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+        s2 = (uint32_t)_mm_cvtsi128_si32(v_s2);
+
+        s1 %= BASE;
+        s2 %= BASE;
+    }
+    return adler32_tail(s1, s2, buf, len);
+}
+#endif
+
+#ifdef X86_AVX2_ADLER32
+__attribute__((target("avx2")))
+ZLIB_INTERNAL uint32_t adler32_avx2(uint32_t adler, const unsigned char *buf, size_t len) {
+    enum { BLOCK = 64 };
+    uint32_t s1 = adler & 0xffff;
+    uint32_t s2 = adler >> 16;
+    size_t blocks;
+
+    if (buf == NULL || len < 128)
+        return adler32_c(adler, buf, len);
+
+    const __m256i tap1 = _mm256_setr_epi8(64, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49,
+                                          48, 47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33);
+    const __m256i tap2 = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                          16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+
+    blocks = len / BLOCK;
+    len -= blocks * BLOCK;
+    while (blocks) {
+        unsigned n = NMAX / BLOCK;
+        if (n > blocks)
+            n = (unsigned)blocks;
+        blocks -= n;
+
+        __m256i v_ps = _mm256_setr_epi32((int)(s1 * n), 0, 0, 0, 0, 0, 0, 0);
+        __m256i v_s2 = _mm256_setr_epi32((int)s2, 0, 0, 0, 0, 0, 0, 0);
+        __m256i v_s1 = zero;
+        do {
+            const __m256i b1 = _mm256_loadu_si256((const __m256i *)buf);
+            const __m256i b2 = _mm256_loadu_si256((const __m256i *)(buf + 32));
+            v_ps = _mm256_add_epi32(v_ps, v_s1);
+            v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(b1, zero));
+            v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(b2, zero));
+            v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(b1, tap1), ones));
+            v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(b2, tap2), ones));
+            buf += BLOCK;
+        } while (--n);
+        v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_ps, 6));
+
+        /* Horizontal sums. */
+        __m128i h1 = _mm_add_epi32(_mm256_castsi256_si128(v_s1), _mm256_extracti128_si256(v_s1, 1));
+        h1 = _mm_add_epi32(h1, _mm_shuffle_epi32(h1, _MM_SHUFFLE(1, 0, 3, 2)));
+        h1 = _mm_add_epi32(h1, _mm_shuffle_epi32(h1, _MM_SHUFFLE(2, 3, 0, 1)));
+        s1 += (uint32_t)_mm_cvtsi128_si32(h1);
+        __m128i h2 = _mm_add_epi32(_mm256_castsi256_si128(v_s2), _mm256_extracti128_si256(v_s2, 1));
+        h2 = _mm_add_epi32(h2, _mm_shuffle_epi32(h2, _MM_SHUFFLE(1, 0, 3, 2)));
+        h2 = _mm_add_epi32(h2, _mm_shuffle_epi32(h2, _MM_SHUFFLE(2, 3, 0, 1)));
+        s2 = (uint32_t)_mm_cvtsi128_si32(h2);
+
+        s1 %= BASE;
+        s2 %= BASE;
+    }
+    return adler32_tail(s1, s2, buf, len);
+}
+#endif
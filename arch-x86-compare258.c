@@ -0,0 +1,168 @@
+/* compare258.c -- SIMD string comparison for the match finders
+ *
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * Each compare258 variant returns the length of the common prefix of two
+ * strings, up to MAX_MATCH (258) bytes, and reads at most 258 bytes from
+ * either string. The AVX2 and AVX-512 variants are compiled with target
+ * attributes, so that the rest of the library does not require those
+ * instruction sets; functable.c selects them at runtime. The longest_match
+ * variants inline them into match_tpl.h.
+ */
+
+#include "zbuild.h"
+#include <immintrin.h>
+#ifdef _MSC_VER
+#  include <nmmintrin.h>
+#endif
+#include "deflate.h"
+#include "match.h"
+
+ZLIB_INTERNAL unsigned compare258_sse(const unsigned char *const src0, const unsigned char *const src1) {
+#ifdef _MSC_VER
+    long cnt;
+
+    cnt = 0;
+    do {
+#define mode  _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH | _SIDD_NEGATIVE_POLARITY
+
+        int ret;
+        __m128i xmm_src0, xmm_src1;
+
+        xmm_src0 = _mm_loadu_si128((__m128i *)(src0 + cnt));
+        xmm_src1 = _mm_loadu_si128((__m128i *)(src1 + cnt));
+        ret = _mm_cmpestri(xmm_src0, 16, xmm_src1, 16, mode);
+        if (_mm_cmpestrc(xmm_src0, 16, xmm_src1, 16, mode)) {
+            cnt += ret;
+	    break;
+        }
+        cnt += 16;
+
+        xmm_src0 = _mm_loadu_si128((__m128i *)(src0 + cnt));
+        xmm_src1 = _mm_loadu_si128((__m128i *)(src1 + cnt));
+        ret = _mm_cmpestri(xmm_src0, 16, xmm_src1, 16, mode);
+        if (_mm_cmpestrc(xmm_src0, 16, xmm_src1, 16, mode)) {
+            cnt += ret;
+	    break;
+        }
+        cnt += 16;
+    } while (cnt < 256);
+
+    if (*(unsigned short *)(src0 + cnt) == *(unsigned short *)(src1 + cnt)) {
+        cnt += 2;
+    } else if (*(src0 + cnt) == *(src1 + cnt)) {
+        cnt++;
+    }
+    return (unsigned)cnt;
+#else
+    uintptr_t ax, dx, cx;
+    __m128i xmm_src0;
+
+    ax = 16;
+    dx = 16;
+    /* set cx to something, otherwise gcc thinks it's used
+       uninitalised */
+    cx = 0;
+
+    __asm__ __volatile__ (
+    "1:"
+        "movdqu     -16(%[src0], %[ax]), %[xmm_src0]\n\t"
+        "pcmpestri  $0x18, -16(%[src1], %[ax]), %[xmm_src0]\n\t"
+        "jc         2f\n\t"
+        "add        $16, %[ax]\n\t"
+
+        "movdqu     -16(%[src0], %[ax]), %[xmm_src0]\n\t"
+        "pcmpestri  $0x18, -16(%[src1], %[ax]), %[xmm_src0]\n\t"
+        "jc         2f\n\t"
+        "add        $16, %[ax]\n\t"
+
+        "cmp        $256 + 16, %[ax]\n\t"
+        "jb         1b\n\t"
+
+#ifdef X86
+        "movzwl     -16(%[src0], %[ax]), %[dx]\n\t"
+#else
+        "movzwq     -16(%[src0], %[ax]), %[dx]\n\t"
+#endif
+        "xorw       -16(%[src1], %[ax]), %%dx\n\t"
+        "jnz        3f\n\t"
+
+        "add        $2, %[ax]\n\t"
+        "jmp        4f\n\t"
+    "3:\n\t"
+        "rep; bsf   %[dx], %[cx]\n\t"
+        "shr        $3, %[cx]\n\t"
+    "2:"
+        "add        %[cx], %[ax]\n\t"
+    "4:"
+    : [ax] "+a" (ax),
+      [cx] "+c" (cx),
+      [dx] "+d" (dx),
+      [xmm_src0] "=x" (xmm_src0)
+    : [src0] "r" (src0),
+      [src1] "r" (src1)
+    : "cc"
+    );
+    return (unsigned)(ax - 16);
+#endif
+}
+
+#ifdef X86_AVX2
+__attribute__((target("avx2,bmi")))
+static inline unsigned compare258_avx2_static(const unsigned char *src0, const unsigned char *src1) {
+    unsigned len = 0;
+
+    do {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src0 + len));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src1 + len));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+        if (mask != 0xFFFFFFFFU)
+            return len + (unsigned)__builtin_ctz(~mask);
+        len += 32;
+    } while (len < 256);
+
+    if (src0[256] != src1[256])
+        return 256;
+    return src0[257] == src1[257] ? 258 : 257;
+}
+
+__attribute__((target("avx2,bmi")))
+ZLIB_INTERNAL unsigned compare258_avx2(const unsigned char *src0, const unsigned char *src1) {
+    return compare258_avx2_static(src0, src1);
+}
+
+#define LONGEST_MATCH      longest_match_avx2
+#define LONGEST_MATCH_ATTR ZLIB_INTERNAL __attribute__((target("avx2,bmi")))
+#define COMPARE258         compare258_avx2_static
+#include "match_tpl.h"
+#endif
+
+#ifdef X86_AVX512
+__attribute__((target("avx512f,avx512bw,bmi")))
+static inline unsigned compare258_avx512_static(const unsigned char *src0, const unsigned char *src1) {
+    unsigned len = 0;
+
+    do {
+        __m512i a = _mm512_loadu_si512((const void *)(src0 + len));
+        __m512i b = _mm512_loadu_si512((const void *)(src1 + len));
+        uint64_t mask = _mm512_cmpneq_epi8_mask(a, b);
+        if (mask != 0)
+            return len + (unsigned)__builtin_ctzll(mask);
+        len += 64;
+    } while (len < 256);
+
+    if (src0[256] != src1[256])
+        return 256;
+    return src0[257] == src1[257] ? 258 : 257;
+}
+
+__attribute__((target("avx512f,avx512bw,bmi")))
+ZLIB_INTERNAL unsigned compare258_avx512(const unsigned char *src0, const unsigned char *src1) {
+    return compare258_avx512_static(src0, src1);
+}
+
+#define LONGEST_MATCH      longest_match_avx512
+#define LONGEST_MATCH_ATTR ZLIB_INTERNAL __attribute__((target("avx512f,avx512bw,bmi")))
+#define COMPARE258         compare258_avx512_static
+#include "match_tpl.h"
+#endif
@@ -0,0 +1,125 @@
+/* crc32_simd.c -- stateless CRC-32 with PCLMULQDQ
+ *
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * Unlike crc_folding.c, which keeps its folding state in deflate_state for
+ * deflate's fused copy, these kernels compute the CRC of one buffer, so that
+ * crc32() and inflate can use them through the functable.
+ *
+ * On CPUs with 512-bit VPCLMULQDQ, the bulk of the buffer goes through
+ * zng_crc_fold_16_vpclmulqdq in crc_folding.c.
+ *
+ * The folding constants and the Barrett reduction follow "Fast CRC Computation
+ * for Generic Polynomials Using PCLMULQDQ Instruction", Intel, 2009, in the
+ * bit-reflected domain.
+ */
+
+#ifdef X86_PCLMULQDQ_CRC
+
+#include "zbuild.h"
+#include "zutil.h"
+#include <immintrin.h>
+#include "arch-x86-crc_folding.h"
+#include "arch-x86-x86.h"
+
+extern uint32_t crc32_little(uint32_t crc, const unsigned char *buf, uint64_t len);
+
+/* crc32_fold_pclmulqdq returns the CRC register after len bytes, where len is
+   a multiple of 16 and at least 64. crc is the register before them, i.e. the
+   complement of the CRC-32 value. */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_fold_pclmulqdq(uint32_t crc, const unsigned char *buf, uint64_t len) {
+    static const uint64_t ALIGNED_(16) k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    static const uint64_t ALIGNED_(16) k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    static const uint64_t ALIGNED_(16) k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    static const uint64_t ALIGNED_(16) poly[] = { 0x01db710641, 0x01f7011641 };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    buf += 64;
+    len -= 64;
+
+#ifdef X86_VPCLMULQDQ_CRC
+    /* The lanes are laid out as in crc_folding.c, so the wide kernel applies. */
+    if (x86_cpu_has_vpclmulqdq && len >= 256) {
+        uint64_t n = zng_crc_fold_16_vpclmulqdq(&x1, &x2, &x3, &x4, NULL, buf, len);
+        buf += n;
+        len -= n;
+    }
+#endif
+
+    /* Fold four 128-bit lanes, 64 bytes per iteration. */
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    }
+
+    /* Fold the four lanes into one. */
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* Fold the remaining 16-byte blocks. */
+    while (len >= 16) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)buf));
+        buf += 16;
+        len -= 16;
+    }
+
+    /* Fold 128 bits to 64. */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits. */
+    x0 = _mm_load_si128((const __m128i *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+ZLIB_INTERNAL uint32_t crc32_pclmulqdq(uint32_t crc, const unsigned char *buf, uint64_t len) {
+    uint64_t n;
+
+    if (len < 64)
+        return crc32_little(crc, buf, len);
+    n = len & ~(uint64_t)15;
+    crc = ~crc32_fold_pclmulqdq(~crc, buf, n);
+    return crc32_little(crc, buf + n, len - n);
+}
+
+#endif
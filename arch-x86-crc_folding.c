@@ -24,7 +24,11 @@
 #include <wmmintrin.h>
 
 #include "arch-x86-crc_folding.h"
+#include "arch-x86-x86.h"
 
+/* The library is built for baseline x86-64; these functions are only called
+ * after crc_reset has checked x86_cpu_has_pclmulqdq. */
+#define CRC_FOLD_TARGET __attribute__((target("pclmul,sse4.1")))
 
 #define CRC_LOAD(s) \
     do { \
@@ -42,6 +46,7 @@
         _mm_storeu_si128((__m128i *)s->crc0 + 4, xmm_crc_part);\
     } while (0);
 
+CRC_FOLD_TARGET
 ZLIB_INTERNAL void zng_crc_fold_init(deflate_state *const s) {
     CRC_LOAD(s)
 
@@ -55,6 +60,7 @@ ZLIB_INTERNAL void zng_crc_fold_init(deflate_state *const s) {
     s->strm->adler = 0;
 }
 
+CRC_FOLD_TARGET
 static void fold_1(__m128i *xmm_crc0, __m128i *xmm_crc1, __m128i *xmm_crc2, __m128i *xmm_crc3) {
     const __m128i xmm_fold4 = _mm_set_epi32( 0x00000001, 0x54442bd4,
                                              0x00000001, 0xc6e41596);
@@ -76,6 +82,7 @@ static void fold_1(__m128i *xmm_crc0, __m128i *xmm_crc1, __m128i *xmm_crc2, __m1
     *xmm_crc3 = _mm_castps_si128(ps_res);
 }
 
+CRC_FOLD_TARGET
 static void fold_2(__m128i *xmm_crc0, __m128i *xmm_crc1, __m128i *xmm_crc2, __m128i *xmm_crc3) {
     const __m128i xmm_fold4 = _mm_set_epi32( 0x00000001, 0x54442bd4,
                                              0x00000001, 0xc6e41596);
@@ -105,6 +112,7 @@ static void fold_2(__m128i *xmm_crc0, __m128i *xmm_crc1, __m128i *xmm_crc2, __m1
     *xmm_crc3 = _mm_castps_si128(ps_res31);
 }
 
+CRC_FOLD_TARGET
 static void fold_3(__m128i *xmm_crc0, __m128i *xmm_crc1, __m128i *xmm_crc2, __m128i *xmm_crc3) {
     const __m128i xmm_fold4 = _mm_set_epi32( 0x00000001, 0x54442bd4,
                                              0x00000001, 0xc6e41596);
@@ -140,6 +148,7 @@ static void fold_3(__m128i *xmm_crc0, __m128i *xmm_crc1, __m128i *xmm_crc2, __m1
     *xmm_crc3 = _mm_castps_si128(ps_res32);
 }
 
+CRC_FOLD_TARGET
 static void fold_4(__m128i *xmm_crc0, __m128i *xmm_crc1, __m128i *xmm_crc2, __m128i *xmm_crc3) {
     const __m128i xmm_fold4 = _mm_set_epi32( 0x00000001, 0x54442bd4,
                                              0x00000001, 0xc6e41596);
@@ -201,6 +210,7 @@ static const unsigned ALIGNED_(32) pshufb_shf_table[60] = {
     0x0201008f, 0x06050403, 0x0a090807, 0x0e0d0c0b  /* shl  1 (16 -15)/shr15*/
 };
 
+CRC_FOLD_TARGET
 static void partial_fold(const size_t len, __m128i *xmm_crc0, __m128i *xmm_crc1, __m128i *xmm_crc2,
                          __m128i *xmm_crc3, __m128i *xmm_crc_part) {
 
@@ -247,6 +257,86 @@ static void partial_fold(const size_t len, __m128i *xmm_crc0, __m128i *xmm_crc1,
     *xmm_crc3 = _mm_castps_si128(ps_res);
 }
 
+#ifdef X86_VPCLMULQDQ_CRC
+/*
+ * zng_crc_fold_16_vpclmulqdq folds the first len & ~255 bytes of src into the
+ * four lanes, and copies them to dst unless dst is NULL. It returns the number
+ * of bytes consumed; len must be at least 256. Four 512-bit registers hold
+ * sixteen lanes, which are folded by 2048 bits per iteration, and reduced back
+ * to four lanes with the fold_4 constants at the end.
+ */
+__attribute__((target("avx512f,vpclmulqdq")))
+ZLIB_INTERNAL size_t zng_crc_fold_16_vpclmulqdq(__m128i *xmm_crc0, __m128i *xmm_crc1, __m128i *xmm_crc2,
+                                                __m128i *xmm_crc3, unsigned char *dst, const unsigned char *src,
+                                                size_t len) {
+    const __m512i zmm_fold4 = _mm512_set4_epi32( 0x00000001, 0x54442bd4,
+                                                 0x00000001, 0xc6e41596);
+    const __m512i zmm_fold16 = _mm512_set4_epi32( 0x00000001, 0x1542778a,
+                                                  0x00000001, 0x322d1430);
+    __m512i zmm_crc0, zmm_crc1, zmm_crc2, zmm_crc3;
+    __m512i zmm_t0, zmm_t1, zmm_t2, zmm_t3;
+    size_t n = len & ~(size_t)255;
+
+    zmm_crc0 = _mm512_castsi128_si512(*xmm_crc0);
+    zmm_crc0 = _mm512_inserti32x4(zmm_crc0, *xmm_crc1, 1);
+    zmm_crc0 = _mm512_inserti32x4(zmm_crc0, *xmm_crc2, 2);
+    zmm_crc0 = _mm512_inserti32x4(zmm_crc0, *xmm_crc3, 3);
+
+    zmm_t0 = _mm512_loadu_si512((const void *)src);
+    zmm_crc1 = _mm512_loadu_si512((const void *)(src + 64));
+    zmm_crc2 = _mm512_loadu_si512((const void *)(src + 128));
+    zmm_crc3 = _mm512_loadu_si512((const void *)(src + 192));
+    zmm_crc0 = _mm512_ternarylogic_epi32(_mm512_clmulepi64_epi128(zmm_crc0, zmm_fold4, 0x01),
+                                         _mm512_clmulepi64_epi128(zmm_crc0, zmm_fold4, 0x10), zmm_t0, 0x96);
+    if (dst) {
+        _mm512_storeu_si512((void *)dst, zmm_t0);
+        _mm512_storeu_si512((void *)(dst + 64), zmm_crc1);
+        _mm512_storeu_si512((void *)(dst + 128), zmm_crc2);
+        _mm512_storeu_si512((void *)(dst + 192), zmm_crc3);
+        dst += 256;
+    }
+    src += 256;
+
+    for (len = n - 256; len != 0; len -= 256) {
+        zmm_t0 = _mm512_loadu_si512((const void *)src);
+        zmm_t1 = _mm512_loadu_si512((const void *)(src + 64));
+        zmm_t2 = _mm512_loadu_si512((const void *)(src + 128));
+        zmm_t3 = _mm512_loadu_si512((const void *)(src + 192));
+        if (dst) {
+            _mm512_storeu_si512((void *)dst, zmm_t0);
+            _mm512_storeu_si512((void *)(dst + 64), zmm_t1);
+            _mm512_storeu_si512((void *)(dst + 128), zmm_t2);
+            _mm512_storeu_si512((void *)(dst + 192), zmm_t3);
+            dst += 256;
+        }
+        src += 256;
+
+        zmm_crc0 = _mm512_ternarylogic_epi32(_mm512_clmulepi64_epi128(zmm_crc0, zmm_fold16, 0x01),
+                                             _mm512_clmulepi64_epi128(zmm_crc0, zmm_fold16, 0x10), zmm_t0, 0x96);
+        zmm_crc1 = _mm512_ternarylogic_epi32(_mm512_clmulepi64_epi128(zmm_crc1, zmm_fold16, 0x01),
+                                             _mm512_clmulepi64_epi128(zmm_crc1, zmm_fold16, 0x10), zmm_t1, 0x96);
+        zmm_crc2 = _mm512_ternarylogic_epi32(_mm512_clmulepi64_epi128(zmm_crc2, zmm_fold16, 0x01),
+                                             _mm512_clmulepi64_epi128(zmm_crc2, zmm_fold16, 0x10), zmm_t2, 0x96);
+        zmm_crc3 = _mm512_ternarylogic_epi32(_mm512_clmulepi64_epi128(zmm_crc3, zmm_fold16, 0x01),
+                                             _mm512_clmulepi64_epi128(zmm_crc3, zmm_fold16, 0x10), zmm_t3, 0x96);
+    }
+
+    zmm_crc0 = _mm512_ternarylogic_epi32(_mm512_clmulepi64_epi128(zmm_crc0, zmm_fold4, 0x01),
+                                         _mm512_clmulepi64_epi128(zmm_crc0, zmm_fold4, 0x10), zmm_crc1, 0x96);
+    zmm_crc0 = _mm512_ternarylogic_epi32(_mm512_clmulepi64_epi128(zmm_crc0, zmm_fold4, 0x01),
+                                         _mm512_clmulepi64_epi128(zmm_crc0, zmm_fold4, 0x10), zmm_crc2, 0x96);
+    zmm_crc0 = _mm512_ternarylogic_epi32(_mm512_clmulepi64_epi128(zmm_crc0, zmm_fold4, 0x01),
+                                         _mm512_clmulepi64_epi128(zmm_crc0, zmm_fold4, 0x10), zmm_crc3, 0x96);
+
+    *xmm_crc0 = _mm512_castsi512_si128(zmm_crc0);
+    *xmm_crc1 = _mm512_extracti32x4_epi32(zmm_crc0, 1);
+    *xmm_crc2 = _mm512_extracti32x4_epi32(zmm_crc0, 2);
+    *xmm_crc3 = _mm512_extracti32x4_epi32(zmm_crc0, 3);
+    return n;
+}
+#endif
+
+CRC_FOLD_TARGET
 ZLIB_INTERNAL void zng_crc_fold_copy(deflate_state *const s, unsigned char *dst, const unsigned char *src, long len) {
     unsigned long algn_diff;
     __m128i xmm_t0, xmm_t1, xmm_t2, xmm_t3;
@@ -272,6 +362,15 @@ ZLIB_INTERNAL void zng_crc_fold_copy(deflate_state *const s, unsigned char *dst,
         partial_fold(algn_diff, &xmm_crc0, &xmm_crc1, &xmm_crc2, &xmm_crc3, &xmm_crc_part);
     }
 
+#ifdef X86_VPCLMULQDQ_CRC
+    if (x86_cpu_has_vpclmulqdq && len >= 256) {
+        size_t n = zng_crc_fold_16_vpclmulqdq(&xmm_crc0, &xmm_crc1, &xmm_crc2, &xmm_crc3, dst, src, (size_t)len);
+        dst += n;
+        src += n;
+        len -= (long)n;
+    }
+#endif
+
     while ((len -= 64) >= 0) {
         xmm_t0 = _mm_load_si128((__m128i *)src);
         xmm_t1 = _mm_load_si128((__m128i *)src + 1);
@@ -385,6 +484,7 @@ static const unsigned ALIGNED_(16) crc_mask2[4] = {
     0x00000000, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF
 };
 
+CRC_FOLD_TARGET
 uint32_t ZLIB_INTERNAL zng_crc_fold_512to32(deflate_state *const s) {
     const __m128i xmm_mask  = _mm_load_si128((__m128i *)crc_mask);
     const __m128i xmm_mask2 = _mm_load_si128((__m128i *)crc_mask2);
@@ -11,9 +11,14 @@
 #define CRC_FOLDING_H_
 
 #include "deflate.h"
+#include <immintrin.h>
 
 ZLIB_INTERNAL void zng_crc_fold_init(deflate_state *const);
 ZLIB_INTERNAL uint32_t zng_crc_fold_512to32(deflate_state *const);
 ZLIB_INTERNAL void zng_crc_fold_copy(deflate_state *const, unsigned char *, const unsigned char *, long);
+#ifdef X86_VPCLMULQDQ_CRC
+ZLIB_INTERNAL size_t zng_crc_fold_16_vpclmulqdq(__m128i *, __m128i *, __m128i *, __m128i *,
+                                                unsigned char *, const unsigned char *, size_t);
+#endif
 
 #endif
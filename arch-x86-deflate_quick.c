@@ -23,137 +23,27 @@
 #  include <nmmintrin.h>
 #endif
 #include "deflate.h"
+#include "deflate_p.h"
+#include "functable.h"
 
 #ifdef ZLIB_DEBUG
 #include <ctype.h>
 #endif
 
-extern void fill_window_sse(deflate_state *s);
-extern void flush_pending(PREFIX3(stream) *strm);
-
-static inline long compare258(const unsigned char *const src0, const unsigned char *const src1) {
-#ifdef _MSC_VER
-    long cnt;
-
-    cnt = 0;
-    do {
-#define mode  _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH | _SIDD_NEGATIVE_POLARITY
-
-        int ret;
-        __m128i xmm_src0, xmm_src1;
-
-        xmm_src0 = _mm_loadu_si128((__m128i *)(src0 + cnt));
-        xmm_src1 = _mm_loadu_si128((__m128i *)(src1 + cnt));
-        ret = _mm_cmpestri(xmm_src0, 16, xmm_src1, 16, mode);
-        if (_mm_cmpestrc(xmm_src0, 16, xmm_src1, 16, mode)) {
-            cnt += ret;
-	    break;
-        }
-        cnt += 16;
-
-        xmm_src0 = _mm_loadu_si128((__m128i *)(src0 + cnt));
-        xmm_src1 = _mm_loadu_si128((__m128i *)(src1 + cnt));
-        ret = _mm_cmpestri(xmm_src0, 16, xmm_src1, 16, mode);
-        if (_mm_cmpestrc(xmm_src0, 16, xmm_src1, 16, mode)) {
-            cnt += ret;
-	    break;
-        }
-        cnt += 16;
-    } while (cnt < 256);
-
-    if (*(unsigned short *)(src0 + cnt) == *(unsigned short *)(src1 + cnt)) {
-        cnt += 2;
-    } else if (*(src0 + cnt) == *(src1 + cnt)) {
-        cnt++;
-    }
-    return cnt;
-#else
-    uintptr_t ax, dx, cx;
-    __m128i xmm_src0;
-
-    ax = 16;
-    dx = 16;
-    /* set cx to something, otherwise gcc thinks it's used
-       uninitalised */
-    cx = 0;
-
-    __asm__ __volatile__ (
-    "1:"
-        "movdqu     -16(%[src0], %[ax]), %[xmm_src0]\n\t"
-        "pcmpestri  $0x18, -16(%[src1], %[ax]), %[xmm_src0]\n\t"
-        "jc         2f\n\t"
-        "add        $16, %[ax]\n\t"
-
-        "movdqu     -16(%[src0], %[ax]), %[xmm_src0]\n\t"
-        "pcmpestri  $0x18, -16(%[src1], %[ax]), %[xmm_src0]\n\t"
-        "jc         2f\n\t"
-        "add        $16, %[ax]\n\t"
-
-        "cmp        $256 + 16, %[ax]\n\t"
-        "jb         1b\n\t"
-
-#ifdef X86
-        "movzwl     -16(%[src0], %[ax]), %[dx]\n\t"
-#else
-        "movzwq     -16(%[src0], %[ax]), %[dx]\n\t"
-#endif
-        "xorw       -16(%[src1], %[ax]), %%dx\n\t"
-        "jnz        3f\n\t"
-
-        "add        $2, %[ax]\n\t"
-        "jmp        4f\n\t"
-    "3:\n\t"
-        "rep; bsf   %[dx], %[cx]\n\t"
-        "shr        $3, %[cx]\n\t"
-    "2:"
-        "add        %[cx], %[ax]\n\t"
-    "4:"
-    : [ax] "+a" (ax),
-      [cx] "+c" (cx),
-      [dx] "+d" (dx),
-      [xmm_src0] "=x" (xmm_src0)
-    : [src0] "r" (src0),
-      [src1] "r" (src1)
-    : "cc"
-    );
-    return ax - 16;
-#endif
-}
-
 static const unsigned quick_len_codes[MAX_MATCH-MIN_MATCH+1];
 static const unsigned quick_zng_dist_codes[8192];
 
+/* quick_send_bits sends two codes, at most 41 bits, with one send_bits. */
 static inline void quick_send_bits(deflate_state *const s,
                                    const int value1, const int length1,
                                    const int value2, const int length2) {
-    unsigned offset2 = s->bi_valid + length1;
-    unsigned width = s->bi_valid + length1 + length2;
-    unsigned bytes_out = width / 8;
-
-    /* Concatenate the new bits with the bits currently in the buffer */
-    unsigned out = s->bi_buf | (value1 << s->bi_valid);
-    if (width < 32) {
-      out |= (value2 << offset2);
-      /* Shift out the valid LSBs written out. */
-      s->bi_buf = out >> (bytes_out * 8);
-    } else /* width => 32 */ {
-      unsigned bits_that_fit = 32 - offset2;
-      unsigned mask = (1 << bits_that_fit) - 1;
-      /* Zero out the high bits of value2 such that the shift by offset2 will
-         not cause undefined behavior. */
-      out |= ((value2 & mask) << offset2);
-
-      /* Save in s->bi_buf the bits of value2 that do not fit: they will be
-         written in a next full byte. */
-      s->bi_buf = (width == 32) ? 0 : value2 >> bits_that_fit;
-    }
-
-    s->bi_valid = width - (bytes_out * 8);
-
-    /* Taking advantage of the fact that LSB comes first, write to output buffer */
-    *(unsigned *)(s->pending_buf + s->pending) = out;
-
-    s->pending += bytes_out;
+#ifdef ZLIB_DEBUG
+    send_bits(s, value1, length1);
+    if (length2)
+        send_bits(s, value2, length2);
+#else
+    send_bits(s, (uint64_t)value1 | ((uint64_t)value2 << length1), length1 + length2);
+#endif
 }
 
 static inline void static_emit_ptr(deflate_state *const s, const int lc, const unsigned dist) {
@@ -206,8 +96,8 @@ static inline Pos quick_insert_string(deflate_state *const s, const Pos str) {
     );
 #endif
 
-    ret = s->head[h & s->hash_mask];
-    s->head[h & s->hash_mask] = str;
+    ret = (Pos)REL_POS(s, s->head[h & s->hash_mask]);
+    s->head[h & s->hash_mask] = ABS_POS(s, str);
     return ret;
 }
 
@@ -215,19 +105,30 @@ ZLIB_INTERNAL block_state deflate_quick(deflate_state *s, int flush) {
     IPos hash_head;
     unsigned dist, match_len;
 
+    /* A block opened before Z_FINISH stays open if we ran out of output, and
+     * cannot be the last one. */
+    if (s->block_open == 1 && flush == Z_FINISH) {
+        static_emit_end_block(s, 0);
+        if (s->strm->avail_out == 0)
+            return need_more;
+    }
+
     if (s->block_open == 0) {
         static_emit_tree(s, flush);
-        s->block_open = 1;
+        s->block_open = 1 + (flush == Z_FINISH);
     }
 
     do {
-        if (s->pending + 4 >= s->pending_buf_size) {
+        /* Leave room for a code and the end of the block, each of which
+         * may write out the 8-byte bit buffer. */
+        if (s->pending + 3 * (Buf_size >> 3) >= s->pending_buf_size) {
             flush_pending(s->strm);
-            return need_more;
+            if (s->strm->avail_out == 0)
+                return need_more;
         }
 
         if (s->lookahead < MIN_LOOKAHEAD) {
-            fill_window_sse(s);
+            FUNCTABLE_GET(fill_window)(s);
             if (s->lookahead < MIN_LOOKAHEAD && flush == Z_NO_FLUSH) {
                 static_emit_end_block(s, 0);
                 return need_more;
@@ -241,7 +142,7 @@ ZLIB_INTERNAL block_state deflate_quick(deflate_state *s, int flush) {
             dist = s->strstart - hash_head;
 
             if (dist > 0 && (dist-1) < (s->w_size - 1)) {
-                match_len = compare258(s->window + s->strstart, s->window + s->strstart - dist);
+                match_len = FUNCTABLE_GET(compare258)(s->window + s->strstart, s->window + s->strstart - dist);
 
                 if (match_len >= MIN_MATCH) {
                     if (match_len > s->lookahead)
@@ -279,6 +180,72 @@ ZLIB_INTERNAL block_state deflate_quick(deflate_state *s, int flush) {
     return block_done;
 }
 
+/* deflate_quick_dynamic finds matches like deflate_quick, with a single probe
+ * of the hash table, but tallies them in the symbol buffer instead of sending
+ * them with the static trees. Each block then gets its own Huffman trees, which
+ * pays off on inputs with a skewed alphabet, such as DNA and quality strings.
+ * Once the literals have short codes, the short matches that a single probe
+ * mostly finds cost more than the literals they replace, so the matches shorter
+ * than QUICK_DYNAMIC_MIN_MATCH are sent as literals.
+ */
+#define QUICK_DYNAMIC_MIN_MATCH 6
+
+ZLIB_INTERNAL block_state deflate_quick_dynamic(deflate_state *s, int flush) {
+    IPos hash_head;
+    unsigned match_dist = 0, match_len;
+    int bflush;
+
+    for (;;) {
+        if (s->lookahead < MIN_LOOKAHEAD) {
+            FUNCTABLE_GET(fill_window)(s);
+            if (s->lookahead < MIN_LOOKAHEAD && flush == Z_NO_FLUSH)
+                return need_more;
+            if (s->lookahead == 0)
+                break; /* flush the current block */
+        }
+
+        match_len = 0;
+        if (s->lookahead >= MIN_MATCH) {
+            hash_head = quick_insert_string(s, s->strstart);
+            match_dist = s->strstart - hash_head;
+
+            if (match_dist > 0 && match_dist <= MAX_DIST(s)) {
+                const unsigned char *scan = s->window + s->strstart;
+                const unsigned char *match = scan - match_dist;
+
+                /* Most probes find no match long enough, so skip the call for those. */
+                if (memcmp(scan, match, QUICK_DYNAMIC_MIN_MATCH) == 0) {
+                    match_len = FUNCTABLE_GET(compare258)(scan, match);
+                    if (match_len > s->lookahead)
+                        match_len = s->lookahead;
+                }
+            }
+        }
+
+        if (match_len >= QUICK_DYNAMIC_MIN_MATCH) {
+            check_match(s, s->strstart, s->strstart - match_dist, match_len);
+            _zng_tr_tally_dist(s, match_dist, match_len - MIN_MATCH, bflush);
+            s->lookahead -= match_len;
+            s->strstart += match_len;
+        } else {
+            Tracevv((stderr, "%c", s->window[s->strstart]));
+            _zng_tr_tally_lit(s, s->window[s->strstart], bflush);
+            s->lookahead--;
+            s->strstart++;
+        }
+        if (bflush)
+            FLUSH_BLOCK(s, 0);
+    }
+    s->insert = s->strstart < MIN_MATCH - 1 ? s->strstart : MIN_MATCH-1;
+    if (flush == Z_FINISH) {
+        FLUSH_BLOCK(s, 1);
+        return finish_done;
+    }
+    if (s->sym_next)
+        FLUSH_BLOCK(s, 0);
+    return block_done;
+}
+
 static const unsigned quick_len_codes[MAX_MATCH-MIN_MATCH+1] = {
     0x00004007, 0x00002007, 0x00006007, 0x00001007,
     0x00005007, 0x00003007, 0x00007007, 0x00000807,
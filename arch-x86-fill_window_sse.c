@@ -8,7 +8,7 @@
  *
  * For conditions of distribution and use, see copyright notice in zlib.h
  */
-#ifdef X86_SSE2_FILL_WINDOW
+#if defined(X86_SSE2_FILL_WINDOW) && !defined(DEFLATE_POS32)
 
 #include "zbuild.h"
 #include <immintrin.h>
@@ -26,7 +26,8 @@ ZLIB_INTERNAL void fill_window_sse(deflate_state *s) {
     unsigned more;    /* Amount of free space at the end of the window. */
     unsigned int wsize = s->w_size;
 
-    Assert(s->lookahead < MIN_LOOKAHEAD, "already enough lookahead");
+    Assert(s->lookahead < MIN_LOOKAHEAD || s->strstart + s->lookahead < s->window_size,
+           "already enough lookahead");
 
     do {
         more = (unsigned)(s->window_size -(unsigned long)s->lookahead -(unsigned long)s->strstart);
@@ -52,6 +53,8 @@ ZLIB_INTERNAL void fill_window_sse(deflate_state *s) {
             s->match_start = (s->match_start >= wsize) ? s->match_start - wsize : 0;
             s->strstart    -= wsize; /* we now have strstart >= MAX_DIST */
             s->block_start -= (long) wsize;
+            if (s->insert > s->strstart)
+                s->insert = s->strstart;
 
             /* Slide the hash table (could be avoided with 32 bit values
                at the expense of memory usage). We slide even when level == 0
@@ -101,7 +104,7 @@ ZLIB_INTERNAL void fill_window_sse(deflate_state *s) {
          * Otherwise, window_size == 2*WSIZE so more >= 2.
          * If there was sliding, more >= WSIZE. So in all cases, more >= 2.
          */
-        Assert(more >= 2, "more < 2");
+        Assert(more >= 2 || s->lookahead >= MIN_LOOKAHEAD, "more < 2");
 
         n = read_buf(s->strm, s->window + s->strstart + s->lookahead, more);
         s->lookahead += n;
@@ -111,11 +114,11 @@ ZLIB_INTERNAL void fill_window_sse(deflate_state *s) {
             unsigned int str = s->strstart - s->insert;
             s->ins_h = s->window[str];
             if (str >= 1)
-                zng_functable.insert_string(s, str + 2 - MIN_MATCH, 1);
+                FUNCTABLE_GET(insert_string)(s, str + 2 - MIN_MATCH, 1);
 #if MIN_MATCH != 3
 #error Call insert_string() MIN_MATCH-3 more times
             while (s->insert) {
-                zng_functable.insert_string(s, str, 1);
+                FUNCTABLE_GET(insert_string)(s, str, 1);
                 str++;
                 s->insert--;
                 if (s->lookahead + s->insert < MIN_MATCH)
@@ -128,7 +131,7 @@ ZLIB_INTERNAL void fill_window_sse(deflate_state *s) {
             }else{
                 count = s->insert;
             }
-            zng_functable.insert_string(s, str, count);
+            FUNCTABLE_GET(insert_string)(s, str, count);
             s->insert -= count;
 #endif
         }
@@ -0,0 +1,26 @@
+/* inffast_avx2.c -- inflate_fast() with 32-byte AVX2 match copies
+ *
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * The function is compiled with a target attribute; functable.c selects it
+ * at runtime. inflate.c pads the window to 32 bytes for it.
+ */
+
+#ifdef X86_AVX2_CHUNKCOPY
+
+#include "zbuild.h"
+#include "zutil.h"
+#include "inftrees.h"
+#include "inflate.h"
+#include "inffast.h"
+#include "memcopy.h"
+#include <immintrin.h>
+
+typedef __m256i inffast_chunk_t;
+#define INFFAST_CHUNKSIZE sizeof(inffast_chunk_t)
+
+#define INFLATE_FAST inflate_fast_avx2
+#define INFFAST_TARGET __attribute__((target("avx2")))
+#include "inffast_tpl.h"
+
+#endif
@@ -0,0 +1,23 @@
+/* inffast_sse2.c -- inflate_fast() with 16-byte SSE2 match copies
+ *
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#ifdef X86_SSE2_CHUNKCOPY
+
+#include "zbuild.h"
+#include "zutil.h"
+#include "inftrees.h"
+#include "inflate.h"
+#include "inffast.h"
+#include "memcopy.h"
+#include <immintrin.h>
+
+typedef __m128i inffast_chunk_t;
+#define INFFAST_CHUNKSIZE sizeof(inffast_chunk_t)
+
+#define INFLATE_FAST inflate_fast_sse2
+#define INFFAST_TARGET __attribute__((target("sse2")))
+#include "inffast_tpl.h"
+
+#endif
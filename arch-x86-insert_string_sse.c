@@ -17,6 +17,7 @@
  *    (except for the last MIN_MATCH-1 bytes of the input file).
  */
 #ifdef X86_SSE4_2_CRC_HASH
+__attribute__((target("sse4.2")))
 ZLIB_INTERNAL Pos insert_string_sse(deflate_state *const s, const Pos str, unsigned int count) {
     Pos ret = 0;
     unsigned int idx;
@@ -42,11 +43,11 @@ ZLIB_INTERNAL Pos insert_string_sse(deflate_state *const s, const Pos str, unsig
         );
 #endif
         Pos head = s->head[h & s->hash_mask];
-        if (head != str+idx) {
+        if (head != ABS_POS(s, str+idx)) {
             s->prev[(str+idx) & s->w_mask] = head;
-            s->head[h & s->hash_mask] = str+idx;
+            s->head[h & s->hash_mask] = ABS_POS(s, str+idx);
             if (idx == count-1)
-              ret = head;
+              ret = (Pos)REL_POS(s, head);
         } else if (idx == count - 1) {
           ret = str + idx;
         }
@@ -15,17 +15,25 @@
 #else
 // Newer versions of GCC and clang come with cpuid.h
 #include <cpuid.h>
+#include <pthread.h>
 #endif
 
 ZLIB_INTERNAL int x86_cpu_has_sse2;
+ZLIB_INTERNAL int x86_cpu_has_ssse3;
 ZLIB_INTERNAL int x86_cpu_has_sse42;
 ZLIB_INTERNAL int x86_cpu_has_pclmulqdq;
 ZLIB_INTERNAL int x86_cpu_has_tzcnt;
+ZLIB_INTERNAL int x86_cpu_has_bmi2;
+ZLIB_INTERNAL int x86_cpu_has_avx2;
+ZLIB_INTERNAL int x86_cpu_has_avx512;
+ZLIB_INTERNAL int x86_cpu_has_vpclmulqdq;
 
+/* cpuid queries subleaf 0 of leaf info. Leaf 7 has subleaves, so ecx must be
+ * set; __cpuid leaves it undefined. */
 static void cpuid(int info, unsigned* eax, unsigned* ebx, unsigned* ecx, unsigned* edx) {
 #ifdef _MSC_VER
 	unsigned int registers[4];
-	__cpuid(registers, info);
+	__cpuidex(registers, info, 0);
 
 	*eax = registers[0];
 	*ebx = registers[1];
@@ -36,7 +44,7 @@ static void cpuid(int info, unsigned* eax, unsigned* ebx, unsigned* ecx, unsigne
 	unsigned int _ebx;
 	unsigned int _ecx;
 	unsigned int _edx;
-	__cpuid(info, _eax, _ebx, _ecx, _edx);
+	__cpuid_count(info, 0, _eax, _ebx, _ecx, _edx);
 	*eax = _eax;
 	*ebx = _ebx;
 	*ecx = _ecx;
@@ -44,7 +52,19 @@ static void cpuid(int info, unsigned* eax, unsigned* ebx, unsigned* ecx, unsigne
 #endif
 }
 
-void ZLIB_INTERNAL zng_x86_check_features(void) {
+/* xgetbv returns the XCR0 register, which says which register states the OS
+ * saves on context switches. */
+static unsigned xgetbv(void) {
+#ifdef _MSC_VER
+	return (unsigned)_xgetbv(0);
+#else
+	unsigned eax, edx;
+	__asm__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return eax;
+#endif
+}
+
+static void x86_check_features_once(void) {
 	unsigned eax, ebx, ecx, edx;
 	unsigned maxbasic;
 
@@ -53,8 +73,10 @@ void ZLIB_INTERNAL zng_x86_check_features(void) {
 	cpuid(1 /*CPU_PROCINFO_AND_FEATUREBITS*/, &eax, &ebx, &ecx, &edx);
 
 	x86_cpu_has_sse2 = edx & 0x4000000;
+	x86_cpu_has_ssse3 = ecx & 0x200;
 	x86_cpu_has_sse42 = ecx & 0x100000;
 	x86_cpu_has_pclmulqdq = ecx & 0x2;
+	int has_osxsave = ecx & 0x8000000;
 
 	if (maxbasic >= 7) {
 	  cpuid(7, &eax, &ebx, &ecx, &edx);
@@ -62,7 +84,30 @@ void ZLIB_INTERNAL zng_x86_check_features(void) {
 	  // check BMI1 bit
 	  // Reference: https://software.intel.com/sites/default/files/article/405250/how-to-detect-new-instruction-support-in-the-4th-generation-intel-core-processor-family.pdf
 	  x86_cpu_has_tzcnt = ebx & 0x8;
+	  x86_cpu_has_bmi2 = ebx & 0x100;
+
+	  // AVX2 needs the OS to save the YMM state (XCR0 bits 1-2), and AVX-512
+	  // the ZMM and opmask states as well (bits 5-7).
+	  unsigned xcr0 = has_osxsave ? xgetbv() : 0;
+	  x86_cpu_has_avx2 = (ebx & 0x20) && (xcr0 & 0x6) == 0x6;
+	  x86_cpu_has_avx512 = (ebx & 0x10000) && (ebx & 0x40000000) && (xcr0 & 0xe6) == 0xe6;
+	  x86_cpu_has_vpclmulqdq = x86_cpu_has_avx512 && x86_cpu_has_pclmulqdq && (ecx & 0x400);
 	} else {
 	  x86_cpu_has_tzcnt = 0;
+	  x86_cpu_has_bmi2 = 0;
+	  x86_cpu_has_avx2 = 0;
+	  x86_cpu_has_avx512 = 0;
+	  x86_cpu_has_vpclmulqdq = 0;
 	}
 }
+
+/* zng_x86_check_features runs the CPU check once per process. deflateInit and
+ * the functable stubs call it freely. */
+void ZLIB_INTERNAL zng_x86_check_features(void) {
+#ifdef _MSC_VER
+	x86_check_features_once();
+#else
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, x86_check_features_once);
+#endif
+}
@@ -15,9 +15,14 @@
 #endif
 
 extern int x86_cpu_has_sse2;
+extern int x86_cpu_has_ssse3;
 extern int x86_cpu_has_sse42;
 extern int x86_cpu_has_pclmulqdq;
 extern int x86_cpu_has_tzcnt;
+extern int x86_cpu_has_bmi2;
+extern int x86_cpu_has_avx2;
+extern int x86_cpu_has_avx512;  /* AVX512F and AVX512BW */
+extern int x86_cpu_has_vpclmulqdq;  /* VPCLMULQDQ on 512-bit registers */
 
 void ZLIB_INTERNAL zng_x86_check_features(void);
 
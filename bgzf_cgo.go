@@ -0,0 +1,151 @@
+// +build cgo,amd64
+
+package zlibng
+
+/*
+#include <stdlib.h>
+#include "./zlib-ng.h"
+#include "./zstream.h"
+*/
+import "C"
+
+import (
+	"encoding/binary"
+	"errors"
+	"io"
+	"io/ioutil"
+)
+
+// bgzfExtra is the gzip extra field of a BGZF block. The last two bytes
+// (BSIZE) are filled after the block is compressed.
+var bgzfExtra = []byte{'B', 'C', 2, 0, 0, 0}
+
+// bgzfBSizeOffset is the offset of the BSIZE field in a BGZF block.
+const bgzfBSizeOffset = 16
+
+func (z *Writer) initBGZF() error {
+	if z.bgzfBuf == nil {
+		z.bgzfBuf = make([]byte, 0, bgzfMaxInputSize)
+	}
+	z.gzHeader.extra = (*C.uchar)(C.CBytes(bgzfExtra))
+	z.gzHeader.extra_len = C.uint(len(bgzfExtra))
+	z.gzHeader.os = 255
+	return zlibReturnCodeToError(C.zs_deflate_set_header(&z.zs[0], &z.gzHeader))
+}
+
+// VirtualOffset returns the BGZF virtual offset of the next byte to be
+// written.
+//
+// REQUIRES: Opts.BGZF=true when the writer was created.
+func (z *Writer) VirtualOffset() VirtualOffset {
+	return NewVirtualOffset(z.outOffset, len(z.bgzfBuf))
+}
+
+func (z *Writer) writeBGZF(in []byte) (int, error) {
+	n := len(in)
+	for len(in) > 0 {
+		room := bgzfMaxInputSize - len(z.bgzfBuf)
+		if room > len(in) {
+			room = len(in)
+		}
+		z.bgzfBuf = append(z.bgzfBuf, in[:room]...)
+		in = in[room:]
+		if len(z.bgzfBuf) == bgzfMaxInputSize {
+			if err := z.flushBGZFBlock(z.bgzfBuf); err != nil {
+				return 0, err
+			}
+			z.bgzfBuf = z.bgzfBuf[:0]
+		}
+	}
+	return n, nil
+}
+
+// flushBGZFBlock compresses data into one or more BGZF blocks and writes them
+// out.
+func (z *Writer) flushBGZFBlock(data []byte) error {
+	outLen := &z.cArgs[0]
+	*outLen = C.int(BGZFMaxBlockSize)
+	ret := C.zs_deflate_member(&z.zs[0], bufPtr(data), C.int(len(data)),
+		bufPtr(z.outBuf), outLen)
+	if ret == C.Z_BUF_ERROR && len(data) > 1 {
+		// The data expanded beyond the BGZF block limit. Split it.
+		if err := z.flushBGZFBlock(data[:len(data)/2]); err != nil {
+			return err
+		}
+		return z.flushBGZFBlock(data[len(data)/2:])
+	}
+	if ret != 0 {
+		return zlibReturnCodeToError(ret)
+	}
+	n := BGZFMaxBlockSize - int(*outLen)
+	block := z.outBuf[:n]
+	binary.LittleEndian.PutUint16(block[bgzfBSizeOffset:], uint16(n-1))
+	if err := z.flush(block); err != nil {
+		return err
+	}
+	z.outOffset += int64(n)
+	return nil
+}
+
+func (z *Writer) closeBGZF() error {
+	if len(z.bgzfBuf) > 0 {
+		if err := z.flushBGZFBlock(z.bgzfBuf); err != nil {
+			return err
+		}
+		z.bgzfBuf = z.bgzfBuf[:0]
+	}
+	if err := z.flush(BGZFEOF); err != nil {
+		return err
+	}
+	z.outOffset += int64(len(BGZFEOF))
+	return nil
+}
+
+// VirtualOffset returns the BGZF virtual offset of the next byte to be
+// returned by Read. The compressed offset is relative to the position of the
+// underlying reader when NewReader was called.
+func (z *Reader) VirtualOffset() VirtualOffset {
+	return NewVirtualOffset(z.blockStart, z.blockOut)
+}
+
+// SeekVirtualOffset moves the read position to the given BGZF virtual offset.
+// Only the block containing the offset is decompressed.
+//
+// REQUIRES: The underlying reader implements io.Seeker, and it was positioned
+// at offset zero when NewReader was called.
+func (z *Reader) SeekVirtualOffset(off VirtualOffset) error {
+	if z.freed {
+		return errClosed
+	}
+	seeker, ok := z.in.(io.Seeker)
+	if !ok {
+		return errors.New("zlibng.SeekVirtualOffset: reader is not an io.Seeker")
+	}
+	coff := off.CompressedOffset()
+	if _, err := seeker.Seek(coff, io.SeekStart); err != nil {
+		return err
+	}
+	if ec := C.zs_inflate_discard(&z.zs[0]); ec != 0 {
+		z.err = zlibReturnCodeToError(ec)
+		return z.err
+	}
+	z.inConsumed = true
+	z.inEOF = false
+	z.err = nil
+	z.inOffset = coff
+	z.blockStart = coff
+	z.blockOut = 0
+	if skip := off.UncompressedOffset(); skip > 0 {
+		n, err := io.CopyN(ioutil.Discard, z, int64(skip))
+		if err != nil {
+			if err == io.EOF {
+				err = io.ErrUnexpectedEOF
+			}
+			return err
+		}
+		if n != int64(skip) {
+			return io.ErrUnexpectedEOF
+		}
+	}
+	return nil
+}
@@ -0,0 +1,225 @@
+// +build cgo
+
+package zlibng_test
+
+import (
+	"bytes"
+	"compress/gzip"
+	"encoding/binary"
+	"io"
+	"io/ioutil"
+	"math/rand"
+	"runtime"
+	"testing"
+
+	"github.com/grailbio/testutil/assert"
+	"github.com/yasushi-saito/zlibng"
+)
+
+type bgzfMark struct {
+	off  zlibng.VirtualOffset
+	uoff int // offset in the uncompressed data
+}
+
+func writeBGZF(t *testing.T, r *rand.Rand, level int, data []byte) ([]byte, []bgzfMark) {
+	out := bytes.Buffer{}
+	zout, err := zlibng.NewWriter(&out, zlibng.Opts{Level: level, BGZF: true})
+	assert.NoError(t, err)
+	var marks []bgzfMark
+	for off := 0; off < len(data); {
+		marks = append(marks, bgzfMark{zout.VirtualOffset(), off})
+		n := r.Intn(100000)
+		if n > len(data)-off {
+			n = len(data) - off
+		}
+		_, err := zout.Write(data[off : off+n])
+		assert.NoError(t, err)
+		off += n
+	}
+	assert.NoError(t, zout.Close())
+	return out.Bytes(), marks
+}
+
+func TestBGZFFormat(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	for _, level := range []int{-1, 1, 9} {
+		data := compressibleData(r, 3<<20)
+		random := make([]byte, 1<<20)
+		r.Read(random)
+		data = append(data, random...)
+		compressed, _ := writeBGZF(t, r, level, data)
+		assert.True(t, bytes.HasSuffix(compressed, zlibng.BGZFEOF))
+
+		// Check the BC subfield of every block.
+		nBlocks := 0
+		for off := 0; off < len(compressed); nBlocks++ {
+			block := compressed[off:]
+			assert.EQ(t, block[3]&4, byte(4)) // FEXTRA
+			assert.EQ(t, binary.LittleEndian.Uint16(block[10:]), uint16(6))
+			assert.EQ(t, block[12:16], []byte{'B', 'C', 2, 0})
+			size := int(binary.LittleEndian.Uint16(block[16:])) + 1
+			assert.LE(t, size, zlibng.BGZFMaxBlockSize)
+			off += size
+			assert.LE(t, off, len(compressed))
+		}
+		assert.GT(t, nBlocks, len(data)/0xff00)
+
+		zin, err := gzip.NewReader(bytes.NewReader(compressed))
+		assert.NoError(t, err)
+		got, err := ioutil.ReadAll(zin)
+		assert.NoError(t, err)
+		assert.True(t, bytes.Equal(got, data))
+	}
+}
+
+func TestBGZFSeek(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	data := compressibleData(r, 4<<20)
+	compressed, marks := writeBGZF(t, r, -1, data)
+
+	zin, err := zlibng.NewReader(bytes.NewReader(compressed))
+	assert.NoError(t, err)
+	buf := make([]byte, 1000)
+	for i := 0; i < 100; i++ {
+		m := marks[r.Intn(len(marks))]
+		assert.NoError(t, zin.SeekVirtualOffset(m.off))
+		assert.EQ(t, zin.VirtualOffset(), m.off)
+		want := data[m.uoff:]
+		if len(want) > len(buf) {
+			want = want[:len(buf)]
+		}
+		n, err := io.ReadFull(zin, buf[:len(want)])
+		assert.NoError(t, err)
+		assert.EQ(t, buf[:n], want)
+	}
+
+	// Read sequentially and check that VirtualOffset agrees with the writer.
+	assert.NoError(t, zin.SeekVirtualOffset(0))
+	uoff := 0
+	for _, m := range marks {
+		_, err := io.ReadFull(zin, make([]byte, m.uoff-uoff))
+		assert.NoError(t, err)
+		uoff = m.uoff
+		got := zin.VirtualOffset()
+		if got != m.off {
+			// (block, blocksize) and (nextblock, 0) denote the same position.
+			assert.EQ(t, m.off.UncompressedOffset(), 0)
+			assert.NoError(t, zin.SeekVirtualOffset(m.off))
+		}
+	}
+	assert.NoError(t, zin.Close())
+}
+
+func readAllRandomly(t *testing.T, r *rand.Rand, in io.Reader) ([]byte, error) {
+	var (
+		got []byte
+		buf = make([]byte, 200000)
+	)
+	for {
+		n, err := in.Read(buf[:r.Intn(len(buf))])
+		got = append(got, buf[:n]...)
+		if err == io.EOF {
+			return got, nil
+		}
+		if err != nil {
+			return got, err
+		}
+	}
+}
+
+func TestParallelInflateBGZF(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	data := compressibleData(r, 8<<20)
+	compressed, _ := writeBGZF(t, r, -1, data)
+	for _, concurrency := range []int{1, 3, 8} {
+		zin, err := zlibng.NewParallelReader(bytes.NewReader(compressed), zlibng.Opts{Concurrency: concurrency})
+		assert.NoError(t, err)
+		got, err := readAllRandomly(t, r, zin)
+		assert.NoError(t, err)
+		assert.True(t, bytes.Equal(got, data))
+		assert.NoError(t, zin.Close())
+	}
+}
+
+func TestParallelInflateMixed(t *testing.T) {
+	// BGZF blocks followed by ordinary gzip members.
+	r := rand.New(rand.NewSource(0))
+	data := compressibleData(r, 3<<20)
+	compressed, _ := writeBGZF(t, r, 5, data[:1<<20])
+	compressed = compressed[:len(compressed)-len(zlibng.BGZFEOF)]
+	buf := bytes.NewBuffer(compressed)
+	for _, part := range [][]byte{data[1<<20 : 2<<20], data[2<<20:]} {
+		gz := gzip.NewWriter(buf)
+		_, err := gz.Write(part)
+		assert.NoError(t, err)
+		assert.NoError(t, gz.Close())
+	}
+	zin, err := zlibng.NewParallelReader(bytes.NewReader(buf.Bytes()), zlibng.Opts{Concurrency: 4})
+	assert.NoError(t, err)
+	got, err := readAllRandomly(t, r, zin)
+	assert.NoError(t, err)
+	assert.True(t, bytes.Equal(got, data))
+	assert.NoError(t, zin.Close())
+}
+
+func TestParallelInflateCorrupt(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	data := compressibleData(r, 1<<20)
+	compressed, _ := writeBGZF(t, r, -1, data)
+
+	// Truncated input.
+	zin, err := zlibng.NewParallelReader(bytes.NewReader(compressed[:len(compressed)/2]))
+	assert.NoError(t, err)
+	_, err = readAllRandomly(t, r, zin)
+	assert.NE(t, err, nil)
+	assert.NE(t, zin.Close(), nil)
+
+	// Corrupt deflate data in the middle of a block.
+	corrupt := append([]byte{}, compressed...)
+	for i := 100; i < 200; i++ {
+		corrupt[i] ^= 0x55
+	}
+	zin, err = zlibng.NewParallelReader(bytes.NewReader(corrupt))
+	assert.NoError(t, err)
+	_, err = readAllRandomly(t, r, zin)
+	assert.NE(t, err, nil)
+	assert.NE(t, zin.Close(), nil)
+
+	// Close without reading everything.
+	zin, err = zlibng.NewParallelReader(bytes.NewReader(compressed), zlibng.Opts{Concurrency: 2})
+	assert.NoError(t, err)
+	_, err = zin.Read(make([]byte, 10))
+	assert.NoError(t, err)
+	assert.NoError(t, zin.Close())
+}
+
+func benchmarkInflateBGZF(b *testing.B, concurrency int) {
+	b.StopTimer()
+	data, err := ioutil.ReadFile(*testSmallPathFlag)
+	assert.NoError(b, err)
+	out := bytes.Buffer{}
+	zout, err := zlibng.NewWriter(&out, zlibng.Opts{Level: 5, BGZF: true})
+	assert.NoError(b, err)
+	_, err = zout.Write(data)
+	assert.NoError(b, err)
+	assert.NoError(b, zout.Close())
+	b.SetBytes(int64(len(data)))
+	b.StartTimer()
+
+	for i := 0; i < b.N; i++ {
+		var zin io.ReadCloser
+		if concurrency == 0 {
+			zin, err = zlibng.NewReader(bytes.NewReader(out.Bytes()))
+		} else {
+			zin, err = zlibng.NewParallelReader(bytes.NewReader(out.Bytes()), zlibng.Opts{Concurrency: concurrency})
+		}
+		assert.NoError(b, err)
+		n, err := io.Copy(ioutil.Discard, zin)
+		assert.NoError(b, err)
+		assert.EQ(b, n, int64(len(data)))
+		assert.NoError(b, zin.Close())
+	}
+}
+
+func BenchmarkInflateBGZFSerial(b *testing.B)   { benchmarkInflateBGZF(b, 0) }
+func BenchmarkInflateBGZFParallel(b *testing.B) { benchmarkInflateBGZF(b, runtime.NumCPU()) }
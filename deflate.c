@@ -73,12 +73,16 @@ typedef block_state (*compress_func) (deflate_state *s, int flush);
 static int deflateStateCheck      (PREFIX3(stream) *strm);
 static void slide_hash            (deflate_state *s);
 static block_state deflate_stored (deflate_state *s, int flush);
+static block_state deflate_level  (deflate_state *s, int flush);
+static block_state deflate_sampled(deflate_state *s, int flush);
 ZLIB_INTERNAL block_state deflate_fast         (deflate_state *s, int flush);
 ZLIB_INTERNAL block_state deflate_quick        (deflate_state *s, int flush);
+ZLIB_INTERNAL block_state deflate_quick_dynamic(deflate_state *s, int flush);
 #ifdef MEDIUM_STRATEGY
 ZLIB_INTERNAL block_state deflate_medium       (deflate_state *s, int flush);
 #endif
 ZLIB_INTERNAL block_state deflate_slow         (deflate_state *s, int flush);
+ZLIB_INTERNAL block_state deflate_optimal      (deflate_state *s, int flush);
 static block_state deflate_rle   (deflate_state *s, int flush);
 static block_state deflate_huff  (deflate_state *s, int flush);
 static void lm_init              (deflate_state *s);
@@ -99,8 +103,11 @@ extern void copy_with_crc(PREFIX3(stream) *strm, unsigned char *dst, unsigned lo
 #define NIL 0
 /* Tail of hash chains */
 
+#define MAX_LEVEL 12
+/* Highest compression level */
+
 /* Values for max_lazy_match, good_match and max_chain_length, depending on
- * the desired pack level (0..9). The values given below have been tuned to
+ * the desired pack level (0..12). The values given below have been tuned to
  * exclude worst case performance for pathological files. Better values may be
  * found for specific files.
  */
@@ -112,7 +119,7 @@ typedef struct config_s {
     compress_func func;
 } config;
 
-static const config configuration_table[10] = {
+static const config configuration_table[MAX_LEVEL+1] = {
 /*      good lazy nice chain */
 /* 0 */ {0,    0,  0,    0, deflate_stored},  /* store only */
 
@@ -138,11 +145,15 @@ static const config configuration_table[10] = {
 
 /* 7 */ {8,   32, 128,  256, deflate_slow},
 /* 8 */ {32, 128, 258, 1024, deflate_slow},
-/* 9 */ {32, 258, 258, 4096, deflate_slow}}; /* max compression */
+/* 9 */ {32, 258, 258, 4096, deflate_slow},  /* max compression with lazy matches */
+
+/* 10 */ {32, 258, 128,  256, deflate_optimal},  /* optimal parse */
+/* 11 */ {32, 258, 258, 1024, deflate_optimal},
+/* 12 */ {32, 258, 258, 4096, deflate_optimal}}; /* max compression */
 
 /* Note: the deflate() code requires max_lazy >= MIN_MATCH and max_chain >= 4
  * For deflate_fast() (levels <= 3) good is ignored and lazy has a different
- * meaning.
+ * meaning. deflate_optimal() (levels >= 10) ignores good and lazy.
  */
 
 /* rank Z_BLOCK between Z_NO_FLUSH and Z_PARTIAL_FLUSH */
@@ -159,10 +170,31 @@ static const config configuration_table[10] = {
   } while (0)
 
 /* ===========================================================================
- * Slide the hash table when sliding the window down (could be avoided with 32
- * bit values at the expense of memory usage). We slide even when level == 0 to
- * keep the hash table consistent if we switch back to level > 0 later.
+ * Slide the hash table when sliding the window down (avoided with 32 bit
+ * values, at the expense of memory usage, see DEFLATE_POS32). We slide even
+ * when level == 0 to keep the hash table consistent if we switch back to
+ * level > 0 later.
+ */
+#ifdef DEFLATE_POS32
+/* With 32-bit positions, only pos_base moves with the window. Before the
+ * positions can wrap around, that is every 4GB of input, the tables are
+ * rebased once to pos_base 0.
  */
+static void slide_hash(deflate_state *s) {
+    Pos base = s->pos_base + s->w_size;
+    unsigned int i;
+
+    if (s->pos_base <= 0xffffffffU - 3 * s->w_size) {
+        s->pos_base = base;
+        return;
+    }
+    for (i = 0; i < s->hash_size; i++)
+        s->head[i] = s->head[i] > base ? s->head[i] - base : NIL;
+    for (i = 0; i < s->w_size; i++)
+        s->prev[i] = s->prev[i] > base ? s->prev[i] - base : NIL;
+    s->pos_base = 0;
+}
+#else
 static void slide_hash(deflate_state *s) {
     unsigned n;
     Pos *p;
@@ -219,6 +251,7 @@ static void slide_hash(deflate_state *s) {
             }
 #endif /* NOT_TWEAK_COMPILER */
 }
+#endif /* DEFLATE_POS32 */
 
 /* ========================================================================= */
 int ZEXPORT PREFIX(deflateInit_)(PREFIX3(stream) *strm, int level, const char *version, int stream_size) {
@@ -229,7 +262,6 @@ int ZEXPORT PREFIX(deflateInit_)(PREFIX3(stream) *strm, int level, const char *v
 /* ========================================================================= */
 int ZEXPORT PREFIX(deflateInit2_)(PREFIX3(stream) *strm, int level, int method, int windowBits,
                            int memLevel, int strategy, const char *version, int stream_size) {
-    unsigned window_padding = 0;
     deflate_state *s;
     int wrap = 1;
     static const char my_version[] = PREFIX2(VERSION);
@@ -265,7 +297,7 @@ int ZEXPORT PREFIX(deflateInit2_)(PREFIX3(stream) *strm, int level, int method,
 #endif
     }
     if (memLevel < 1 || memLevel > MAX_MEM_LEVEL || method != Z_DEFLATED || windowBits < 8 ||
-        windowBits > 15 || level < 0 || level > 9 || strategy < 0 || strategy > Z_FIXED ||
+        windowBits > 15 || level < 0 || level > MAX_LEVEL || strategy < 0 || strategy > Z_FIXED ||
         (windowBits == 8 && wrap != 1)) {
         return Z_STREAM_ERROR;
     }
@@ -303,11 +335,7 @@ int ZEXPORT PREFIX(deflateInit2_)(PREFIX3(stream) *strm, int level, int method,
     s->hash_shift =  ((s->hash_bits+MIN_MATCH-1)/MIN_MATCH);
 #endif
 
-#ifdef X86_PCLMULQDQ_CRC
-    window_padding = 8;
-#endif
-
-    s->window = (unsigned char *) ZALLOC(strm, s->w_size + window_padding, 2*sizeof(unsigned char));
+    s->window = (unsigned char *) ZALLOC(strm, 2 * s->w_size + WINDOW_PADDING, sizeof(unsigned char));
     s->prev   = (Pos *)  ZALLOC(strm, s->w_size, sizeof(Pos));
     memset(s->prev, 0, s->w_size * sizeof(Pos));
     s->head   = (Pos *)  ZALLOC(strm, s->hash_size, sizeof(Pos));
@@ -358,8 +386,12 @@ int ZEXPORT PREFIX(deflateInit2_)(PREFIX3(stream) *strm, int level, int method,
     s->pending_buf = (unsigned char *) ZALLOC(strm, s->lit_bufsize, 4);
     s->pending_buf_size = (unsigned long)s->lit_bufsize * 4;
 
+    s->opt = NULL;
+    if (configuration_table[level].func == deflate_optimal)
+        s->opt = (opt_state *) ZALLOC(strm, 1, sizeof(opt_state));
+
     if (s->window == NULL || s->prev == NULL || s->head == NULL ||
-        s->pending_buf == NULL) {
+        s->pending_buf == NULL || (configuration_table[level].func == deflate_optimal && s->opt == NULL)) {
         s->status = FINISH_STATE;
         strm->msg = ERR_MSG(Z_MEM_ERROR);
         PREFIX(deflateEnd)(strm);
@@ -376,6 +408,9 @@ int ZEXPORT PREFIX(deflateInit2_)(PREFIX3(stream) *strm, int level, int method,
     s->strategy = strategy;
     s->method = (unsigned char)method;
     s->block_open = 0;
+    s->block_split = 0;
+    s->store_incompressible = 0;
+    s->quick_dynamic = 0;
 
     return PREFIX(deflateReset)(strm);
 }
@@ -420,7 +455,7 @@ int ZEXPORT PREFIX(deflateSetDictionary)(PREFIX3(stream) *strm, const unsigned c
 
     /* when using zlib wrappers, compute Adler-32 for provided dictionary */
     if (wrap == 1)
-        strm->adler = zng_functable.adler32(strm->adler, dictionary, dictLength);
+        strm->adler = FUNCTABLE_GET(adler32)(strm->adler, dictionary, dictLength);
     s->wrap = 0;                    /* avoid computing Adler-32 in read_buf */
 
     /* if dictionary would fill window, just replace the history */
@@ -440,14 +475,14 @@ int ZEXPORT PREFIX(deflateSetDictionary)(PREFIX3(stream) *strm, const unsigned c
     next = strm->next_in;
     strm->avail_in = dictLength;
     strm->next_in = (const unsigned char *)dictionary;
-    zng_functable.fill_window(s);
+    FUNCTABLE_GET(fill_window)(s);
     while (s->lookahead >= MIN_MATCH) {
         str = s->strstart;
         n = s->lookahead - (MIN_MATCH-1);
-        zng_functable.insert_string(s, str, n);
+        FUNCTABLE_GET(insert_string)(s, str, n);
         s->strstart = str + n;
         s->lookahead = MIN_MATCH-1;
-        zng_functable.fill_window(s);
+        FUNCTABLE_GET(fill_window)(s);
     }
     s->strstart += s->lookahead;
     s->block_start = (long)s->strstart;
@@ -509,8 +544,9 @@ int ZEXPORT PREFIX(deflateResetKeep)(PREFIX3(stream) *strm) {
         crc_reset(s);
     else
 #endif
-        strm->adler = zng_functable.adler32(0L, NULL, 0);
+        strm->adler = FUNCTABLE_GET(adler32)(0L, NULL, 0);
     s->last_flush = -2;
+    s->block_open = 0;
 
     _zng_tr_init(s);
 
@@ -561,7 +597,7 @@ int ZEXPORT PREFIX(deflatePrime)(PREFIX3(stream) *strm, int bits, int value) {
         put = Buf_size - s->bi_valid;
         if (put > bits)
             put = bits;
-        s->bi_buf |= (uint16_t)((value & ((1 << put) - 1)) << s->bi_valid);
+        s->bi_buf |= (uint64_t)(value & ((1 << put) - 1)) << s->bi_valid;
         s->bi_valid += put;
         _zng_tr_flush_bits(s);
         value >>= put;
@@ -581,7 +617,7 @@ int ZEXPORT PREFIX(deflateParams)(PREFIX3(stream) *strm, int level, int strategy
 
     if (level == Z_DEFAULT_COMPRESSION)
         level = 6;
-    if (level < 0 || level > 9 || strategy < 0 || strategy > Z_FIXED) {
+    if (level < 0 || level > MAX_LEVEL || strategy < 0 || strategy > Z_FIXED) {
         return Z_STREAM_ERROR;
     }
     func = configuration_table[s->level].func;
@@ -595,6 +631,12 @@ int ZEXPORT PREFIX(deflateParams)(PREFIX3(stream) *strm, int level, int strategy
         if (strm->avail_in || (s->strstart - s->block_start) + s->lookahead)
             return Z_BUF_ERROR;
     }
+    if (configuration_table[level].func == deflate_optimal && s->opt == NULL) {
+        s->opt = (opt_state *) ZALLOC(strm, 1, sizeof(opt_state));
+        if (s->opt == NULL)
+            return Z_MEM_ERROR;
+        s->opt->more = 0;
+    }
     if (s->level != level) {
         if (s->level == 0 && s->matches != 0) {
             if (s->matches == 1) {
@@ -614,6 +656,75 @@ int ZEXPORT PREFIX(deflateParams)(PREFIX3(stream) *strm, int level, int strategy
     return Z_OK;
 }
 
+/* =========================================================================
+ * Make the blocks also end where the statistics of their symbols change. The
+ * symbol buffer is then 1 << SPLIT_BUF_SHIFT times larger, so that stable
+ * input gets larger blocks. This must be called before the first deflate call.
+ */
+#define SPLIT_BUF_SHIFT 3
+
+int ZEXPORT PREFIX(deflateBlockSplit)(PREFIX3(stream) *strm, int on) {
+    deflate_state *s;
+    unsigned int lit_bufsize;
+    unsigned char *pending_buf;
+
+    if (deflateStateCheck(strm))
+        return Z_STREAM_ERROR;
+    s = strm->state;
+    if (s->last_flush != -2 || s->pending != 0)
+        return Z_STREAM_ERROR;
+    on = on != 0;
+    if (on == s->block_split)
+        return Z_OK;
+
+    lit_bufsize = on ? s->lit_bufsize << SPLIT_BUF_SHIFT : s->lit_bufsize >> SPLIT_BUF_SHIFT;
+    pending_buf = (unsigned char *) ZALLOC(strm, lit_bufsize, 4);
+    if (pending_buf == NULL)
+        return Z_MEM_ERROR;
+    ZFREE(strm, s->pending_buf);
+    s->lit_bufsize = lit_bufsize;
+    s->pending_buf = s->pending_out = pending_buf;
+    s->pending_buf_size = (unsigned long)lit_bufsize * 4;
+    s->sym_buf = pending_buf + lit_bufsize;
+    s->sym_end = (lit_bufsize - 1) * 3;
+    s->block_split = on;
+    _zng_tr_init(s);
+    return Z_OK;
+}
+
+/* =========================================================================
+ * Store the input that looks random instead of compressing it, see
+ * deflate_sampled(). This must be called before the first deflate call.
+ */
+int ZEXPORT PREFIX(deflateStoreIncompressible)(PREFIX3(stream) *strm, int on) {
+    deflate_state *s;
+
+    if (deflateStateCheck(strm))
+        return Z_STREAM_ERROR;
+    s = strm->state;
+    if (s->last_flush != -2)
+        return Z_STREAM_ERROR;
+    s->store_incompressible = on != 0;
+    return Z_OK;
+}
+
+/* =========================================================================
+ * Make level 1 send its blocks with Huffman trees built for each block, see
+ * deflate_quick_dynamic(), instead of with the static trees. This must be
+ * called before the first deflate call.
+ */
+int ZEXPORT PREFIX(deflateQuickDynamic)(PREFIX3(stream) *strm, int on) {
+    deflate_state *s;
+
+    if (deflateStateCheck(strm))
+        return Z_STREAM_ERROR;
+    s = strm->state;
+    if (s->last_flush != -2)
+        return Z_STREAM_ERROR;
+    s->quick_dynamic = on != 0;
+    return Z_OK;
+}
+
 /* ========================================================================= */
 int ZEXPORT PREFIX(deflateTune)(PREFIX3(stream) *strm, int good_length, int max_lazy, int nice_length, int max_chain) {
     deflate_state *s;
@@ -694,8 +805,9 @@ unsigned long ZEXPORT PREFIX(deflateBound)(PREFIX3(stream) *strm, unsigned long
         wraplen = 6;
     }
 
-    /* if not default parameters, return conservative bound */
-    if (s->w_bits != 15 || s->hash_bits != 8 + 7)
+    /* if not default parameters, or if the blocks may be smaller, return
+     * conservative bound */
+    if (s->w_bits != 15 || s->hash_bits != 8 + 7 || s->block_split || s->store_incompressible)
         return complen + wraplen;
 
     /* default settings: return tight bound for that case */
@@ -824,7 +936,7 @@ int ZEXPORT PREFIX(deflate)(PREFIX3(stream) *strm, int flush) {
             putShortMSB(s, (uint16_t)(strm->adler >> 16));
             putShortMSB(s, (uint16_t)(strm->adler));
         }
-        strm->adler = zng_functable.adler32(0L, NULL, 0);
+        strm->adler = FUNCTABLE_GET(adler32)(0L, NULL, 0);
         s->status = BUSY_STATE;
 
         /* Compression must start with an empty pending buffer */
@@ -847,7 +959,7 @@ int ZEXPORT PREFIX(deflate)(PREFIX3(stream) *strm, int flush) {
             put_byte(s, 0);
             put_byte(s, 0);
             put_byte(s, 0);
-            put_byte(s, s->level == 9 ? 2 :
+            put_byte(s, s->level >= 9 ? 2 :
                      (s->strategy >= Z_HUFFMAN_ONLY || s->level < 2 ? 4 : 0));
             put_byte(s, OS_CODE);
             s->status = BUSY_STATE;
@@ -870,7 +982,7 @@ int ZEXPORT PREFIX(deflate)(PREFIX3(stream) *strm, int flush) {
             put_byte(s, (unsigned char)((s->gzhead->time >> 8) & 0xff));
             put_byte(s, (unsigned char)((s->gzhead->time >> 16) & 0xff));
             put_byte(s, (unsigned char)((s->gzhead->time >> 24) & 0xff));
-            put_byte(s, s->level == 9 ? 2 :
+            put_byte(s, s->level >= 9 ? 2 :
                      (s->strategy >= Z_HUFFMAN_ONLY || s->level < 2 ? 4 : 0));
             put_byte(s, s->gzhead->os & 0xff);
             if (s->gzhead->extra != NULL) {
@@ -984,12 +1096,8 @@ int ZEXPORT PREFIX(deflate)(PREFIX3(stream) *strm, int flush) {
         block_state bstate;
 
         bstate = s->level == 0 ? deflate_stored(s, flush) :
-                 s->strategy == Z_HUFFMAN_ONLY ? deflate_huff(s, flush) :
-                 s->strategy == Z_RLE ? deflate_rle(s, flush) :
-#ifdef X86_QUICK_STRATEGY
-                 (s->level == 1 && !x86_cpu_has_sse42) ? deflate_fast(s, flush) :
-#endif
-                 (*(configuration_table[s->level].func))(s, flush);
+                 s->store_incompressible ? deflate_sampled(s, flush) :
+                 deflate_level(s, flush);
 
         if (bstate == finish_started || bstate == finish_done) {
             s->status = FINISH_STATE;
@@ -1076,6 +1184,7 @@ int ZEXPORT PREFIX(deflateEnd)(PREFIX3(stream) *strm) {
     status = strm->state->status;
 
     /* Deallocate in reverse order of allocations: */
+    TRY_FREE(strm, strm->state->opt);
     TRY_FREE(strm, strm->state->pending_buf);
     TRY_FREE(strm, strm->state->head);
     TRY_FREE(strm, strm->state->prev);
@@ -1109,12 +1218,16 @@ int ZEXPORT PREFIX(deflateCopy)(PREFIX3(stream) *dest, PREFIX3(stream) *source)
     memcpy((void *)ds, (void *)ss, sizeof(deflate_state));
     ds->strm = dest;
 
-    ds->window = (unsigned char *) ZALLOC(dest, ds->w_size, 2*sizeof(unsigned char));
+    ds->window = (unsigned char *) ZALLOC(dest, 2 * ds->w_size + WINDOW_PADDING, sizeof(unsigned char));
     ds->prev   = (Pos *)  ZALLOC(dest, ds->w_size, sizeof(Pos));
     ds->head   = (Pos *)  ZALLOC(dest, ds->hash_size, sizeof(Pos));
     ds->pending_buf = (unsigned char *) ZALLOC(dest, ds->lit_bufsize, 4);
+    ds->opt = NULL;
+    if (ss->opt != NULL)
+        ds->opt = (opt_state *) ZALLOC(dest, 1, sizeof(opt_state));
 
-    if (ds->window == NULL || ds->prev == NULL || ds->head == NULL || ds->pending_buf == NULL) {
+    if (ds->window == NULL || ds->prev == NULL || ds->head == NULL || ds->pending_buf == NULL ||
+        (ss->opt != NULL && ds->opt == NULL)) {
         PREFIX(deflateEnd)(dest);
         return Z_MEM_ERROR;
     }
@@ -1123,6 +1236,8 @@ int ZEXPORT PREFIX(deflateCopy)(PREFIX3(stream) *dest, PREFIX3(stream) *source)
     memcpy((void *)ds->prev, (void *)ss->prev, ds->w_size * sizeof(Pos));
     memcpy((void *)ds->head, (void *)ss->head, ds->hash_size * sizeof(Pos));
     memcpy(ds->pending_buf, ss->pending_buf, (unsigned int)ds->pending_buf_size);
+    if (ss->opt != NULL)
+        memcpy(ds->opt, ss->opt, sizeof(opt_state));
 
     ds->pending_out = ds->pending_buf + (ss->pending_out - ss->pending_buf);
     ds->sym_buf = ds->pending_buf + ds->lit_bufsize;
@@ -1159,7 +1274,7 @@ ZLIB_INTERNAL unsigned read_buf(PREFIX3(stream) *strm, unsigned char *buf, unsig
     {
         memcpy(buf, strm->next_in, len);
         if (strm->state->wrap == 1)
-            strm->adler = zng_functable.adler32(strm->adler, buf, len);
+            strm->adler = FUNCTABLE_GET(adler32)(strm->adler, buf, len);
     }
     strm->next_in  += len;
     strm->total_in += len;
@@ -1174,6 +1289,9 @@ static void lm_init(deflate_state *s) {
     s->window_size = (unsigned long)2L*s->w_size;
 
     CLEAR_HASH(s);
+#ifdef DEFLATE_POS32
+    s->pos_base = 0;
+#endif
 
     /* Set the default configuration parameters:
      */
@@ -1190,6 +1308,10 @@ static void lm_init(deflate_state *s) {
     s->match_available = 0;
     s->match_start = 0;
     s->ins_h = 0;
+    if (s->opt != NULL)
+        s->opt->more = 0;
+    s->storing = s->store_switch = 0;
+    s->sample_left = 0;
 }
 
 #ifdef ZLIB_DEBUG
@@ -1223,7 +1345,8 @@ void check_match(deflate_state *s, IPos start, IPos match, int length) {
  * Fill the window when the lookahead becomes insufficient.
  * Updates strstart and lookahead.
  *
- * IN assertion: lookahead < MIN_LOOKAHEAD
+ * IN assertion: lookahead < MIN_LOOKAHEAD, or there is room at the end of
+ *    the window (deflate_optimal reads a chunk ahead)
  * OUT assertions: strstart <= window_size-MIN_LOOKAHEAD
  *    At least one byte has been read, or avail_in == 0; reads are
  *    performed for at least two bytes (required for the zip translate_eol
@@ -1235,7 +1358,8 @@ void ZLIB_INTERNAL zng_fill_window_c(deflate_state *s) {
     unsigned more;    /* Amount of free space at the end of the window. */
     unsigned int wsize = s->w_size;
 
-    Assert(s->lookahead < MIN_LOOKAHEAD, "already enough lookahead");
+    Assert(s->lookahead < MIN_LOOKAHEAD || s->strstart + s->lookahead < s->window_size,
+           "already enough lookahead");
 
     do {
         more = (unsigned)(s->window_size -(unsigned long)s->lookahead -(unsigned long)s->strstart);
@@ -1267,7 +1391,7 @@ void ZLIB_INTERNAL zng_fill_window_c(deflate_state *s) {
          * Otherwise, window_size == 2*WSIZE so more >= 2.
          * If there was sliding, more >= WSIZE. So in all cases, more >= 2.
          */
-        Assert(more >= 2, "more < 2");
+        Assert(more >= 2 || s->lookahead >= MIN_LOOKAHEAD, "more < 2");
 
         n = read_buf(s->strm, s->window + s->strstart + s->lookahead, more);
         s->lookahead += n;
@@ -1277,11 +1401,11 @@ void ZLIB_INTERNAL zng_fill_window_c(deflate_state *s) {
             unsigned int str = s->strstart - s->insert;
             s->ins_h = s->window[str];
             if (str >= 1)
-                zng_functable.insert_string(s, str + 2 - MIN_MATCH, 1);
+                FUNCTABLE_GET(insert_string)(s, str + 2 - MIN_MATCH, 1);
 #if MIN_MATCH != 3
 #error Call insert_string() MIN_MATCH-3 more times
             while (s->insert) {
-                zng_functable.insert_string(s, str, 1);
+                FUNCTABLE_GET(insert_string)(s, str, 1);
                 str++;
                 s->insert--;
                 if (s->lookahead + s->insert < MIN_MATCH)
@@ -1294,7 +1418,7 @@ void ZLIB_INTERNAL zng_fill_window_c(deflate_state *s) {
             }else{
                 count = s->insert;
             }
-            zng_functable.insert_string(s,str,count);
+            FUNCTABLE_GET(insert_string)(s,str,count);
             s->insert -= count;
 #endif
         }
@@ -1531,6 +1655,165 @@ static block_state deflate_stored(deflate_state *s, int flush) {
 }
 
 
+/* ===========================================================================
+ * Compress as much as possible with the function of the level and strategy.
+ */
+static block_state deflate_level(deflate_state *s, int flush) {
+    return s->strategy == Z_HUFFMAN_ONLY ? deflate_huff(s, flush) :
+           s->strategy == Z_RLE ? deflate_rle(s, flush) :
+#ifdef X86_QUICK_STRATEGY
+           (s->level == 1 && !x86_cpu_has_sse42) ? deflate_fast(s, flush) :
+           (s->level == 1 && s->quick_dynamic && s->strategy != Z_FIXED) ? deflate_quick_dynamic(s, flush) :
+#endif
+           (*(configuration_table[s->level].func))(s, flush);
+}
+
+#define SAMPLE_SIZE 1024
+/* bytes of input in a sample */
+
+#define SAMPLE_STEP 4096
+/* bytes of input from one sample to the next */
+
+#define SAMPLE_HASH_BITS 10
+/* log2 of the number of entries of the table of sample_repeats() */
+
+/* ===========================================================================
+ * Return true if the bytes of the sample at buf are spread like random bytes:
+ * two of them are equal at most 21/20 times as often as two uniformly random
+ * bytes, i.e., their collision entropy is above 7.93 bits per byte. Text and
+ * binaries are far below that, compressed and encrypted data barely below 8.
+ * When storing, the limit is 5/4 instead, so that the random samples that
+ * are a little over 21/20 do not stop the storing.
+ */
+static int sample_spread(const unsigned char *buf, int storing) {
+    uint32_t limit = (uint32_t)SAMPLE_SIZE * (SAMPLE_SIZE - 1) / 2 / 256;
+    uint32_t count[256];
+    uint32_t pairs = 0;
+    unsigned i;
+
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < SAMPLE_SIZE; i++)
+        count[buf[i]]++;
+    for (i = 0; i < 256; i++)
+        pairs += count[i] * (count[i] - 1) / 2;
+    return storing ? pairs <= limit * 5 / 4 : pairs <= limit * 21 / 20;
+}
+
+/* ===========================================================================
+ * Return true if some strings of MIN_MATCH bytes of the sample at buf occur
+ * in it more than once, as they do in data whose bytes are spread evenly but
+ * that still has matches. A sample of random bytes has 0.03 of them on average.
+ */
+static int sample_repeats(const unsigned char *buf) {
+    uint32_t seen[1 << SAMPLE_HASH_BITS];
+    unsigned i, repeats = 0;
+
+    memset(seen, 0, sizeof(seen));
+    for (i = 0; i + MIN_MATCH <= SAMPLE_SIZE; i++) {
+        uint32_t str = (uint32_t)buf[i] << 16 | (uint32_t)buf[i+1] << 8 | buf[i+2];
+        uint32_t h = (str * 2654435761U) >> (32 - SAMPLE_HASH_BITS);
+
+        /* The strings are stored plus one, so that zero is an empty entry. */
+        if (seen[h] == str + 1)
+            repeats++;
+        else
+            seen[h] = str + 1;
+    }
+    return repeats > 2;
+}
+
+/* ===========================================================================
+ * Return true if the sample at buf says to switch storing: when compressing,
+ * if it looks random, and when storing, if it does not.
+ */
+static int sample_switch(deflate_state *s, const unsigned char *buf) {
+    if (s->storing)
+        return !sample_spread(buf, 1);
+    /* Only look for matches before storing, the input that is stored is not
+     * searched for them anyway.
+     */
+    return sample_spread(buf, 0) && !sample_repeats(buf);
+}
+
+/* ===========================================================================
+ * Compress the input, or store it if it looks random. Every SAMPLE_STEP
+ * bytes, SAMPLE_SIZE bytes of input are sampled, and the input from a sample
+ * that looks random to the next one that does not is stored by
+ * deflate_stored(). That copies the input to next_out, with its check value
+ * computed in the same pass, without filling the hash table. The samples are
+ * taken ahead over all of next_in, so that the input is only cut where
+ * storing is switched. When switching, the current block is first ended with
+ * the data in the window, as deflateParams() does, and the hash table is
+ * brought up to date for the compression after storing.
+ */
+static block_state deflate_sampled(deflate_state *s, int flush) {
+    PREFIX3(stream) *strm = s->strm;
+    block_state bstate;
+
+    for (;;) {
+        unsigned int avail = strm->avail_in;
+        unsigned int chunk = avail;
+        unsigned int used;
+
+        if (s->store_switch) {
+            /* deflate_stored() may return need_more after it wrote the end
+             * of the window to pending_buf, if it could not write it to
+             * next_out directly.
+             */
+            strm->avail_in = 0;
+            do {
+                bstate = s->storing ? deflate_stored(s, Z_BLOCK) : deflate_level(s, Z_BLOCK);
+            } while (bstate == need_more && strm->avail_out != 0);
+            strm->avail_in = avail;
+            if (bstate != block_done)
+                return bstate;
+
+            s->store_switch = 0;
+            s->storing = !s->storing;
+            if (!s->storing && s->matches != 0) {
+                if (s->matches == 1)
+                    slide_hash(s);
+                else
+                    CLEAR_HASH(s);
+            }
+            s->matches = 0;
+            s->sample_left = SAMPLE_STEP;
+            Tracev((stderr, s->storing ? "\n[storing]" : "\n[compressing]"));
+
+            /* deflate_stored() sizes its blocks for an empty pending_buf,
+             * and deflate_quick() may leave the end of its block there.
+             */
+            flush_pending(strm);
+            if (s->pending != 0)
+                return need_more;
+        }
+
+        /* Find the next sample that switches storing, and stop there. */
+        while (s->sample_left + SAMPLE_SIZE <= avail) {
+            if (sample_switch(s, strm->next_in + s->sample_left)) {
+                chunk = s->sample_left;
+                break;
+            }
+            s->sample_left += SAMPLE_STEP;
+        }
+
+        if (chunk != 0 || chunk == avail) {
+            strm->avail_in = chunk;
+            if (s->storing)
+                bstate = deflate_stored(s, chunk == avail ? flush : Z_NO_FLUSH);
+            else
+                bstate = deflate_level(s, chunk == avail ? flush : Z_NO_FLUSH);
+            used = chunk - strm->avail_in;
+            strm->avail_in = avail - used;
+            s->sample_left -= MIN(used, s->sample_left);
+
+            if (chunk == avail || used != chunk || bstate != need_more || strm->avail_out == 0)
+                return bstate;
+        }
+        s->store_switch = 1;
+    }
+}
+
 /* ===========================================================================
  * For Z_RLE, simply look for runs of bytes, generate matches only of distance
  * one.  Do not maintain a hash table.  (It will be regenerated if this run of
@@ -1547,7 +1830,7 @@ static block_state deflate_rle(deflate_state *s, int flush) {
          * for the longest run, plus one for the unrolled loop.
          */
         if (s->lookahead <= MAX_MATCH) {
-            zng_functable.fill_window(s);
+            FUNCTABLE_GET(fill_window)(s);
             if (s->lookahead <= MAX_MATCH && flush == Z_NO_FLUSH) {
                 return need_more;
             }
@@ -1614,7 +1897,7 @@ static block_state deflate_huff(deflate_state *s, int flush) {
     for (;;) {
         /* Make sure that we have a literal to write. */
         if (s->lookahead == 0) {
-            zng_functable.fill_window(s);
+            FUNCTABLE_GET(fill_window)(s);
             if (s->lookahead == 0) {
                 if (flush == Z_NO_FLUSH)
                     return need_more;
@@ -1644,25 +1927,25 @@ static block_state deflate_huff(deflate_state *s, int flush) {
 #ifdef ZLIB_DEBUG
 /* ===========================================================================
  * Send a value on a given number of bits.
- * IN assertion: length <= 16 and value fits in length bits.
+ * IN assertion: length < 64 and value fits in length bits.
  */
-void send_bits(deflate_state *s, int value, int length) {
-    Tracevv((stderr, " l %2d v %4x ", length, value));
-    Assert(length > 0 && length <= 15, "invalid length");
+void send_bits(deflate_state *s, uint64_t value, int length) {
+    int total = s->bi_valid + length;
+
+    Tracevv((stderr, " l %2d v %4llx ", length, (unsigned long long)value));
+    Assert(length > 0 && length < (int)Buf_size, "invalid length");
+    Assert(value < ((uint64_t)1 << length), "value too large");
     s->bits_sent += (unsigned long)length;
 
-    /* If not enough room in bi_buf, use (valid) bits from bi_buf and
-     * (16 - bi_valid) bits from value, leaving (width - (16-bi_valid))
-     * unused bits in value.
+    /* If not enough room in bi_buf, write out bi_buf filled with the low
+     * (64 - bi_valid) bits of value, and keep the remaining bits of value.
      */
-    if (s->bi_valid > (int)Buf_size - length) {
-        s->bi_buf |= (uint16_t)value << s->bi_valid;
-        put_short(s, s->bi_buf);
-        s->bi_buf = (uint16_t)value >> (Buf_size - s->bi_valid);
-        s->bi_valid += length - Buf_size;
-    } else {
-        s->bi_buf |= (uint16_t)value << s->bi_valid;
-        s->bi_valid += length;
+    s->bi_buf |= value << s->bi_valid;
+    if (total >= (int)Buf_size) {
+        put_uint64(s, s->bi_buf);
+        s->bi_buf = value >> (Buf_size - s->bi_valid);
+        total -= Buf_size;
     }
+    s->bi_valid = total;
 }
 #endif
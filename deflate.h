@@ -52,7 +52,7 @@
 #define MAX_BITS 15
 /* All codes must not exceed MAX_BITS bits */
 
-#define Buf_size 16
+#define Buf_size 64
 /* size of bit buffer in bi_buf */
 
 #define END_BLOCK 256
@@ -74,8 +74,8 @@
 /* Data structure describing a single value and its code string. */
 typedef struct ct_data_s {
     union {
-        uint16_t  freq;       /* frequency count */
-        uint16_t  code;       /* bit string */
+        uint16_t  code;       /* bit string, first for the static tree initializers */
+        uint32_t  freq;       /* frequency count, which may exceed 64K in a block */
     } fc;
     union {
         uint16_t  dad;        /* father node in Huffman tree */
@@ -96,13 +96,35 @@ typedef struct tree_desc_s {
     const static_tree_desc *stat_desc; /* the corresponding static tree */
 } tree_desc;
 
+#ifdef DEFLATE_POS32
+typedef uint32_t Pos;
+#else
 typedef uint16_t Pos;
+#endif
 typedef unsigned IPos;
 
 /* A Pos is an index in the character window. We use short instead of int to
  * save space in the various tables. IPos is used only for parameter passing.
+ * With DEFLATE_POS32, the hash tables hold 32-bit positions in the input
+ * instead, see ABS_POS(), so they do not have to be slid with the window.
  */
 
+#define OPT_CHUNK 4096
+/* Number of positions parsed at a time by deflate_optimal */
+
+#define OPT_MATCHES (4*OPT_CHUNK)
+/* Number of matches that deflate_optimal can collect for a chunk */
+
+/* State of deflate_optimal, for the compression levels above 9. */
+typedef struct opt_state_s {
+    unsigned int more;                 /* positions at strstart with their matches collected */
+    uint32_t cost[OPT_CHUNK+1];        /* bits to reach each position */
+    uint16_t step[OPT_CHUNK+1];        /* length of the last step to each position */
+    uint16_t dist[OPT_CHUNK+1];        /* its distance, or 0 for a literal */
+    uint32_t first[OPT_CHUNK+1];       /* index of the first match of each position */
+    uint16_t match[2*OPT_MATCHES];     /* lengths and distances of the matches */
+} opt_state;
+
 typedef struct internal_state {
     PREFIX3(stream)      *strm;            /* pointer back to this zlib stream */
     int                  status;           /* as the name implies */
@@ -149,6 +171,13 @@ typedef struct internal_state {
 
     Pos *head; /* Heads of the hash chains or NIL. */
 
+#ifdef DEFLATE_POS32
+    Pos pos_base;
+    /* Position in the input of the window index 0, minus the positions
+     * dropped by the last rebase of the hash tables, see slide_hash().
+     */
+#endif
+
     unsigned int  ins_h;             /* hash index of string to be inserted */
     unsigned int  hash_size;         /* number of elements in hash table */
     unsigned int  hash_bits;         /* log2(hash_size) */
@@ -197,7 +226,7 @@ typedef struct internal_state {
      * max_insert_length is used only for compression levels <= 3.
      */
 
-    int level;    /* compression level (1..9) */
+    int level;    /* compression level (1..12) */
     int strategy; /* favor or force Huffman coding*/
 
     unsigned int good_match;
@@ -218,17 +247,6 @@ typedef struct internal_state {
     uint16_t bl_count[MAX_BITS+1];
     /* number of codes at each bit length for an optimal tree */
 
-    int heap[2*L_CODES+1];      /* heap used to build the Huffman trees */
-    int heap_len;               /* number of elements in the heap */
-    int heap_max;               /* element of largest frequency */
-    /* The sons of heap[n] are heap[2*n] and heap[2*n+1]. heap[0] is not used.
-     * The same heap array is used to build all trees.
-     */
-
-    unsigned char depth[2*L_CODES+1];
-    /* Depth of each subtree used as tie breaker for trees of equal frequency
-     */
-
     unsigned char *sym_buf;       /* buffer for distances and literals/lengths */
 
     unsigned int  lit_bufsize;
@@ -249,10 +267,15 @@ typedef struct internal_state {
      *     fast adaptation but have of course the overhead of transmitting
      *     trees more frequently.
      *   - I can't count above 4
+     * The frequencies are kept in 32 bits nonetheless, so that
+     * zng_deflateBlockSplit() can raise lit_bufsize above 64K: its blocks
+     * also end where the statistics change.
      */
 
+    unsigned int sym_start;     /* index in sym_buf of the first symbol of the block */
     unsigned int sym_next;      /* running index in sym_buf */
     unsigned int sym_end;       /* symbol table full when sym_next reaches this */
+    unsigned int sym_check;     /* end of block checked when sym_next reaches this */
 
     unsigned long opt_len;        /* bit length of current block with optimal trees */
     unsigned long static_len;     /* bit length of current block with static trees */
@@ -264,9 +287,9 @@ typedef struct internal_state {
     unsigned long bits_sent;      /* bit length of compressed data sent mod 2^32 */
 #endif
 
-    uint16_t bi_buf;
+    uint64_t bi_buf;
     /* Output buffer. bits are inserted starting at the bottom (least
-     * significant bits).
+     * significant bits), and written out 8 bytes at a time.
      */
     int bi_valid;
     /* Number of valid bits in bi_buf.  All bits above the last valid bit
@@ -281,10 +304,36 @@ typedef struct internal_state {
      */
     int block_open;
     /* Whether or not a block is currently open for the QUICK deflation scheme.
-     * This is set to 1 if there is an active block, or 0 if the block was just
-     * closed.
+     * This is set to 1 if there is an active block, 2 if the active block is
+     * the last one, or 0 if the block was just closed.
      */
 
+    opt_state *opt;
+    /* State of deflate_optimal, allocated for the levels above 9 only. */
+
+    int block_split;
+    /* If true, a block also ends where the statistics of its symbols change,
+     * see _zng_tr_block_end().
+     */
+    unsigned int split_sym;
+    /* Value of sym_next at the last check of the current block. */
+    uint64_t split_bits;
+    /* Estimated bits of the current block at its last check, times 65536. */
+    uint32_t split_freq[L_CODES+D_CODES];
+    /* Frequencies of the literal/length and distance codes in the current
+     * block at its last check.
+     */
+
+    int store_incompressible;
+    /* If true, input that looks random is stored, see deflate_sampled(). */
+    int quick_dynamic;
+    /* If true, level 1 builds Huffman trees for each block, see
+     * deflate_quick_dynamic().
+     */
+    int storing;                /* whether the input is currently stored */
+    int store_switch;           /* whether storing is switched before the next input */
+    unsigned int sample_left;   /* bytes of input before the next sample */
+
 } deflate_state;
 
 typedef enum {
@@ -311,6 +360,26 @@ static inline void put_short(deflate_state *s, uint16_t w) {
   s->pending += 2;
 }
 
+/* ===========================================================================
+ * Output a 32-bit and a 64-bit word LSB first on the stream.
+ * IN assertion: there is enough room in pendingBuf.
+ */
+static inline void put_uint32(deflate_state *s, uint32_t w) {
+#if BYTE_ORDER == BIG_ENDIAN
+  w = ZSWAP32(w);
+#endif
+  MEMCPY(&(s->pending_buf[s->pending]), &w, sizeof(uint32_t));
+  s->pending += 4;
+}
+
+static inline void put_uint64(deflate_state *s, uint64_t w) {
+#if BYTE_ORDER == BIG_ENDIAN
+  w = ZSWAP64(w);
+#endif
+  MEMCPY(&(s->pending_buf[s->pending]), &w, sizeof(uint64_t));
+  s->pending += 8;
+}
+
 #define MIN_LOOKAHEAD (MAX_MATCH+MIN_MATCH+1)
 /* Minimum amount of lookahead, except at the end of the input file.
  * See deflate.c for comments about the MIN_MATCH+1.
@@ -325,16 +394,42 @@ static inline void put_short(deflate_state *s, uint16_t w) {
 /* Number of bytes after end of data in window to initialize in order to avoid
    memory checker errors from longest match routines */
 
+#ifdef X86_PCLMULQDQ_CRC
+#  define WINDOW_PADDING 16
+#else
+#  define WINDOW_PADDING 2
+#endif
+/* Number of spare bytes allocated after the end of the window. compare258 may
+   read up to 264 bytes from a string that starts MIN_LOOKAHEAD bytes before
+   the end of the window, see match_tpl.h. */
+
+#ifdef DEFLATE_POS32
+#  define ABS_POS(s, pos) ((Pos)((pos) + (s)->pos_base))
+#  define REL_POS(s, pos) ((pos) > (s)->pos_base ? (IPos)((pos) - (s)->pos_base) : NIL)
+#else
+#  define ABS_POS(s, pos) ((Pos)(pos))
+#  define REL_POS(s, pos) ((IPos)(pos))
+#endif
+/* Conversions of a window index to the position kept in head and prev, and
+ * back. The positions from before the window index 1 come back as NIL, as
+ * slide_hash() makes them with 16-bit positions. The window index modulo
+ * w_size, which indexes prev, is the same for both since pos_base is a
+ * multiple of w_size.
+ */
+
 
 void ZLIB_INTERNAL zng_fill_window_c(deflate_state *s);
 
         /* in trees.c */
 void ZLIB_INTERNAL _zng_tr_init(deflate_state *s);
 int ZLIB_INTERNAL _zng_tr_tally(deflate_state *s, unsigned dist, unsigned lc);
+int ZLIB_INTERNAL _zng_tr_block_end(deflate_state *s);
 void ZLIB_INTERNAL _zng_tr_flush_block(deflate_state *s, char *buf, unsigned long stored_len, int last);
 void ZLIB_INTERNAL _zng_tr_flush_bits(deflate_state *s);
 void ZLIB_INTERNAL _zng_tr_align(deflate_state *s);
 void ZLIB_INTERNAL _zng_tr_stored_block(deflate_state *s, char *buf, unsigned long stored_len, int last);
+void ZLIB_INTERNAL _zng_tr_costs(const ct_data *ltree, const ct_data *dtree, unsigned char *lit_cost,
+                                 unsigned char *len_cost, unsigned char *dist_cost);
 void ZLIB_INTERNAL zng_bi_windup(deflate_state *s);
 
 #define d_code(dist) ((dist) < 256 ? _zng_dist_code[dist] : _zng_dist_code[256+((dist)>>7)])
@@ -343,16 +438,16 @@ void ZLIB_INTERNAL zng_bi_windup(deflate_state *s);
  * used.
  */
 
-#ifndef ZLIB_DEBUG
-/* Inline versions of _zng_tr_tally for speed: */
-
-# if defined(GEN_TREES_H)
+#if defined(GEN_TREES_H)
     extern unsigned char ZLIB_INTERNAL _zng_length_code[];
     extern unsigned char ZLIB_INTERNAL _zng_dist_code[];
-# else
+#else
     extern const unsigned char ZLIB_INTERNAL _zng_length_code[];
     extern const unsigned char ZLIB_INTERNAL _zng_dist_code[];
-# endif
+#endif
+
+#ifndef ZLIB_DEBUG
+/* Inline versions of _zng_tr_tally for speed: */
 
 # define _zng_tr_tally_lit(s, c, flush) \
   { unsigned char cc = (c); \
@@ -360,7 +455,7 @@ void ZLIB_INTERNAL zng_bi_windup(deflate_state *s);
     s->sym_buf[s->sym_next++] = 0; \
     s->sym_buf[s->sym_next++] = cc; \
     s->dyn_ltree[cc].Freq++; \
-    flush = (s->sym_next == s->sym_end); \
+    flush = (s->sym_next == s->sym_check && _zng_tr_block_end(s)); \
   }
 # define _zng_tr_tally_dist(s, distance, length, flush) \
   { unsigned char len = (unsigned char)(length); \
@@ -371,7 +466,7 @@ void ZLIB_INTERNAL zng_bi_windup(deflate_state *s);
     dist--; \
     s->dyn_ltree[_zng_length_code[len]+LITERALS+1].Freq++; \
     s->dyn_dtree[d_code(dist)].Freq++; \
-    flush = (s->sym_next == s->sym_end); \
+    flush = (s->sym_next == s->sym_check && _zng_tr_block_end(s)); \
   }
 #else
 #   define _zng_tr_tally_lit(s, c, flush) flush = _zng_tr_tally(s, 0, c)
@@ -422,21 +517,24 @@ void ZLIB_INTERNAL zng_bi_windup(deflate_state *s);
      }
 #endif
 
+/* send_bits appends length bits of value to bi_buf. When bi_buf fills up, it
+ * writes out all 64 bits at once, and keeps the rest of value. length must be
+ * less than 64; deflate_quick sends a length and a distance code in one call.
+ */
 #ifdef ZLIB_DEBUG
-void send_bits(deflate_state *s, int value, int length);
+void send_bits(deflate_state *s, uint64_t value, int length);
 #else
 #define send_bits(s, value, length) \
-{ int len = length;\
-  if (s->bi_valid > (int)Buf_size - len) {\
-    int val = (int)value;\
-    s->bi_buf |= (uint16_t)val << s->bi_valid;\
-    put_short(s, s->bi_buf);\
-    s->bi_buf = (uint16_t)val >> (Buf_size - s->bi_valid);\
-    s->bi_valid += len - Buf_size;\
-  } else {\
-    s->bi_buf |= (uint16_t)(value) << s->bi_valid;\
-    s->bi_valid += len;\
+{ uint64_t val = (uint64_t)(value);\
+  int len = length;\
+  int total = s->bi_valid + len;\
+  s->bi_buf |= val << s->bi_valid;\
+  if (total >= (int)Buf_size) {\
+    put_uint64(s, s->bi_buf);\
+    s->bi_buf = val >> (Buf_size - s->bi_valid);\
+    total -= Buf_size;\
   }\
+  s->bi_valid = total;\
 }
 #endif
 
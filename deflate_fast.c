@@ -28,7 +28,7 @@ ZLIB_INTERNAL block_state deflate_fast(deflate_state *s, int flush) {
          * string following the next match.
          */
         if (s->lookahead < MIN_LOOKAHEAD) {
-            zng_functable.fill_window(s);
+            FUNCTABLE_GET(fill_window)(s);
             if (s->lookahead < MIN_LOOKAHEAD && flush == Z_NO_FLUSH) {
                 return need_more;
             }
@@ -41,7 +41,7 @@ ZLIB_INTERNAL block_state deflate_fast(deflate_state *s, int flush) {
          */
         hash_head = NIL;
         if (s->lookahead >= MIN_MATCH) {
-            hash_head = zng_functable.insert_string(s, s->strstart, 1);
+            hash_head = FUNCTABLE_GET(insert_string)(s, s->strstart, 1);
         }
 
         /* Find the longest match, discarding those <= prev_length.
@@ -52,7 +52,7 @@ ZLIB_INTERNAL block_state deflate_fast(deflate_state *s, int flush) {
              * of window index 0 (in particular we have to avoid a match
              * of the string with itself at the start of the input file).
              */
-            s->match_length = longest_match(s, hash_head);
+            s->match_length = FUNCTABLE_GET(longest_match)(s, hash_head);
             /* longest_match() sets match_start */
         }
         if (s->match_length >= MIN_MATCH) {
@@ -70,7 +70,7 @@ ZLIB_INTERNAL block_state deflate_fast(deflate_state *s, int flush) {
                 s->strstart++;
 #ifdef NOT_TWEAK_COMPILER
                 do {
-                    zng_functable.insert_string(s, s->strstart, 1);
+                    FUNCTABLE_GET(insert_string)(s, s->strstart, 1);
                     s->strstart++;
                     /* strstart never exceeds WSIZE-MAX_MATCH, so there are
                      * always MIN_MATCH bytes ahead.
@@ -78,7 +78,7 @@ ZLIB_INTERNAL block_state deflate_fast(deflate_state *s, int flush) {
                 } while (--s->match_length != 0);
 #else
                 {
-                    zng_functable.insert_string(s, s->strstart, s->match_length);
+                    FUNCTABLE_GET(insert_string)(s, s->strstart, s->match_length);
                     s->strstart += s->match_length;
                     s->match_length = 0;
                 }
@@ -88,9 +88,9 @@ ZLIB_INTERNAL block_state deflate_fast(deflate_state *s, int flush) {
                 s->match_length = 0;
                 s->ins_h = s->window[s->strstart];
 #ifndef NOT_TWEAK_COMPILER
-                zng_functable.insert_string(s, s->strstart + 2 - MIN_MATCH, MIN_MATCH - 2);
+                FUNCTABLE_GET(insert_string)(s, s->strstart + 2 - MIN_MATCH, MIN_MATCH - 2);
 #else
-                zng_functable.insert_string(s, s->strstart + 2 - MIN_MATCH, 1);
+                FUNCTABLE_GET(insert_string)(s, s->strstart + 2 - MIN_MATCH, 1);
 #if MIN_MATCH != 3
 #warning        Call insert_string() MIN_MATCH-3 more times
 #endif
@@ -65,7 +65,7 @@ static void insert_match(deflate_state *s, struct match match) {
 
             if (match.match_length) {
                 if (match.strstart >= match.orgstart) {
-                    zng_functable.insert_string(s, match.strstart, 1);
+                    FUNCTABLE_GET(insert_string)(s, match.strstart, 1);
                 }
             }
         }
@@ -75,9 +75,9 @@ static void insert_match(deflate_state *s, struct match match) {
         if (match.match_length > 0) {
             if (match.strstart >= match.orgstart) {
                 if (match.strstart + match.match_length - 1 >= match.orgstart) {
-                    zng_functable.insert_string(s, match.strstart, match.match_length);
+                    FUNCTABLE_GET(insert_string)(s, match.strstart, match.match_length);
                 } else {
-                    zng_functable.insert_string(s, match.strstart, match.orgstart - match.strstart + 1);
+                    FUNCTABLE_GET(insert_string)(s, match.strstart, match.orgstart - match.strstart + 1);
                 }
                 match.strstart += match.match_length;
                 match.match_length = 0;
@@ -96,7 +96,7 @@ static void insert_match(deflate_state *s, struct match match) {
 #ifdef NOT_TWEAK_COMPILER
         do {
             if (likely(match.strstart >= match.orgstart)) {
-                zng_functable.insert_string(s, match.strstart, 1);
+                FUNCTABLE_GET(insert_string)(s, match.strstart, 1);
             }
             match.strstart++;
             /* strstart never exceeds WSIZE-MAX_MATCH, so there are
@@ -106,9 +106,9 @@ static void insert_match(deflate_state *s, struct match match) {
 #else
         if (likely(match.strstart >= match.orgstart)) {
             if (likely(match.strstart + match.match_length - 1 >= match.orgstart)) {
-                zng_functable.insert_string(s, match.strstart, match.match_length);
+                FUNCTABLE_GET(insert_string)(s, match.strstart, match.match_length);
             } else {
-                zng_functable.insert_string(s, match.strstart, match.orgstart - match.strstart + 1);
+                FUNCTABLE_GET(insert_string)(s, match.strstart, match.orgstart - match.strstart + 1);
             }
         }
         match.strstart += match.match_length;
@@ -120,9 +120,9 @@ static void insert_match(deflate_state *s, struct match match) {
         s->ins_h = s->window[match.strstart];
         if (match.strstart >= (MIN_MATCH - 2))
 #ifndef NOT_TWEAK_COMPILER
-            zng_functable.insert_string(s, match.strstart + 2 - MIN_MATCH, MIN_MATCH - 2);
+            FUNCTABLE_GET(insert_string)(s, match.strstart + 2 - MIN_MATCH, MIN_MATCH - 2);
 #else
-            zng_functable.insert_string(s, match.strstart + 2 - MIN_MATCH, 1);
+            FUNCTABLE_GET(insert_string)(s, match.strstart + 2 - MIN_MATCH, 1);
 #if MIN_MATCH != 3
 #warning    Call insert_string() MIN_MATCH-3 more times
 #endif
@@ -212,7 +212,7 @@ ZLIB_INTERNAL block_state deflate_medium(deflate_state *s, int flush) {
          * string following the next current_match.
          */
         if (s->lookahead < MIN_LOOKAHEAD) {
-            zng_functable.fill_window(s);
+            FUNCTABLE_GET(fill_window)(s);
             if (s->lookahead < MIN_LOOKAHEAD && flush == Z_NO_FLUSH) {
                 return need_more;
             }
@@ -234,7 +234,7 @@ ZLIB_INTERNAL block_state deflate_medium(deflate_state *s, int flush) {
         } else {
             hash_head = 0;
             if (s->lookahead >= MIN_MATCH) {
-                hash_head = zng_functable.insert_string(s, s->strstart, 1);
+                hash_head = FUNCTABLE_GET(insert_string)(s, s->strstart, 1);
             }
 
             /* set up the initial match to be a 1 byte literal */
@@ -252,7 +252,7 @@ ZLIB_INTERNAL block_state deflate_medium(deflate_state *s, int flush) {
                  * of window index 0 (in particular we have to avoid a match
                  * of the string with itself at the start of the input file).
                  */
-                current_match.match_length = longest_match(s, hash_head);
+                current_match.match_length = FUNCTABLE_GET(longest_match)(s, hash_head);
                 current_match.match_start = s->match_start;
                 if (current_match.match_length < MIN_MATCH)
                     current_match.match_length = 1;
@@ -268,7 +268,7 @@ ZLIB_INTERNAL block_state deflate_medium(deflate_state *s, int flush) {
         /* now, look ahead one */
         if (s->lookahead > MIN_LOOKAHEAD && (current_match.strstart + current_match.match_length) < (s->window_size - MIN_LOOKAHEAD)) {
             s->strstart = current_match.strstart + current_match.match_length;
-            hash_head = zng_functable.insert_string(s, s->strstart, 1);
+            hash_head = FUNCTABLE_GET(insert_string)(s, s->strstart, 1);
 
             /* set up the initial match to be a 1 byte literal */
             next_match.match_start = 0;
@@ -284,7 +284,7 @@ ZLIB_INTERNAL block_state deflate_medium(deflate_state *s, int flush) {
                  * of window index 0 (in particular we have to avoid a match
                  * of the string with itself at the start of the input file).
                  */
-                next_match.match_length = longest_match(s, hash_head);
+                next_match.match_length = FUNCTABLE_GET(longest_match)(s, hash_head);
                 next_match.match_start = s->match_start;
                 if (next_match.match_start >= next_match.strstart) {
                     /* this can happen due to some restarts */
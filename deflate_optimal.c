@@ -0,0 +1,310 @@
+/* deflate_optimal.c -- compress data using an optimal parse, for the levels
+ *                      above 9
+ *
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * The input is parsed OPT_CHUNK positions at a time. For each position of a
+ * chunk, the matches found on the hash chain are collected, each one longer
+ * than the previous one. The chunk is then parsed as a shortest path from its
+ * first to its last position, where a literal costs the bits of its code and a
+ * match the bits of its length and distance codes, including the extra bits.
+ * The code lengths are estimated from the frequencies of the current block
+ * and of the previous parse of the chunk, so the chunk is parsed a few times
+ * for the costs and the parse to converge. The last parse is tallied as usual,
+ * so the output is a standard deflate stream.
+ */
+
+#include "zbuild.h"
+#include "deflate.h"
+#include "deflate_p.h"
+#include "functable.h"
+
+/* Number of parses of each chunk, for the levels 10, 11 and 12 */
+static const int opt_passes[3] = {2, 3, 5};
+
+/* Below this number of symbols, the frequencies of the current block are not
+ * used for the costs of the first parse of a chunk.
+ */
+#define OPT_MIN_SYMBOLS 1024
+
+#define OPT_INFINITY 0xffffffffU
+
+/* ===========================================================================
+ * Collect the matches of the string at pos, starting from cur_match on its
+ * hash chain. Each match is longer than the previous one, and its distance is
+ * the shortest seen for its length. Return the number of matches.
+ */
+static unsigned find_matches(deflate_state *s, IPos cur_match, unsigned pos, unsigned max_len, uint16_t *match) {
+    const unsigned char *scan = s->window + pos;
+    unsigned limit = pos > MAX_DIST(s) ? pos - MAX_DIST(s) : NIL;
+    unsigned chain = s->max_chain_length;
+    unsigned nice = (unsigned)s->nice_match < max_len ? (unsigned)s->nice_match : max_len;
+    unsigned best = MIN_MATCH-1;
+    unsigned n = 0;
+
+    while (cur_match > limit && cur_match < pos && chain-- != 0) {
+        const unsigned char *cur = s->window + cur_match;
+
+        if (cur[best] == scan[best] && cur[0] == scan[0] && cur[1] == scan[1]) {
+            unsigned len = FUNCTABLE_GET(compare258)(scan, cur);
+            if (len > best) {
+                if (len > max_len)
+                    len = max_len;
+                match[2*n] = (uint16_t)len;
+                match[2*n+1] = (uint16_t)(pos - cur_match);
+                n++;
+                best = len;
+                if (len >= nice)
+                    break;
+            }
+        }
+        cur_match = REL_POS(s, s->prev[cur_match & s->w_mask]);
+    }
+    return n;
+}
+
+/* ===========================================================================
+ * Find the cheapest parse of the n positions at strstart with the given
+ * costs. On return, opt->cost[i] holds the length of the step that starts at
+ * position i in the parse in its upper 16 bits, and its distance, or 0 for a
+ * literal, in its lower 16 bits.
+ */
+static void parse_chunk(deflate_state *s, opt_state *opt, unsigned n, const unsigned char *lit_cost,
+                        const unsigned char *len_cost, const unsigned char *dist_cost) {
+    const unsigned char *window = s->window + s->strstart;
+    unsigned min_len = s->strategy == Z_FILTERED ? 6 : MIN_MATCH;
+    unsigned i, m;
+
+    opt->cost[0] = 0;
+    for (i = 1; i <= n; i++)
+        opt->cost[i] = OPT_INFINITY;
+
+    for (i = 0; i < n; i++) {
+        uint32_t cost = opt->cost[i] + lit_cost[window[i]];
+        unsigned max_len = n - i;
+        unsigned len = min_len;
+
+        if (cost < opt->cost[i+1]) {
+            opt->cost[i+1] = cost;
+            opt->step[i+1] = 1;
+            opt->dist[i+1] = 0;
+        }
+        /* A match also gives all the shorter lengths at its distance. As in
+         * deflate_slow, Z_FILTERED drops the matches shorter than 6.
+         */
+        for (m = opt->first[i]; m < opt->first[i+1]; m++) {
+            unsigned mlen = opt->match[2*m];
+            unsigned dist = opt->match[2*m+1];
+            uint32_t dist_bits = opt->cost[i] + dist_cost[d_code(dist - 1)];
+
+            if (mlen > max_len)
+                mlen = max_len;
+            for (; len <= mlen; len++) {
+                cost = dist_bits + len_cost[len - MIN_MATCH];
+                if (cost < opt->cost[i+len]) {
+                    opt->cost[i+len] = cost;
+                    opt->step[i+len] = (uint16_t)len;
+                    opt->dist[i+len] = (uint16_t)dist;
+                }
+            }
+            if (mlen == max_len)
+                break;
+        }
+    }
+
+    /* Walk the parse back from the end. The costs of the positions before i
+     * are no longer needed, so they are replaced with the steps of the parse.
+     */
+    i = n;
+    while (i > 0) {
+        unsigned len = opt->step[i];
+        unsigned dist = opt->dist[i];
+        i -= len;
+        opt->cost[i] = (uint32_t)len << 16 | dist;
+    }
+}
+
+/* ===========================================================================
+ * Add the symbols of the parse of n positions to the frequencies in ltree and
+ * dtree.
+ */
+static void count_chunk(const opt_state *opt, unsigned n, ct_data *ltree, ct_data *dtree, const unsigned char *window) {
+    unsigned i = 0;
+
+    while (i < n) {
+        unsigned len = opt->cost[i] >> 16;
+        unsigned dist = opt->cost[i] & 0xffff;
+
+        if (dist == 0) {
+            ltree[window[i]].Freq++;
+        } else {
+            ltree[_zng_length_code[len - MIN_MATCH]+LITERALS+1].Freq++;
+            dtree[d_code(dist - 1)].Freq++;
+        }
+        i += len;
+    }
+}
+
+/* ===========================================================================
+ * Compress as much as possible from the input stream with an optimal parse,
+ * as described at the top of this file. Like deflate_slow, this requires
+ * max_chain >= 4. nice_match also bounds the search: inside a match of at
+ * least nice_match bytes, the positions only get the rest of that match.
+ */
+ZLIB_INTERNAL block_state deflate_optimal(deflate_state *s, int flush) {
+    opt_state *opt = s->opt;
+    int passes = opt_passes[s->level - 10];
+    unsigned char lit_cost[LITERALS];
+    unsigned char len_cost[MAX_MATCH-MIN_MATCH+1];
+    unsigned char dist_cost[D_CODES];
+    ct_data ltree[L_CODES];
+    ct_data dtree[D_CODES];
+    int bflush = 0;          /* set if current block must be flushed */
+
+    if (s->strategy == Z_FIXED)
+        passes = 1;
+
+    for (;;) {
+        const unsigned char *window;
+        unsigned n, i, room, nmatch, end, nsym;
+        unsigned run_len = 0, run_dist = 0;
+        int last, pass;
+
+        /* Wait for a chunk and the lookahead of its last match, unless the
+         * window is full or the input is flushed.
+         */
+        if (s->lookahead < MIN_LOOKAHEAD ||
+            (s->lookahead < OPT_CHUNK + MIN_LOOKAHEAD && s->strstart + s->lookahead < s->window_size)) {
+            FUNCTABLE_GET(fill_window)(s);
+            if (flush == Z_NO_FLUSH && (s->lookahead < MIN_LOOKAHEAD ||
+                (s->strm->avail_in == 0 && s->strstart + s->lookahead < s->window_size))) {
+                return need_more;
+            }
+            if (s->lookahead == 0)
+                break; /* flush the current block */
+        }
+
+        /* Size the chunk. It includes the positions whose matches were
+         * collected for the previous chunk but not committed.
+         */
+        room = (s->sym_end - s->sym_next) / 3;
+        last = flush != Z_NO_FLUSH && s->strm->avail_in == 0;
+        n = s->lookahead;
+        if (!last)
+            n -= MIN_LOOKAHEAD - 1;
+        n = MIN(n, OPT_CHUNK);
+        n = MIN(n, room + MAX_MATCH);
+        /* compare258 reads MAX_MATCH bytes past any position of the chunk. */
+        n = MIN(n, (unsigned)(s->window_size - MAX_MATCH - s->strstart));
+        if (n < opt->more)
+            n = opt->more;
+        last = last && n == s->lookahead;
+
+        /* Insert the new strings of the chunk in the hash table, and collect
+         * their matches.
+         */
+        nmatch = opt->more ? opt->first[opt->more] : 0;
+        for (i = opt->more; i < n; i++) {
+            unsigned pos = s->strstart + i;
+            unsigned avail = s->lookahead - i;
+            IPos hash_head = NIL;
+
+            if (nmatch + MAX_MATCH > OPT_MATCHES) {
+                n = i;
+                last = 0;
+                break;
+            }
+            opt->first[i] = nmatch;
+            if (avail >= MIN_MATCH)
+                hash_head = FUNCTABLE_GET(insert_string)(s, pos, 1);
+
+            if (run_len > MIN_MATCH) {
+                run_len--;
+                opt->match[2*nmatch] = (uint16_t)run_len;
+                opt->match[2*nmatch+1] = (uint16_t)run_dist;
+                nmatch++;
+            } else if (hash_head != NIL) {
+                unsigned found = find_matches(s, hash_head, pos, MIN(avail, MAX_MATCH), opt->match + 2*nmatch);
+                nmatch += found;
+                run_len = 0;
+                if (found != 0 && opt->match[2*nmatch-2] >= (unsigned)s->nice_match) {
+                    run_len = opt->match[2*nmatch-2];
+                    run_dist = opt->match[2*nmatch-1];
+                }
+            } else {
+                run_len = 0;
+            }
+        }
+        opt->first[n] = nmatch;
+
+        /* Parse the chunk, with the costs of the previous parse after the
+         * first one.
+         */
+        window = s->window + s->strstart;
+        for (pass = 0; pass < passes; pass++) {
+            if (s->strategy == Z_FIXED) {
+                _zng_tr_costs(NULL, NULL, lit_cost, len_cost, dist_cost);
+            } else if (pass == 0) {
+                if ((s->sym_next - s->sym_start) / 3 >= OPT_MIN_SYMBOLS)
+                    _zng_tr_costs(s->dyn_ltree, s->dyn_dtree, lit_cost, len_cost, dist_cost);
+                else
+                    _zng_tr_costs(NULL, NULL, lit_cost, len_cost, dist_cost);
+            } else {
+                for (i = 0; i < L_CODES; i++)
+                    ltree[i].Freq = s->dyn_ltree[i].Freq;
+                for (i = 0; i < D_CODES; i++)
+                    dtree[i].Freq = s->dyn_dtree[i].Freq;
+                count_chunk(opt, n, ltree, dtree, window);
+                _zng_tr_costs(ltree, dtree, lit_cost, len_cost, dist_cost);
+            }
+            parse_chunk(s, opt, n, lit_cost, len_cost, dist_cost);
+        }
+
+        /* Tally the parse. The matches are cut at the end of the chunk, so
+         * unless this is the end of the input, the steps from MAX_MATCH
+         * positions before the end are parsed again with the next chunk. At
+         * least one step is taken, and no more than fit in the symbol buffer.
+         */
+        end = last ? n : (n > MAX_MATCH ? n - MAX_MATCH : 1);
+        i = nsym = 0;
+        do {
+            unsigned match_len = opt->cost[i] >> 16;
+            unsigned match_dist = opt->cost[i] & 0xffff;
+
+            if (match_dist == 0) {
+                Tracevv((stderr, "%c", window[i]));
+                _zng_tr_tally_lit(s, window[i], bflush);
+            } else {
+                check_match(s, s->strstart + i, s->strstart + i - match_dist, match_len);
+                _zng_tr_tally_dist(s, match_dist, match_len - MIN_MATCH, bflush);
+            }
+            i += match_len;
+            nsym++;
+        } while (i < end && nsym < room);
+        s->strstart += i;
+        s->lookahead -= i;
+
+        /* Keep the matches of the positions that were not committed. */
+        opt->more = n - i;
+        if (opt->more != 0) {
+            unsigned base = opt->first[i];
+            unsigned k;
+
+            memmove(opt->match, opt->match + 2*base, (opt->first[n] - base) * 2 * sizeof(uint16_t));
+            for (k = 0; k <= opt->more; k++)
+                opt->first[k] = opt->first[i+k] - base;
+        }
+
+        if (bflush)
+            FLUSH_BLOCK(s, 0);
+    }
+    Assert(flush != Z_NO_FLUSH, "no flush?");
+    s->insert = s->strstart < MIN_MATCH-1 ? s->strstart : MIN_MATCH-1;
+    if (flush == Z_FINISH) {
+        FLUSH_BLOCK(s, 1);
+        return finish_done;
+    }
+    if (s->sym_next)
+        FLUSH_BLOCK(s, 0);
+    return block_done;
+}
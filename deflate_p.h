@@ -39,11 +39,11 @@ static inline Pos insert_string_c(deflate_state *const s, const Pos str, unsigne
         UPDATE_HASH(s, s->ins_h, str+idx);
 
         Pos head = s->head[s->ins_h];
-        if (head != str+idx) {
+        if (head != ABS_POS(s, str+idx)) {
           s->prev[(str+idx) & s->w_mask] = head;
-          s->head[s->ins_h] = str+idx;
+          s->head[s->ins_h] = ABS_POS(s, str+idx);
           if (idx == count - 1)
-            ret = head;
+            ret = (Pos)REL_POS(s, head);
         } else if (idx == count - 1) {
           ret = str + idx;
         }
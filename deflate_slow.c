@@ -36,7 +36,7 @@ ZLIB_INTERNAL block_state deflate_slow(deflate_state *s, int flush) {
          * string following the next match.
          */
         if (s->lookahead < MIN_LOOKAHEAD) {
-            zng_functable.fill_window(s);
+            FUNCTABLE_GET(fill_window)(s);
             if (s->lookahead < MIN_LOOKAHEAD && flush == Z_NO_FLUSH) {
                 return need_more;
             }
@@ -49,7 +49,7 @@ ZLIB_INTERNAL block_state deflate_slow(deflate_state *s, int flush) {
          */
         hash_head = NIL;
         if (s->lookahead >= MIN_MATCH) {
-            hash_head = zng_functable.insert_string(s, s->strstart, 1);
+            hash_head = FUNCTABLE_GET(insert_string)(s, s->strstart, 1);
         }
 
         /* Find the longest match, discarding those <= prev_length.
@@ -62,7 +62,7 @@ ZLIB_INTERNAL block_state deflate_slow(deflate_state *s, int flush) {
              * of window index 0 (in particular we have to avoid a match
              * of the string with itself at the start of the input file).
              */
-            s->match_length = longest_match(s, hash_head);
+            s->match_length = FUNCTABLE_GET(longest_match)(s, hash_head);
             /* longest_match() sets match_start */
 
             if (s->match_length <= 5 && (s->strategy == Z_FILTERED
@@ -99,7 +99,7 @@ ZLIB_INTERNAL block_state deflate_slow(deflate_state *s, int flush) {
             s->prev_length -= 2;
             do {
                 if (++s->strstart <= max_insert) {
-                    zng_functable.insert_string(s, s->strstart, 1);
+                    FUNCTABLE_GET(insert_string)(s, s->strstart, 1);
                 }
             } while (--s->prev_length != 0);
             s->match_available = 0;
@@ -113,7 +113,7 @@ ZLIB_INTERNAL block_state deflate_slow(deflate_state *s, int flush) {
                     if (unlikely(insert_cnt > max_insert - s->strstart))
                         insert_cnt = max_insert - s->strstart;
 
-                    zng_functable.insert_string(s, s->strstart + 1, insert_cnt);
+                    FUNCTABLE_GET(insert_string)(s, s->strstart + 1, insert_cnt);
                 }
                 s->prev_length = 0;
                 s->match_available = 0;
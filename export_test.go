@@ -0,0 +1,12 @@
+// +build cgo,amd64
+
+package zlibng
+
+// InflateBack exports inflateBack to the tests.
+var InflateBack = inflateBack
+
+// InflateCopyAt exports inflateCopyAt to the tests.
+var InflateCopyAt = inflateCopyAt
+
+// DeflateSyncFlush exports deflateSyncFlush to the tests.
+var DeflateSyncFlush = deflateSyncFlush
@@ -9,6 +9,8 @@
 #include "deflate_p.h"
 
 #include "gzendian.h"
+#include "match.h"
+#include "inffast.h"
 
 #if defined(X86_CPUID)
 # include "arch-x86-x86.h"
@@ -37,6 +39,20 @@ extern uint32_t adler32_c(uint32_t adler, const unsigned char *buf, size_t len);
 #if ((defined(__ARM_NEON__) || defined(__ARM_NEON)) && defined(ARM_NEON_ADLER32))
 extern uint32_t adler32_neon(uint32_t adler, const unsigned char *buf, size_t len);
 #endif
+#ifdef X86_SSSE3_ADLER32
+extern uint32_t adler32_ssse3(uint32_t adler, const unsigned char *buf, size_t len);
+#endif
+#ifdef X86_AVX2_ADLER32
+extern uint32_t adler32_avx2(uint32_t adler, const unsigned char *buf, size_t len);
+#endif
+
+/* inflate_fast */
+#ifdef X86_SSE2_CHUNKCOPY
+extern void inflate_fast_sse2(PREFIX3(stream) *strm, unsigned long start);
+#endif
+#ifdef X86_AVX2_CHUNKCOPY
+extern void inflate_fast_avx2(PREFIX3(stream) *strm, unsigned long start);
+#endif
 
 ZLIB_INTERNAL uint32_t crc32_generic(uint32_t, const unsigned char *, uint64_t);
 
@@ -44,6 +60,10 @@ ZLIB_INTERNAL uint32_t crc32_generic(uint32_t, const unsigned char *, uint64_t);
 extern uint32_t crc32_acle(uint32_t, const unsigned char *, uint64_t);
 #endif
 
+#ifdef X86_PCLMULQDQ_CRC
+extern uint32_t crc32_pclmulqdq(uint32_t, const unsigned char *, uint64_t);
+#endif
+
 #if BYTE_ORDER == LITTLE_ENDIAN
 extern uint32_t crc32_little(uint32_t, const unsigned char *, uint64_t);
 #elif BYTE_ORDER == BIG_ENDIAN
@@ -55,53 +75,73 @@ ZLIB_INTERNAL Pos insert_string_stub(deflate_state *const s, const Pos str, unsi
 ZLIB_INTERNAL void fill_window_stub(deflate_state *s);
 ZLIB_INTERNAL uint32_t adler32_stub(uint32_t adler, const unsigned char *buf, size_t len);
 ZLIB_INTERNAL uint32_t crc32_stub(uint32_t crc, const unsigned char *buf, uint64_t len);
+ZLIB_INTERNAL unsigned longest_match_stub(deflate_state *const s, IPos cur_match);
+ZLIB_INTERNAL unsigned compare258_stub(const unsigned char *src0, const unsigned char *src1);
+ZLIB_INTERNAL void inflate_fast_stub(PREFIX3(stream) *strm, unsigned long start);
 
-/* functable init */
-ZLIB_INTERNAL __thread struct functable_s zng_functable = {fill_window_stub,insert_string_stub,adler32_stub,crc32_stub};
+/* functable init. The table is shared by all threads. Each stub resolves its
+ * entry on first use; threads that race on it store the same pointer. All
+ * accesses go through FUNCTABLE_GET and FUNCTABLE_SET. */
+ZLIB_INTERNAL struct functable_s zng_functable = {fill_window_stub,insert_string_stub,adler32_stub,crc32_stub,
+                                                          longest_match_stub,compare258_stub,inflate_fast_stub};
 
 
 /* stub functions */
 ZLIB_INTERNAL Pos insert_string_stub(deflate_state *const s, const Pos str, unsigned int count) {
     // Initialize default
-    zng_functable.insert_string=&insert_string_c;
+    FUNCTABLE_SET(insert_string, &insert_string_c);
 
     #ifdef X86_SSE4_2_CRC_HASH
     if (x86_cpu_has_sse42)
-        zng_functable.insert_string=&insert_string_sse;
+        FUNCTABLE_SET(insert_string, &insert_string_sse);
     #elif defined(__ARM_FEATURE_CRC32) && defined(ARM_ACLE_CRC_HASH)
     if (arm_has_crc32())
-        zng_functable.insert_string=&insert_string_acle;
+        FUNCTABLE_SET(insert_string, &insert_string_acle);
     #endif
 
-    return zng_functable.insert_string(s, str, count);
+    return FUNCTABLE_GET(insert_string)(s, str, count);
 }
 
 ZLIB_INTERNAL void fill_window_stub(deflate_state *s) {
     // Initialize default
-    zng_functable.fill_window=&zng_fill_window_c;
+    FUNCTABLE_SET(fill_window, &zng_fill_window_c);
 
-    #ifdef X86_SSE2_FILL_WINDOW
+    #if defined(DEFLATE_POS32)
+    /* The variants below only slide the 16-bit hash table faster. */
+    #elif defined(X86_SSE2_FILL_WINDOW)
     # ifndef X86_NOCHECK_SSE2
     if (x86_cpu_has_sse2)
     # endif
-        zng_functable.fill_window=&fill_window_sse;
+        FUNCTABLE_SET(fill_window, &fill_window_sse);
     #elif defined(__arm__) || defined(__aarch64__) || defined(_M_ARM)
-        zng_functable.fill_window=&fill_window_arm;
+        FUNCTABLE_SET(fill_window, &fill_window_arm);
     #endif
 
-    zng_functable.fill_window(s);
+    FUNCTABLE_GET(fill_window)(s);
 }
 
 ZLIB_INTERNAL uint32_t adler32_stub(uint32_t adler, const unsigned char *buf, size_t len) {
     // Initialize default
-    zng_functable.adler32=&adler32_c;
+    FUNCTABLE_SET(adler32, &adler32_c);
 
     #if ((defined(__ARM_NEON__) || defined(__ARM_NEON)) && defined(ARM_NEON_ADLER32))
     if (arm_has_neon())
-        zng_functable.adler32=&adler32_neon;
+        FUNCTABLE_SET(adler32, &adler32_neon);
+    #endif
+    #if defined(X86_SSSE3_ADLER32) || defined(X86_AVX2_ADLER32)
+    // inflate may get here before any deflateInit has run the CPU check.
+    zng_x86_check_features();
+    #endif
+    #ifdef X86_SSSE3_ADLER32
+    if (x86_cpu_has_ssse3)
+        FUNCTABLE_SET(adler32, &adler32_ssse3);
+    #endif
+    #ifdef X86_AVX2_ADLER32
+    if (x86_cpu_has_avx2)
+        FUNCTABLE_SET(adler32, &adler32_avx2);
     #endif
 
-    return zng_functable.adler32(adler, buf, len);
+    return FUNCTABLE_GET(adler32)(adler, buf, len);
 }
 
 ZLIB_INTERNAL uint32_t crc32_stub(uint32_t crc, const unsigned char *buf, uint64_t len) {
@@ -118,19 +158,83 @@ ZLIB_INTERNAL uint32_t crc32_stub(uint32_t crc, const unsigned char *buf, uint64
 
     if (sizeof(void *) == sizeof(ptrdiff_t)) {
 #if BYTE_ORDER == LITTLE_ENDIAN
-      zng_functable.crc32=crc32_little;
+      FUNCTABLE_SET(crc32, crc32_little);
 #  if __ARM_FEATURE_CRC32 && defined(ARM_ACLE_CRC_HASH)
       if (arm_has_crc32())
-        zng_functable.crc32=crc32_acle;
+        FUNCTABLE_SET(crc32, crc32_acle);
+#  endif
+#  ifdef X86_PCLMULQDQ_CRC
+      // inflate may get here before any deflateInit has run the CPU check.
+      zng_x86_check_features();
+      if (x86_cpu_has_pclmulqdq)
+        FUNCTABLE_SET(crc32, crc32_pclmulqdq);
 #  endif
 #elif BYTE_ORDER == BIG_ENDIAN
-        zng_functable.crc32=crc32_big;
+        FUNCTABLE_SET(crc32, crc32_big);
 #else
 #  error No endian defined
 #endif
     } else {
-        zng_functable.crc32=crc32_generic;
+        FUNCTABLE_SET(crc32, crc32_generic);
     }
 
-    return zng_functable.crc32(crc, buf, len);
+    return FUNCTABLE_GET(crc32)(crc, buf, len);
+}
+
+ZLIB_INTERNAL unsigned longest_match_stub(deflate_state *const s, IPos cur_match) {
+    // Initialize default
+    FUNCTABLE_SET(longest_match, &longest_match_c);
+
+    #ifdef X86_AVX2
+    if (x86_cpu_has_avx2)
+        FUNCTABLE_SET(longest_match, &longest_match_avx2);
+    #endif
+    #ifdef X86_AVX512
+    if (x86_cpu_has_avx512)
+        FUNCTABLE_SET(longest_match, &longest_match_avx512);
+    #endif
+
+    return FUNCTABLE_GET(longest_match)(s, cur_match);
+}
+
+ZLIB_INTERNAL unsigned compare258_stub(const unsigned char *src0, const unsigned char *src1) {
+    // Initialize default
+    FUNCTABLE_SET(compare258, &compare258_c);
+
+    #ifdef X86_SSE4_2_CRC_HASH
+    if (x86_cpu_has_sse42)
+        FUNCTABLE_SET(compare258, &compare258_sse);
+    #endif
+    #ifdef X86_AVX2
+    if (x86_cpu_has_avx2)
+        FUNCTABLE_SET(compare258, &compare258_avx2);
+    #endif
+    #ifdef X86_AVX512
+    if (x86_cpu_has_avx512)
+        FUNCTABLE_SET(compare258, &compare258_avx512);
+    #endif
+
+    return FUNCTABLE_GET(compare258)(src0, src1);
+}
+
+ZLIB_INTERNAL void inflate_fast_stub(PREFIX3(stream) *strm, unsigned long start) {
+    // Initialize default
+    FUNCTABLE_SET(inflate_fast, &inflate_fast_c);
+
+    #if defined(X86_SSE2_CHUNKCOPY) || defined(X86_AVX2_CHUNKCOPY)
+    // inflate may get here before any deflateInit has run the CPU check.
+    zng_x86_check_features();
+    #endif
+    #ifdef X86_SSE2_CHUNKCOPY
+    # ifndef X86_NOCHECK_SSE2
+    if (x86_cpu_has_sse2)
+    # endif
+        FUNCTABLE_SET(inflate_fast, &inflate_fast_sse2);
+    #endif
+    #ifdef X86_AVX2_CHUNKCOPY
+    if (x86_cpu_has_avx2)
+        FUNCTABLE_SET(inflate_fast, &inflate_fast_avx2);
+    #endif
+
+    FUNCTABLE_GET(inflate_fast)(strm, start);
 }
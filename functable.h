@@ -13,9 +13,25 @@ struct functable_s {
     Pos      (* insert_string)  (deflate_state *const s, const Pos str, unsigned int count);
     uint32_t (* adler32)        (uint32_t adler, const unsigned char *buf, size_t len);
     uint32_t (* crc32)          (uint32_t crc, const unsigned char *buf, uint64_t len);
+    unsigned (* longest_match)  (deflate_state *const s, IPos cur_match);
+    unsigned (* compare258)     (const unsigned char *src0, const unsigned char *src1);
+    void     (* inflate_fast)   (PREFIX3(stream) *strm, unsigned long start);
 };
 
-ZLIB_INTERNAL extern __thread struct functable_s zng_functable;
+ZLIB_INTERNAL extern struct functable_s zng_functable;
+
+/* The table is shared by all threads, and the stubs in functable.c fill it in
+ * on first use while other threads may be calling through it. The functions
+ * may read the x86_cpu_has_* flags, so loading an entry must also make the
+ * flags its stub saw visible. */
+#if defined(__GNUC__) || defined(__clang__)
+#  define FUNCTABLE_GET(name) __atomic_load_n(&zng_functable.name, __ATOMIC_ACQUIRE)
+#  define FUNCTABLE_SET(name, fn) __atomic_store_n(&zng_functable.name, fn, __ATOMIC_RELEASE)
+#else
+/* MSVC gives volatile accesses acquire and release semantics on x86. */
+#  define FUNCTABLE_GET(name) (((volatile struct functable_s *)&zng_functable)->name)
+#  define FUNCTABLE_SET(name, fn) (((volatile struct functable_s *)&zng_functable)->name = (fn))
+#endif
 
 
 #endif
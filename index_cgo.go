@@ -0,0 +1,430 @@
+// +build cgo,amd64
+
+package zlibng
+
+/*
+#include "./zlib-ng.h"
+#include "./zstream.h"
+*/
+import "C"
+
+import (
+	"bufio"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"sort"
+	"unsafe"
+)
+
+// IndexPoint is a checkpoint in a deflate stream, from which decompression can
+// start without reading the preceding data.
+type IndexPoint struct {
+	// Out is the offset in the uncompressed data.
+	Out int64
+	// In is the offset of the first byte of the compressed data that contains
+	// bits of the next deflate block.
+	In int64
+	// Bits is the number of bits of the byte at In-1 that belong to the next
+	// deflate block, or 0.
+	Bits int
+	// Window is the uncompressed data that precedes Out, at most 32KiB.
+	Window []byte
+}
+
+// Index is a list of checkpoints in a single-member gzip, zlib or flate file,
+// as produced by BuildIndex. It allows decompressing from the middle of the
+// file, cf. zran.c in the zlib distribution.
+type Index struct {
+	// Size is the size of the uncompressed data.
+	Size int64
+	// Points are sorted in increasing order of Out. Points[0].Out is zero.
+	Points []IndexPoint
+}
+
+// BuildIndex decompresses the whole contents of in, and records a checkpoint
+// at the first deflate block boundary after every span uncompressed bytes.
+// Each checkpoint costs up to 32KiB of memory. Only the first member of a
+// multi-member gzip file is indexed. There can be at most one options arg;
+// only Opts.WindowBits and Opts.Buffer are used.
+func BuildIndex(in io.Reader, span int64, opts ...Opts) (*Index, error) {
+	opt, err := getOpts(opts...)
+	if err != nil {
+		return nil, err
+	}
+	if opt.WindowBits == 0 {
+		opt.WindowBits = 32 + 15 // autodetect gzip/zlib
+	}
+	zs := &zstream{}
+	var getHeaderStatus C.int
+	if ec := C.zs_inflate_init(&zs[0], C.int(opt.WindowBits), 0, nil, &getHeaderStatus); ec != 0 {
+		return nil, zlibReturnCodeToError(ec)
+	}
+	defer C.zs_inflate_end(&zs[0])
+
+	var (
+		index    = &Index{}
+		inBuf    = make([]byte, opt.Buffer)
+		outBuf   = make([]byte, 32*1024)
+		inOffset int64 // # of bytes read from in.
+		inLen    int   // # of bytes in inBuf yet to be consumed.
+		inEOF    bool
+		lastOut  int64
+		ret      C.int
+	)
+	if opt.WindowBits < 0 {
+		// A raw deflate stream has no header, so inflate does not stop before
+		// the first block.
+		index.Points = append(index.Points, IndexPoint{Window: []byte{}})
+	}
+	for {
+		var inPtr unsafe.Pointer
+		newIn := 0
+		if inLen == 0 && inEOF && ret == C.Z_BUF_ERROR {
+			// Inflate made no progress with all the input consumed.
+			return nil, io.ErrUnexpectedEOF
+		}
+		if inLen == 0 && !inEOF {
+			n, err := in.Read(inBuf)
+			if err == io.EOF {
+				inEOF = true
+			} else if err != nil {
+				return nil, err
+			}
+			if n == 0 {
+				continue
+			}
+			inOffset += int64(n)
+			inLen, newIn = n, n
+			inPtr = unsafe.Pointer(&inBuf[0])
+		}
+		var (
+			outLen      = C.int(len(outBuf))
+			inRemaining C.int
+			dataType    C.int
+		)
+		ret = C.zs_inflate_block(&zs[0], inPtr, C.int(newIn),
+			unsafe.Pointer(&outBuf[0]), &outLen, &inRemaining, &dataType)
+		if ret != C.Z_OK && ret != C.Z_STREAM_END && ret != C.Z_BUF_ERROR {
+			return nil, zlibReturnCodeToError(ret)
+		}
+		inLen = int(inRemaining)
+		index.Size += int64(len(outBuf) - int(outLen))
+		if ret == C.Z_STREAM_END {
+			return index, nil
+		}
+		// Bit 7 of data_type is set at the end of a deflate block header, and
+		// bit 6 is set if it is the last block.
+		if dataType&128 != 0 && dataType&64 == 0 &&
+			(len(index.Points) == 0 || index.Size-lastOut >= span) {
+			p := IndexPoint{
+				Out:    index.Size,
+				In:     inOffset - int64(inLen),
+				Bits:   int(dataType & 7),
+				Window: make([]byte, 32*1024),
+			}
+			var windowLen C.int
+			if ec := C.zs_inflate_get_window(&zs[0], unsafe.Pointer(&p.Window[0]), &windowLen); ec != 0 {
+				return nil, zlibReturnCodeToError(ec)
+			}
+			p.Window = p.Window[:windowLen]
+			index.Points = append(index.Points, p)
+			lastOut = index.Size
+		}
+	}
+}
+
+// indexMagic starts a serialized Index.
+const indexMagic = "zngidx01"
+
+// WriteTo serializes the index, typically to a sidecar file next to the
+// compressed file. It implements io.WriterTo.
+func (x *Index) WriteTo(w io.Writer) (int64, error) {
+	bw := bufio.NewWriter(w)
+	var n int64
+	write := func(data []byte) {
+		nn, _ := bw.Write(data)
+		n += int64(nn)
+	}
+	var buf [8]byte
+	putUint64 := func(v uint64) {
+		binary.LittleEndian.PutUint64(buf[:], v)
+		write(buf[:])
+	}
+	write([]byte(indexMagic))
+	putUint64(uint64(x.Size))
+	putUint64(uint64(len(x.Points)))
+	for _, p := range x.Points {
+		putUint64(uint64(p.Out))
+		putUint64(uint64(p.In))
+		putUint64(uint64(p.Bits))
+		putUint64(uint64(len(p.Window)))
+		write(p.Window)
+	}
+	return n, bw.Flush()
+}
+
+// ReadIndex reads an index serialized by Index.WriteTo.
+func ReadIndex(r io.Reader) (*Index, error) {
+	br := bufio.NewReader(r)
+	magic := make([]byte, len(indexMagic))
+	if _, err := io.ReadFull(br, magic); err != nil {
+		return nil, err
+	}
+	if string(magic) != indexMagic {
+		return nil, errors.New("zlibng.ReadIndex: not an index file")
+	}
+	var buf [8]byte
+	getUint64 := func() (uint64, error) {
+		if _, err := io.ReadFull(br, buf[:]); err != nil {
+			if err == io.EOF {
+				err = io.ErrUnexpectedEOF
+			}
+			return 0, err
+		}
+		return binary.LittleEndian.Uint64(buf[:]), nil
+	}
+	var (
+		x      = &Index{}
+		fields [4]uint64
+	)
+	size, err := getUint64()
+	if err != nil {
+		return nil, err
+	}
+	x.Size = int64(size)
+	nPoints, err := getUint64()
+	if err != nil {
+		return nil, err
+	}
+	for i := uint64(0); i < nPoints; i++ {
+		for j := range fields {
+			if fields[j], err = getUint64(); err != nil {
+				return nil, err
+			}
+		}
+		if fields[2] > 7 || fields[3] > 32*1024 {
+			return nil, fmt.Errorf("zlibng.ReadIndex: corrupt point %d", i)
+		}
+		p := IndexPoint{
+			Out:    int64(fields[0]),
+			In:     int64(fields[1]),
+			Bits:   int(fields[2]),
+			Window: make([]byte, fields[3]),
+		}
+		if _, err := io.ReadFull(br, p.Window); err != nil {
+			return nil, io.ErrUnexpectedEOF
+		}
+		x.Points = append(x.Points, p)
+	}
+	return x, nil
+}
+
+// IndexedReader provides random access to the uncompressed contents of a
+// file using an Index. It implements io.ReaderAt. ReadAt may be called
+// concurrently.
+type IndexedReader struct {
+	in      io.ReaderAt
+	index   *Index
+	buffer  int
+	streams chan *rawInflater // idle decompressors.
+}
+
+// NewIndexedReader creates an IndexedReader. In is the compressed file
+// indexed by index. There can be at most one options arg; only Opts.Buffer and
+// Opts.Concurrency are used. Opts.Concurrency is the number of idle
+// decompressors to cache. Close must be called to release them.
+func NewIndexedReader(in io.ReaderAt, index *Index, opts ...Opts) (*IndexedReader, error) {
+	opt, err := getOpts(opts...)
+	if err != nil {
+		return nil, err
+	}
+	if len(index.Points) == 0 && index.Size > 0 {
+		return nil, errors.New("zlibng.NewIndexedReader: empty index")
+	}
+	return &IndexedReader{
+		in:      in,
+		index:   index,
+		buffer:  opt.Buffer,
+		streams: make(chan *rawInflater, opt.Concurrency),
+	}, nil
+}
+
+// getStream returns an idle decompressor, or creates one. The decompressor
+// owns its input buffer, so ReadAt does not allocate one per call.
+func (r *IndexedReader) getStream() (*rawInflater, error) {
+	select {
+	case zr := <-r.streams:
+		return zr, nil
+	default:
+	}
+	zr := &rawInflater{zs: &zstream{}, inBuf: make([]byte, r.buffer)}
+	var getHeaderStatus C.int
+	if ec := C.zs_inflate_init(&zr.zs[0], C.int(Flate), 0, nil, &getHeaderStatus); ec != 0 {
+		return nil, zlibReturnCodeToError(ec)
+	}
+	return zr, nil
+}
+
+func (r *IndexedReader) putStream(zr *rawInflater) {
+	zr.in.in = nil // Don't pin r.in while idle.
+	select {
+	case r.streams <- zr:
+	default:
+		C.zs_inflate_end(&zr.zs[0])
+	}
+}
+
+// Size returns the size of the uncompressed data.
+func (r *IndexedReader) Size() int64 { return r.index.Size }
+
+// ReadAt implements io.ReaderAt. It decompresses from the last checkpoint at
+// or before off.
+func (r *IndexedReader) ReadAt(out []byte, off int64) (int, error) {
+	if off < 0 {
+		return 0, errors.New("zlibng.ReadAt: negative offset")
+	}
+	if off >= r.index.Size {
+		return 0, io.EOF
+	}
+	points := r.index.Points
+	i := sort.Search(len(points), func(i int) bool { return points[i].Out > off }) - 1
+	p := &points[i]
+
+	zr, err := r.getStream()
+	if err != nil {
+		return 0, err
+	}
+	defer r.putStream(zr)
+
+	value := 0
+	if p.Bits > 0 {
+		var b [1]byte
+		if _, err := r.in.ReadAt(b[:], p.In-1); err != nil {
+			return 0, err
+		}
+		value = int(b[0]) >> uint(8-p.Bits)
+	}
+	var windowPtr unsafe.Pointer
+	if len(p.Window) > 0 {
+		windowPtr = unsafe.Pointer(&p.Window[0])
+	}
+	if ec := C.zs_inflate_resume(&zr.zs[0], C.int(p.Bits), C.int(value), windowPtr, C.int(len(p.Window))); ec != 0 {
+		return 0, zlibReturnCodeToError(ec)
+	}
+	want := len(out)
+	if rem := r.index.Size - off; int64(want) > rem {
+		want = int(rem)
+	}
+	zr.reset(r.in, p.In)
+	if skip := off - p.Out; skip > 0 {
+		if _, err := io.CopyN(ioutil.Discard, zr, skip); err != nil {
+			return 0, unexpectedEOF(err)
+		}
+	}
+	n, err := io.ReadFull(zr, out[:want])
+	if err != nil {
+		return n, unexpectedEOF(err)
+	}
+	if want < len(out) {
+		return n, io.EOF
+	}
+	return n, nil
+}
+
+// rawInflater reads one deflate stream. Unlike Reader, it stops at the end of
+// the deflate stream and ignores the gzip or zlib trailer that may follow.
+type rawInflater struct {
+	zs         *zstream
+	in         offsetReader // reads the compressed file from the checkpoint.
+	inBuf      []byte
+	inConsumed bool // true if zs has consumed inBuf.
+	inEOF      bool // true if in reached io.EOF.
+	err        error
+}
+
+// reset makes z read compressed data from in starting at offset off. The
+// caller must also reset z.zs.
+func (z *rawInflater) reset(in io.ReaderAt, off int64) {
+	z.in = offsetReader{in: in, off: off}
+	z.inConsumed = true
+	z.inEOF = false
+	z.err = nil
+}
+
+// offsetReader is an io.Reader that reads an io.ReaderAt sequentially from
+// off.
+type offsetReader struct {
+	in  io.ReaderAt
+	off int64
+}
+
+func (o *offsetReader) Read(buf []byte) (int, error) {
+	n, err := o.in.ReadAt(buf, o.off)
+	o.off += int64(n)
+	if n > 0 && err == io.EOF {
+		err = nil
+	}
+	return n, err
+}
+
+func (z *rawInflater) Read(out []byte) (int, error) {
+	orgOut := out
+	for z.err == nil && len(out) > 0 {
+		var (
+			outLen     = C.int(len(out))
+			ret        C.int
+			inConsumed C.int
+		)
+		if !z.inConsumed {
+			ret = C.zs_inflate(&z.zs[0], nil, 0, unsafe.Pointer(&out[0]), &outLen, &inConsumed)
+		} else {
+			if z.inEOF {
+				z.err = io.ErrUnexpectedEOF
+				break
+			}
+			n, err := z.in.Read(z.inBuf)
+			if err == io.EOF {
+				z.inEOF = true
+			} else if err != nil {
+				z.err = err
+				break
+			}
+			if n == 0 {
+				continue
+			}
+			ret = C.zs_inflate(&z.zs[0], unsafe.Pointer(&z.inBuf[0]), C.int(n), unsafe.Pointer(&out[0]), &outLen, &inConsumed)
+		}
+		z.inConsumed = inConsumed != 0
+		if ret != C.Z_STREAM_END && ret != C.Z_OK {
+			z.err = zlibReturnCodeToError(ret)
+			break
+		}
+		out = out[len(out)-int(outLen):]
+		if ret == C.Z_STREAM_END {
+			z.err = io.EOF
+		}
+	}
+	return len(orgOut) - len(out), z.err
+}
+
+func unexpectedEOF(err error) error {
+	if err == io.EOF {
+		return io.ErrUnexpectedEOF
+	}
+	return err
+}
+
+// Close releases the cached decompressors.
+func (r *IndexedReader) Close() error {
+	for {
+		select {
+		case zr := <-r.streams:
+			C.zs_inflate_end(&zr.zs[0])
+		default:
+			return nil
+		}
+	}
+}
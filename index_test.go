@@ -0,0 +1,146 @@
+// +build cgo
+
+package zlibng_test
+
+import (
+	"bytes"
+	"compress/gzip"
+	"fmt"
+	"io"
+	"math/rand"
+	"runtime"
+	"testing"
+
+	"github.com/grailbio/testutil/assert"
+	"github.com/yasushi-saito/zlibng"
+)
+
+// readRandomly issues random ReadAt calls to zr and compares the results
+// against data.
+func readRandomly(zr io.ReaderAt, r *rand.Rand, data []byte) error {
+	buf := make([]byte, 100000)
+	for i := 0; i < 50; i++ {
+		off := r.Int63n(int64(len(data)) + 10)
+		n := r.Intn(len(buf))
+		got, err := zr.ReadAt(buf[:n], off)
+		want := []byte{}
+		if off < int64(len(data)) {
+			want = data[off:]
+		}
+		if len(want) > n {
+			want = want[:n]
+		}
+		if len(want) < n {
+			if err != io.EOF {
+				return fmt.Errorf("ReadAt(%d, %d): got error %v, want EOF", off, n, err)
+			}
+		} else if err != nil {
+			return fmt.Errorf("ReadAt(%d, %d): %v", off, n, err)
+		}
+		if !bytes.Equal(buf[:got], want) {
+			return fmt.Errorf("ReadAt(%d, %d): data mismatch", off, n)
+		}
+	}
+	return nil
+}
+
+func testIndexedReader(t *testing.T, r *rand.Rand, compressed, data []byte, windowBits int) {
+	index, err := zlibng.BuildIndex(bytes.NewReader(compressed), 256<<10, zlibng.Opts{WindowBits: windowBits})
+	assert.NoError(t, err)
+	assert.EQ(t, index.Size, int64(len(data)))
+	if len(data) > 1<<20 {
+		assert.GT(t, len(index.Points), 2)
+	}
+
+	// Round trip the index through its serialized form.
+	serialized := bytes.Buffer{}
+	n, err := index.WriteTo(&serialized)
+	assert.NoError(t, err)
+	assert.EQ(t, n, int64(serialized.Len()))
+	index2, err := zlibng.ReadIndex(&serialized)
+	assert.NoError(t, err)
+	assert.EQ(t, index2, index)
+
+	zr, err := zlibng.NewIndexedReader(bytes.NewReader(compressed), index2)
+	assert.NoError(t, err)
+	errs := make(chan error, 4)
+	for i := 0; i < 4; i++ {
+		seed := r.Int63()
+		go func() {
+			errs <- readRandomly(zr, rand.New(rand.NewSource(seed)), data)
+		}()
+	}
+	for i := 0; i < 4; i++ {
+		assert.NoError(t, <-errs)
+	}
+	assert.NoError(t, zr.Close())
+}
+
+func TestIndexedReaderGzip(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	for _, level := range []int{1, 6} {
+		data := compressibleData(r, 4<<20)
+		compressed := bytes.Buffer{}
+		gz, err := gzip.NewWriterLevel(&compressed, level)
+		assert.NoError(t, err)
+		_, err = gz.Write(data)
+		assert.NoError(t, err)
+		assert.NoError(t, gz.Close())
+		testIndexedReader(t, r, compressed.Bytes(), data, 0)
+	}
+}
+
+func TestIndexedReaderFlate(t *testing.T) {
+	r := rand.New(rand.NewSource(1))
+	data := compressibleData(r, 3<<20)
+	compressed := bytes.Buffer{}
+	zout, err := zlibng.NewWriter(&compressed, zlibng.Opts{Level: 9, WindowBits: zlibng.Flate})
+	assert.NoError(t, err)
+	_, err = zout.Write(data)
+	assert.NoError(t, err)
+	assert.NoError(t, zout.Close())
+	testIndexedReader(t, r, compressed.Bytes(), data, zlibng.Flate)
+}
+
+func TestIndexTruncated(t *testing.T) {
+	r := rand.New(rand.NewSource(2))
+	data := compressibleData(r, 1<<20)
+	compressed := bytes.Buffer{}
+	gz := gzip.NewWriter(&compressed)
+	_, err := gz.Write(data)
+	assert.NoError(t, err)
+	assert.NoError(t, gz.Close())
+	_, err = zlibng.BuildIndex(bytes.NewReader(compressed.Bytes()[:compressed.Len()/2]), 1<<16)
+	assert.EQ(t, err, io.ErrUnexpectedEOF)
+}
+
+func TestIndexedReaderReusesBuffer(t *testing.T) {
+	r := rand.New(rand.NewSource(3))
+	data := compressibleData(r, 1<<20)
+	compressed := bytes.Buffer{}
+	gz := gzip.NewWriter(&compressed)
+	_, err := gz.Write(data)
+	assert.NoError(t, err)
+	assert.NoError(t, gz.Close())
+	index, err := zlibng.BuildIndex(bytes.NewReader(compressed.Bytes()), 256<<10)
+	assert.NoError(t, err)
+	zr, err := zlibng.NewIndexedReader(bytes.NewReader(compressed.Bytes()), index, zlibng.Opts{Concurrency: 1})
+	assert.NoError(t, err)
+
+	// After the first call, ReadAt should not allocate another
+	// Opts.Buffer-sized input buffer.
+	buf := make([]byte, 100)
+	_, err = zr.ReadAt(buf, 1000)
+	assert.NoError(t, err)
+	var before, after runtime.MemStats
+	runtime.ReadMemStats(&before)
+	for i := 0; i < 10; i++ {
+		off := r.Int63n(int64(len(data) - len(buf)))
+		_, err = zr.ReadAt(buf, off)
+		assert.NoError(t, err)
+		assert.EQ(t, buf, data[off:off+int64(len(buf))])
+	}
+	runtime.ReadMemStats(&after)
+	assert.LT(t, after.TotalAlloc-before.TotalAlloc, uint64(zlibng.DefaultBufferSize))
+	assert.NoError(t, zr.Close())
+}
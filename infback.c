@@ -52,6 +52,9 @@ int ZEXPORT PREFIX(inflateBackInit_)(PREFIX3(stream) *strm, int windowBits, unsi
     state->window = window;
     state->wnext = 0;
     state->whave = 0;
+#ifdef INFLATE_MULTILIT
+    state->multilit = 0;
+#endif
     return Z_OK;
 }
 
@@ -452,13 +455,15 @@ int ZEXPORT PREFIX(inflateBack)(PREFIX3(stream) *strm, in_func in, void *in_desc
             state->mode = LEN;
 
         case LEN:
-            /* use inflate_fast() if we have enough input and output */
+            /* use inflate_fast() if we have enough input and output. The
+               window is the caller's, without the padding that the chunked
+               x86 variants need, so use the portable one. */
             if (have >= INFLATE_FAST_MIN_HAVE &&
                 left >= INFLATE_FAST_MIN_LEFT) {
                 RESTORE();
                 if (state->whave < state->wsize)
                     state->whave = state->wsize - left;
-                inflate_fast(strm, state->wsize);
+                inflate_fast_c(strm, state->wsize);
                 LOAD();
                 break;
             }
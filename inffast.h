@@ -10,7 +10,7 @@
    subject to change. Applications should only use zlib.h.
  */
 
-void ZLIB_INTERNAL inflate_fast(PREFIX3(stream) *strm, unsigned long start);
+void ZLIB_INTERNAL inflate_fast_c(PREFIX3(stream) *strm, unsigned long start);
 
 
 #if (defined(__GNUC__) || defined(__clang__)) && defined(__ARM_NEON__)
@@ -19,6 +19,17 @@ typedef uint8x16_t inffast_chunk_t;
 #  define INFFAST_CHUNKSIZE sizeof(inffast_chunk_t)
 #endif
 
+/* The inflate window is allocated with this many spare bytes, so that a chunked
+   copy from its end can load a whole chunk. It covers the largest chunk any
+   inflate_fast() variant may use. */
+#if defined(X86_AVX2_CHUNKCOPY)
+#  define INFLATE_WINDOW_PADDING 32
+#elif defined(X86_SSE2_CHUNKCOPY)
+#  define INFLATE_WINDOW_PADDING 16
+#elif defined(INFFAST_CHUNKSIZE)
+#  define INFLATE_WINDOW_PADDING INFFAST_CHUNKSIZE
+#endif
+
 #define INFLATE_FAST_MIN_HAVE 8
 #define INFLATE_FAST_MIN_LEFT 258
 
@@ -124,7 +124,7 @@ int ZEXPORT PREFIX(inflateResetKeep)(PREFIX3(stream) *strm) {
     if (state->wrap)        /* to support ill-conceived Java test suite */
         strm->adler = state->wrap & 1;
     state->mode = HEAD;
-    state->check = zng_functable.adler32(0L, NULL, 0);
+    state->check = FUNCTABLE_GET(adler32)(0L, NULL, 0);
     state->last = 0;
     state->havedict = 0;
     state->dmax = 32768U;
@@ -207,6 +207,9 @@ int ZEXPORT PREFIX(inflateInit2_)(PREFIX3(stream) *strm, int windowBits, const c
     strm->state = (struct internal_state *)state;
     state->strm = strm;
     state->window = NULL;
+#ifdef INFLATE_MULTILIT
+    state->multilit = 0;
+#endif
     state->mode = HEAD;     /* to pass state test in inflateReset2() */
     ret = PREFIX(inflateReset2)(strm, windowBits);
     if (ret != Z_OK) {
@@ -375,12 +378,12 @@ static int updatewindow(PREFIX3(stream) *strm, const unsigned char *end, uint32_
 
     /* if it hasn't been done already, allocate space for the window */
     if (state->window == NULL) {
-#ifdef INFFAST_CHUNKSIZE
+#ifdef INFLATE_WINDOW_PADDING
         unsigned wsize = 1U << state->wbits;
-        state->window = (unsigned char *) ZALLOC(strm, wsize + INFFAST_CHUNKSIZE, sizeof(unsigned char));
+        state->window = (unsigned char *) ZALLOC(strm, wsize + INFLATE_WINDOW_PADDING, sizeof(unsigned char));
         if (state->window == Z_NULL)
             return 1;
-        memset(state->window + wsize, 0, INFFAST_CHUNKSIZE);
+        memset(state->window + wsize, 0, INFLATE_WINDOW_PADDING);
 #else
         state->window = (unsigned char *) ZALLOC(strm, 1U << state->wbits, sizeof(unsigned char));
         if (state->window == NULL)
@@ -426,9 +429,9 @@ static int updatewindow(PREFIX3(stream) *strm, const unsigned char *end, uint32_
 /* check function to use adler32() for zlib or crc32() for gzip */
 #ifdef GUNZIP
 #  define UPDATE(check, buf, len) \
-    (state->flags ? PREFIX(crc32)(check, buf, len) : zng_functable.adler32(check, buf, len))
+    (state->flags ? PREFIX(crc32)(check, buf, len) : FUNCTABLE_GET(adler32)(check, buf, len))
 #else
-#  define UPDATE(check, buf, len) zng_functable.adler32(check, buf, len)
+#  define UPDATE(check, buf, len) FUNCTABLE_GET(adler32)(check, buf, len)
 #endif
 
 /* check macros for header crc */
@@ -674,7 +677,7 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
             }
             state->dmax = 1U << len;
             Tracev((stderr, "inflate:   zlib header ok\n"));
-            strm->adler = state->check = zng_functable.adler32(0L, NULL, 0);
+            strm->adler = state->check = FUNCTABLE_GET(adler32)(0L, NULL, 0);
             state->mode = hold & 0x200 ? DICTID : TYPE;
             INITBITS();
             break;
@@ -821,7 +824,7 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
                 RESTORE();
                 return Z_NEED_DICT;
             }
-            strm->adler = state->check = zng_functable.adler32(0L, NULL, 0);
+            strm->adler = state->check = FUNCTABLE_GET(adler32)(0L, NULL, 0);
             state->mode = TYPE;
         case TYPE:
             if (flush == Z_BLOCK || flush == Z_TREES)
@@ -842,6 +845,10 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
                 break;
             case 1:                             /* fixed block */
                 fixedtables(state);
+#ifdef INFLATE_MULTILIT
+                if (state->multilit)
+                    inflate_multilit_table(state->lencode, state->lenbits, state->litcode);
+#endif
                 Tracev((stderr, "inflate:     fixed codes block%s\n", state->last ? " (last)" : ""));
                 state->mode = LEN_;             /* decode codes */
                 if (flush == Z_TREES) {
@@ -1000,6 +1007,10 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
                 state->mode = BAD;
                 break;
             }
+#ifdef INFLATE_MULTILIT
+            if (state->multilit)
+                inflate_multilit_table(state->lencode, state->lenbits, state->litcode);
+#endif
             state->distcode = (const code *)(state->next);
             state->distbits = 6;
             ret = inflate_table(DISTS, state->lens + state->nlen, state->ndist,
@@ -1019,7 +1030,7 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
             if (have >= INFLATE_FAST_MIN_HAVE &&
                 left >= INFLATE_FAST_MIN_LEFT) {
                 RESTORE();
-                inflate_fast(strm, out);
+                FUNCTABLE_GET(inflate_fast)(strm, out);
                 LOAD();
                 if (state->mode == TYPE)
                     state->back = -1;
@@ -1309,8 +1320,8 @@ int ZEXPORT PREFIX(inflateSetDictionary)(PREFIX3(stream) *strm, const unsigned c
 
     /* check for correct dictionary identifier */
     if (state->mode == DICT) {
-        dictid = zng_functable.adler32(0L, NULL, 0);
-        dictid = zng_functable.adler32(dictid, dictionary, dictLength);
+        dictid = FUNCTABLE_GET(adler32)(0L, NULL, 0);
+        dictid = FUNCTABLE_GET(adler32)(dictid, dictionary, dictLength);
         if (dictid != state->check)
             return Z_DATA_ERROR;
     }
@@ -1455,8 +1466,13 @@ int ZEXPORT PREFIX(inflateCopy)(PREFIX3(stream) *dest, PREFIX3(stream) *source)
     if (copy == NULL)
         return Z_MEM_ERROR;
     window = NULL;
+    wsize = 1U << state->wbits;
     if (state->window != NULL) {
-        window = (unsigned char *) ZALLOC(source, 1U << state->wbits, sizeof(unsigned char));
+#ifdef INFLATE_WINDOW_PADDING
+        window = (unsigned char *) ZALLOC(source, wsize + INFLATE_WINDOW_PADDING, sizeof(unsigned char));
+#else
+        window = (unsigned char *) ZALLOC(source, wsize, sizeof(unsigned char));
+#endif
         if (window == NULL) {
             ZFREE(source, copy);
             return Z_MEM_ERROR;
@@ -1473,8 +1489,10 @@ int ZEXPORT PREFIX(inflateCopy)(PREFIX3(stream) *dest, PREFIX3(stream) *source)
     }
     copy->next = copy->codes + (state->next - state->codes);
     if (window != NULL) {
-        wsize = 1U << state->wbits;
         memcpy(window, state->window, wsize);
+#ifdef INFLATE_WINDOW_PADDING
+        memset(window + wsize, 0, INFLATE_WINDOW_PADDING);
+#endif
     }
     copy->window = window;
     dest->state = (struct internal_state *)copy;
@@ -1497,6 +1515,25 @@ int ZEXPORT PREFIX(inflateUndermine)(PREFIX3(stream) *strm, int subvert) {
 #endif
 }
 
+int ZEXPORT PREFIX(inflateMultiLiteral)(PREFIX3(stream) *strm, int on) {
+    struct inflate_state *state;
+
+    if (inflateStateCheck(strm))
+        return Z_STREAM_ERROR;
+    state = (struct inflate_state *)strm->state;
+#ifdef INFLATE_MULTILIT
+    /* The tables of the current block would be stale. */
+    if (state->mode != HEAD)
+        return Z_STREAM_ERROR;
+    state->multilit = on != 0;
+    return Z_OK;
+#else
+    (void)state;
+    (void)on;
+    return Z_DATA_ERROR;
+#endif
+}
+
 int ZEXPORT PREFIX(inflateValidate)(PREFIX3(stream) *strm, int check) {
     struct inflate_state *state;
 
@@ -125,6 +125,10 @@ struct inflate_state {
     int sane;                   /* if false, allow invalid distance too far */
     int back;                   /* bits back of last unprocessed length/lit */
     unsigned was;               /* initial length of match */
+#ifdef INFLATE_MULTILIT
+    int multilit;               /* if true, inflate_fast() uses litcode */
+    uint32_t litcode[MULTILIT_ENOUGH]; /* multi-literal table for lencode */
+#endif
 };
 
 #endif /* INFLATE_H_ */
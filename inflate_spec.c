@@ -0,0 +1,481 @@
+/* inflate_spec.c -- speculative decoding from the middle of a deflate stream
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/*
+   A deflate stream can be decoded from any block boundary, except that the
+   matches near the boundary may copy from the 32K of data that precedes it.
+   The routines here decode into 16-bit symbols, where a byte copied from the
+   unknown window is recorded as a marker for its position in the window.
+   Once the preceding data is known, the markers are replaced with the actual
+   bytes.  Block boundaries in the middle of a stream are located by trying
+   to read a dynamic-Huffman block header at every bit offset.  Building the
+   three code tables with inflate_table() rejects nearly every offset that is
+   not a real boundary.  This is the approach of rapidgzip and pugz.
+ */
+
+#include "zbuild.h"
+#include "zutil.h"
+#include "inftrees.h"
+#include "inflate_spec.h"
+#include "inffixed.h"
+
+#define SPEC_WSIZE 32768U
+
+/* Maximum bits needed to decode a length/distance pair: 15 bits of length
+   code, 5 extra bits, 15 bits of distance code and 13 extra bits. */
+#define SPEC_MAX_PAIR_BITS 48
+
+/* Bit reader over the whole input buffer */
+typedef struct {
+    const unsigned char *in;    /* input buffer */
+    size_t len;                 /* size of in */
+    size_t next;                /* next byte of in to load into hold */
+    uint64_t hold;              /* bit accumulator */
+    unsigned bits;              /* number of valid bits in hold */
+} spec_bits;
+
+/* Code tables for the current block */
+typedef struct {
+    const code *lencode;        /* literal/length code table */
+    const code *distcode;       /* distance code table */
+    unsigned lenbits;           /* index bits for lencode */
+    unsigned distbits;          /* index bits for distcode */
+    int last;                   /* true if the block is the final one */
+    int stored;                 /* true if the block is a stored block */
+    uint16_t lens[320];         /* temporary storage for code lengths */
+    uint16_t work[288];         /* work area for code table building */
+    code codes[ENOUGH];         /* space for the dynamic code tables */
+} spec_tables;
+
+/* Loads bytes into hold until it has at least 57 bits, or the input ends.
+   Bits of hold above bits are either zero or the correct following input
+   bits, so a wide load may overlap them. */
+static inline void spec_refill(spec_bits *s) {
+    if (s->len - s->next >= 8) {
+        uint64_t v;
+        memcpy(&v, s->in + s->next, sizeof(v));
+        s->hold |= v << s->bits;
+        s->next += (63 - s->bits) >> 3;
+        s->bits |= 56;
+    } else {
+        while (s->bits <= 56 && s->next < s->len) {
+            s->hold |= (uint64_t)s->in[s->next++] << s->bits;
+            s->bits += 8;
+        }
+    }
+}
+
+/* Returns true if hold has at least n bits, loading more input as needed */
+static inline int spec_need(spec_bits *s, unsigned n) {
+    if (s->bits < n)
+        spec_refill(s);
+    return s->bits >= n;
+}
+
+static inline unsigned spec_peek(const spec_bits *s, unsigned n) {
+    return (unsigned)(s->hold & ((1U << n) - 1));
+}
+
+static inline void spec_drop(spec_bits *s, unsigned n) {
+    s->hold >>= n;
+    s->bits -= n;
+}
+
+/* Returns the bit offset of the next unread bit */
+static inline int64_t spec_tell(const spec_bits *s) {
+    return (int64_t)s->next * 8 - s->bits;
+}
+
+/* Positions the reader at the given bit offset.  REQUIRES: bit < len * 8 */
+static void spec_seek(spec_bits *s, const unsigned char *in, size_t len, int64_t bit) {
+    s->in = in;
+    s->len = len;
+    s->next = (size_t)(bit >> 3);
+    s->hold = 0;
+    s->bits = 0;
+    spec_refill(s);
+    spec_drop(s, (unsigned)(bit & 7));
+}
+
+/* Makes room for at least n more symbols in c */
+static int spec_reserve(zng_spec_chunk *c, size_t n) {
+    size_t cap;
+    uint16_t *sym;
+
+    if (c->cap - c->len >= n)
+        return Z_OK;
+    cap = c->cap < 65536 ? 65536 : c->cap;
+    while (cap - c->len < n)
+        cap *= 2;
+    sym = (uint16_t *)realloc(c->sym, cap * sizeof(uint16_t));
+    if (sym == NULL)
+        return Z_MEM_ERROR;
+    c->sym = sym;
+    c->cap = cap;
+    return Z_OK;
+}
+
+/* Reads the code lengths of a dynamic block and builds its code tables */
+static int spec_dynamic(spec_bits *s, spec_tables *t) {
+    static const uint16_t order[19] = /* permutation of code lengths */
+        {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    unsigned nlen, ndist, ncode, have, len, copy;
+    code here, *next;
+
+    if (!spec_need(s, 14))
+        return Z_BUF_ERROR;
+    nlen = spec_peek(s, 5) + 257;
+    spec_drop(s, 5);
+    ndist = spec_peek(s, 5) + 1;
+    spec_drop(s, 5);
+    ncode = spec_peek(s, 4) + 4;
+    spec_drop(s, 4);
+    if (nlen > 286 || ndist > 30)
+        return Z_DATA_ERROR;
+
+    for (have = 0; have < ncode; have++) {
+        if (!spec_need(s, 3))
+            return Z_BUF_ERROR;
+        t->lens[order[have]] = (uint16_t)spec_peek(s, 3);
+        spec_drop(s, 3);
+    }
+    for (; have < 19; have++)
+        t->lens[order[have]] = 0;
+    next = t->codes;
+    t->lencode = (const code *)next;
+    t->lenbits = 7;
+    if (inflate_table(CODES, t->lens, 19, &next, &t->lenbits, t->work))
+        return Z_DATA_ERROR;
+
+    have = 0;
+    while (have < nlen + ndist) {
+        /* A code length code is at most 7 bits plus 7 extra bits.  Fewer
+           bits are left near the end of the input. */
+        spec_need(s, 14);
+        here = t->lencode[spec_peek(s, t->lenbits)];
+        if (here.bits > s->bits)
+            return Z_BUF_ERROR;
+        if (here.val < 16) {
+            spec_drop(s, here.bits);
+            t->lens[have++] = here.val;
+            continue;
+        }
+        if (here.val == 16) {
+            if (here.bits + 2U > s->bits)
+                return Z_BUF_ERROR;
+            spec_drop(s, here.bits);
+            if (have == 0)
+                return Z_DATA_ERROR;
+            len = t->lens[have - 1];
+            copy = 3 + spec_peek(s, 2);
+            spec_drop(s, 2);
+        } else if (here.val == 17) {
+            if (here.bits + 3U > s->bits)
+                return Z_BUF_ERROR;
+            spec_drop(s, here.bits);
+            len = 0;
+            copy = 3 + spec_peek(s, 3);
+            spec_drop(s, 3);
+        } else {
+            if (here.bits + 7U > s->bits)
+                return Z_BUF_ERROR;
+            spec_drop(s, here.bits);
+            len = 0;
+            copy = 11 + spec_peek(s, 7);
+            spec_drop(s, 7);
+        }
+        if (have + copy > nlen + ndist)
+            return Z_DATA_ERROR;
+        while (copy--)
+            t->lens[have++] = (uint16_t)len;
+    }
+
+    /* check for end-of-block code (better have one) */
+    if (t->lens[256] == 0)
+        return Z_DATA_ERROR;
+
+    next = t->codes;
+    t->lencode = (const code *)next;
+    t->lenbits = 9;
+    if (inflate_table(LENS, t->lens, nlen, &next, &t->lenbits, t->work))
+        return Z_DATA_ERROR;
+    t->distcode = (const code *)next;
+    t->distbits = 6;
+    if (inflate_table(DISTS, t->lens + nlen, ndist, &next, &t->distbits, t->work))
+        return Z_DATA_ERROR;
+    return Z_OK;
+}
+
+/* Reads a block header.  For a stored block, it also reads LEN and NLEN, and
+   leaves the reader at the first byte of the stored data. */
+static int spec_header(spec_bits *s, spec_tables *t, unsigned *stored_len) {
+    unsigned type, len;
+
+    if (!spec_need(s, 3))
+        return Z_BUF_ERROR;
+    t->last = (int)spec_peek(s, 1);
+    type = (s->hold >> 1) & 3;
+    spec_drop(s, 3);
+    t->stored = 0;
+    switch (type) {
+    case 0:
+        spec_drop(s, s->bits & 7);
+        if (!spec_need(s, 32))
+            return Z_BUF_ERROR;
+        len = spec_peek(s, 16);
+        spec_drop(s, 16);
+        if (len != (spec_peek(s, 16) ^ 0xffff))
+            return Z_DATA_ERROR;
+        spec_drop(s, 16);
+        t->stored = 1;
+        *stored_len = len;
+        return Z_OK;
+    case 1:
+        t->lencode = lenfix;
+        t->lenbits = 9;
+        t->distcode = distfix;
+        t->distbits = 5;
+        return Z_OK;
+    case 2:
+        return spec_dynamic(s, t);
+    default:
+        return Z_DATA_ERROR;
+    }
+}
+
+/* Copies a stored block of len bytes */
+static int spec_stored(spec_bits *s, zng_spec_chunk *c, unsigned len) {
+    /* The reader is byte aligned after spec_header */
+    size_t start = (size_t)(spec_tell(s) >> 3);
+    unsigned i;
+    int ret;
+
+    if (s->len - start < len)
+        return Z_BUF_ERROR;
+    if ((ret = spec_reserve(c, len)) != Z_OK)
+        return ret;
+    for (i = 0; i < len; i++)
+        c->sym[c->len + i] = s->in[start + i];
+    c->len += len;
+    if (start + len < s->len)
+        spec_seek(s, s->in, s->len, (int64_t)(start + len) * 8);
+    else {
+        s->next = s->len;
+        s->hold = 0;
+        s->bits = 0;
+    }
+    return Z_OK;
+}
+
+/* Decodes the symbols of a fixed or dynamic block up to the end-of-block code */
+static int spec_codes(spec_bits *s, const spec_tables *t, zng_spec_chunk *c) {
+    const code *lcode = t->lencode;
+    const code *dcode = t->distcode;
+    const unsigned lmask = (1U << t->lenbits) - 1;
+    const unsigned dmask = (1U << t->distbits) - 1;
+    code here, last;
+    unsigned op, len, dist, i;
+    uint16_t *put;
+    int64_t from;
+    int ret;
+
+    for (;;) {
+        if (c->cap - c->len < 258 && (ret = spec_reserve(c, 258)) != Z_OK)
+            return ret;
+        if (s->bits < SPEC_MAX_PAIR_BITS)
+            spec_refill(s);
+
+        here = lcode[s->hold & lmask];
+        if (here.op && (here.op & 0xf0) == 0) {
+            last = here;
+            here = lcode[last.val + ((s->hold & ((1U << (last.bits + last.op)) - 1)) >> last.bits)];
+            if ((unsigned)last.bits + here.bits > s->bits)
+                return Z_BUF_ERROR;
+            spec_drop(s, last.bits);
+        }
+        if (here.bits > s->bits)
+            return Z_BUF_ERROR;
+        spec_drop(s, here.bits);
+        op = here.op;
+        if (op == 0) {
+            c->sym[c->len++] = here.val;
+            continue;
+        }
+        if (op & 32)
+            return Z_OK;
+        if (op & 64)
+            return Z_DATA_ERROR;
+
+        len = here.val;
+        op &= 15;
+        if (op) {
+            if (op > s->bits)
+                return Z_BUF_ERROR;
+            len += spec_peek(s, op);
+            spec_drop(s, op);
+        }
+
+        here = dcode[s->hold & dmask];
+        if ((here.op & 0xf0) == 0) {
+            last = here;
+            here = dcode[last.val + ((s->hold & ((1U << (last.bits + last.op)) - 1)) >> last.bits)];
+            if ((unsigned)last.bits + here.bits > s->bits)
+                return Z_BUF_ERROR;
+            spec_drop(s, last.bits);
+        }
+        if (here.bits > s->bits)
+            return Z_BUF_ERROR;
+        spec_drop(s, here.bits);
+        if (here.op & 64)
+            return Z_DATA_ERROR;
+        dist = here.val;
+        op = here.op & 15;
+        if (op) {
+            if (op > s->bits)
+                return Z_BUF_ERROR;
+            dist += spec_peek(s, op);
+            spec_drop(s, op);
+        }
+
+        put = c->sym + c->len;
+        if (dist <= c->len) {
+            const uint16_t *src = put - dist;
+            for (i = 0; i < len; i++)
+                put[i] = src[i];
+        } else {
+            /* The match starts in the unknown window */
+            for (i = 0; i < len; i++) {
+                from = (int64_t)(c->len + i) - dist;
+                put[i] = from < 0 ? (uint16_t)(SPEC_MARKER + SPEC_WSIZE + from) : c->sym[from];
+            }
+        }
+        c->len += len;
+    }
+}
+
+/* Decodes one block, header included */
+static int spec_block(spec_bits *s, spec_tables *t, zng_spec_chunk *c) {
+    unsigned stored_len = 0;
+    int ret;
+
+    if ((ret = spec_header(s, t, &stored_len)) != Z_OK)
+        return ret;
+    if (t->stored)
+        return spec_stored(s, c, stored_len);
+    return spec_codes(s, t, c);
+}
+
+static int spec_decode(zng_spec_chunk *c, spec_tables *t, const unsigned char *in, size_t in_len,
+                       int64_t start_bit, int64_t stop_bit, int64_t soft_bit) {
+    spec_bits s;
+    int64_t pos;
+    int ret;
+
+    c->len = 0;
+    c->end_bit = start_bit;
+    if (start_bit < 0 || start_bit >= (int64_t)in_len * 8)
+        return Z_BUF_ERROR;
+    spec_seek(&s, in, in_len, start_bit);
+    for (;;) {
+        pos = spec_tell(&s);
+        c->end_bit = pos;
+        if (pos != start_bit) {
+            if (stop_bit >= 0) {
+                if (pos == stop_bit)
+                    return Z_OK;
+                if (pos > stop_bit)
+                    return Z_DATA_ERROR;
+            } else if (pos >= soft_bit) {
+                return Z_OK;
+            }
+        }
+        if ((ret = spec_block(&s, t, c)) != Z_OK)
+            return ret;
+        if (t->last) {
+            c->end_bit = spec_tell(&s);
+            return Z_STREAM_END;
+        }
+    }
+}
+
+int zng_inflate_spec_decode(zng_spec_chunk *c, const unsigned char *in, size_t in_len,
+                            int64_t start_bit, int64_t stop_bit, int64_t soft_bit) {
+    spec_tables t;
+    return spec_decode(c, &t, in, in_len, start_bit, stop_bit, soft_bit);
+}
+
+int64_t zng_inflate_spec_find(const unsigned char *in, size_t in_len, int64_t start_bit, int64_t end_bit) {
+    zng_spec_chunk scratch = {NULL, 0, 0, 0};
+    spec_tables t;
+    spec_bits s;
+    unsigned stored_len, i;
+    uint32_t v;
+    int64_t bit, found = -1;
+    size_t at;
+    int ret;
+
+    if (end_bit > (int64_t)in_len * 8)
+        end_bit = (int64_t)in_len * 8;
+    for (bit = start_bit < 0 ? 0 : start_bit; bit < end_bit; bit++) {
+        /* Check BFINAL=0, BTYPE=2, HLIT<=29 and HDIST<=29 cheaply */
+        at = (size_t)(bit >> 3);
+        v = 0;
+        for (i = 0; i < 4 && at + i < in_len; i++)
+            v |= (uint32_t)in[at + i] << (8 * i);
+        v >>= bit & 7;
+        if ((v & 7) != 4 || ((v >> 3) & 31) > 29 || ((v >> 8) & 31) > 29)
+            continue;
+
+        spec_seek(&s, in, in_len, bit);
+        if (spec_header(&s, &t, &stored_len) != Z_OK)
+            continue;
+        /* Decode the block, then check that the next header is valid */
+        ret = spec_decode(&scratch, &t, in, in_len, bit, -1, bit + 1);
+        if (ret == Z_BUF_ERROR) {
+            /* The block runs past the end of the input */
+            found = bit;
+            break;
+        }
+        if (ret != Z_OK)
+            continue;
+        if (scratch.end_bit >= (int64_t)in_len * 8) {
+            found = bit;
+            break;
+        }
+        spec_seek(&s, in, in_len, scratch.end_bit);
+        ret = spec_header(&s, &t, &stored_len);
+        if (ret == Z_OK || ret == Z_BUF_ERROR) {
+            found = bit;
+            break;
+        }
+    }
+    zng_inflate_spec_free(&scratch);
+    return found;
+}
+
+int zng_inflate_spec_resolve(const uint16_t *sym, size_t n, const unsigned char *window, size_t window_len,
+                             unsigned char *out) {
+    /* Marker SPEC_MARKER + SPEC_WSIZE - k stands for the k'th byte before the
+       symbols */
+    const unsigned base = SPEC_MARKER + SPEC_WSIZE - (unsigned)window_len;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        unsigned v = sym[i];
+        if (v < SPEC_MARKER)
+            out[i] = (unsigned char)v;
+        else if (v >= base)
+            out[i] = window[v - base];
+        else
+            return Z_DATA_ERROR;
+    }
+    return Z_OK;
+}
+
+void zng_inflate_spec_free(zng_spec_chunk *c) {
+    free(c->sym);
+    c->sym = NULL;
+    c->len = 0;
+    c->cap = 0;
+}
@@ -0,0 +1,54 @@
+#ifndef INFLATE_SPEC_H_
+#define INFLATE_SPEC_H_
+
+/* inflate_spec.h -- header to use inflate_spec.c
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Symbols produced by speculative decoding.  Values below SPEC_MARKER are
+   literal bytes.  SPEC_MARKER + i stands for byte i of the 32K window that
+   precedes the position at which decoding started; the byte is unknown until
+   zng_inflate_spec_resolve is given the window. */
+#define SPEC_MARKER 256
+
+/* Output of zng_inflate_spec_decode.  sym is allocated with malloc, and it is
+   reused across calls.  Initialize the struct with zeros, and release it with
+   zng_inflate_spec_free. */
+typedef struct zng_spec_chunk_s {
+    uint16_t *sym;      /* decoded symbols */
+    size_t len;         /* number of symbols in sym */
+    size_t cap;         /* allocated size of sym */
+    int64_t end_bit;    /* bit offset in the input where decoding stopped */
+} zng_spec_chunk;
+
+/* Decodes the raw deflate stream in[0, in_len) starting at bit offset
+   start_bit, which must be the start of a deflate block.  Decoding stops at
+   the first block boundary after start_bit that equals stop_bit, or, if
+   stop_bit is negative, that is at or after soft_bit.  Returns Z_OK when it
+   stops at such a boundary, Z_STREAM_END after the final block,
+   Z_DATA_ERROR if the data is invalid or a block boundary passes stop_bit
+   without hitting it, Z_BUF_ERROR if the input ends in the middle of a
+   block, and Z_MEM_ERROR if sym cannot be grown. */
+int zng_inflate_spec_decode(zng_spec_chunk *c, const unsigned char *in, size_t in_len,
+                            int64_t start_bit, int64_t stop_bit, int64_t soft_bit);
+
+/* Returns the first bit offset in [start_bit, end_bit) that starts a
+   non-final dynamic-Huffman block of the raw deflate stream in[0, in_len),
+   or -1 if none is found.  A candidate must have valid code tables, and the
+   block must decode cleanly up to a valid header of the next block.  The
+   result is a guess: a false positive is rare, but possible. */
+int64_t zng_inflate_spec_find(const unsigned char *in, size_t in_len, int64_t start_bit, int64_t end_bit);
+
+/* Converts n symbols to bytes in out.  window holds the window_len (at most
+   32K) bytes that precede the symbols.  Returns Z_DATA_ERROR if a symbol
+   refers to a byte before the window. */
+int zng_inflate_spec_resolve(const uint16_t *sym, size_t n, const unsigned char *window, size_t window_len,
+                             unsigned char *out);
+
+/* Releases the memory held by c. */
+void zng_inflate_spec_free(zng_spec_chunk *c);
+
+#endif /* INFLATE_SPEC_H_ */
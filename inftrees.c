@@ -295,3 +295,31 @@ int ZLIB_INTERNAL inflate_table(codetype type, uint16_t *lens, unsigned codes,
     *bits = root;
     return 0;
 }
+
+#ifdef INFLATE_MULTILIT
+/*
+   Build the multi-literal table for the root table lcode, which has bits index
+   bits. An entry of lcode is repeated for all values of the index bits beyond
+   its code length, so after dropping the bits of the first literals, the
+   entry for the remaining index bits is right whenever its code length fits
+   in them.
+ */
+void ZLIB_INTERNAL inflate_multilit_table(const code *lcode, unsigned bits, uint32_t *table) {
+    unsigned i, n, used;
+    uint32_t lits;
+    code here;
+
+    for (i = 0; i < (1U << bits); i++) {
+        used = 0;
+        lits = 0;
+        for (n = 0; n < 3; n++) {
+            here = lcode[i >> used];
+            if (here.op != 0 || used + here.bits > bits)
+                break;
+            lits |= (uint32_t)here.val << (8 * n);
+            used += here.bits;
+        }
+        table[i] = n == 0 ? 0 : used | (n << 4) | (lits << 8);
+    }
+}
+#endif
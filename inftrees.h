@@ -63,4 +63,17 @@ typedef enum {
 int ZLIB_INTERNAL inflate_table (codetype type, uint16_t *lens, unsigned codes,
                                   code * *table, unsigned *bits, uint16_t *work);
 
+#ifdef INFLATE_MULTILIT
+/* Multi-literal table, built by inflate_multilit_table() from the root table
+   of the literal/length codes and indexed by the same bits. An entry holds up
+   to three literals whose codes fit in those bits together:
+    bits 0-3   - number of bits to drop for all the literals
+    bits 4-5   - number of literals, 0 if the code there is not a literal
+    bits 8-31  - the literals, the first one in bits 8-15
+   The root table has at most 9 index bits (see the calls in inflate.c). */
+#define MULTILIT_ENOUGH (1U << 9)
+
+void ZLIB_INTERNAL inflate_multilit_table (const code *lcode, unsigned bits, uint32_t *table);
+#endif
+
 #endif /* INFTREES_H_ */
@@ -45,7 +45,7 @@
  * Standard longest_match
  *
  */
-ZLIB_INTERNAL unsigned longest_match(deflate_state *const s, IPos cur_match) {
+ZLIB_INTERNAL unsigned longest_match_c(deflate_state *const s, IPos cur_match) {
     const unsigned wmask = s->w_mask;
     const Pos *prev = s->prev;
 
@@ -151,7 +151,7 @@ ZLIB_INTERNAL unsigned longest_match(deflate_state *const s, IPos cur_match) {
             if (s->level < TRIGGER_LEVEL)
                 break;
         }
-    } while ((cur_match = prev[cur_match & wmask]) > limit && --chain_length);
+    } while ((cur_match = REL_POS(s, prev[cur_match & wmask])) > limit && --chain_length);
 
     if ((unsigned int)best_len <= s->lookahead)
         return best_len;
@@ -164,7 +164,7 @@ ZLIB_INTERNAL unsigned longest_match(deflate_state *const s, IPos cur_match) {
  * UNALIGNED_OK longest_match
  *
  */
-ZLIB_INTERNAL unsigned longest_match(deflate_state *const s, IPos cur_match) {
+ZLIB_INTERNAL unsigned longest_match_c(deflate_state *const s, IPos cur_match) {
     const unsigned wmask = s->w_mask;
     const Pos *prev = s->prev;
 
@@ -274,7 +274,7 @@ ZLIB_INTERNAL unsigned longest_match(deflate_state *const s, IPos cur_match) {
             if (s->level < TRIGGER_LEVEL)
                 break;
         }
-    } while (--chain_length && (cur_match = prev[cur_match & wmask]) > limit);
+    } while (--chain_length && (cur_match = REL_POS(s, prev[cur_match & wmask])) > limit);
 
     if ((unsigned)best_len <= s->lookahead)
         return best_len;
@@ -283,198 +283,45 @@ ZLIB_INTERNAL unsigned longest_match(deflate_state *const s, IPos cur_match) {
 #endif
 
 #ifdef std3_longest_match
-/* longest_match() with minor change to improve performance (in terms of
- * execution time).
- *
- * The pristine longest_match() function is sketched below (strip the
- * then-clause of the "#ifdef UNALIGNED_OK"-directive)
- *
- * ------------------------------------------------------------
- * unsigned int longest_match(...) {
- *    ...
- *    do {
- *        match = s->window + cur_match;                //s0
- *        if (*(ushf*)(match+best_len-1) != scan_end || //s1
- *            *(ushf*)match != scan_start) continue;    //s2
- *        ...
- *
- *        do {
- *        } while (*(ushf*)(scan+=2) == *(ushf*)(match+=2) &&
- *                 *(ushf*)(scan+=2) == *(ushf*)(match+=2) &&
- *                 *(ushf*)(scan+=2) == *(ushf*)(match+=2) &&
- *                 *(ushf*)(scan+=2) == *(ushf*)(match+=2) &&
- *                 scan < strend); //s3
- *
- *        ...
- *    } while(cond); //s4
- *
- * -------------------------------------------------------------
- *
- * The change include:
- *
- *  1) The hottest statements of the function is: s0, s1 and s4. Pull them
- *     together to form a new loop. The benefit is two-fold:
- *
- *    o. Ease the compiler to yield good code layout: the conditional-branch
- *       corresponding to s1 and its biased target s4 become very close (likely,
- *       fit in the same cache-line), hence improving instruction-fetching
- *       efficiency.
- *
- *    o. Ease the compiler to promote "s->window" into register. "s->window"
- *       is loop-invariant; it is supposed to be promoted into register and keep
- *       the value throughout the entire loop. However, there are many such
- *       loop-invariant, and x86-family has small register file; "s->window" is
- *       likely to be chosen as register-allocation victim such that its value
- *       is reloaded from memory in every single iteration. By forming a new loop,
- *       "s->window" is loop-invariant of that newly created tight loop. It is
- *       lot easier for compiler to promote this quantity to register and keep
- *       its value throughout the entire small loop.
- *
- * 2) Transfrom s3 such that it examines sizeof(long)-byte-match at a time.
- *    This is done by:
- *        ------------------------------------------------
- *        v1 = load from "scan" by sizeof(long) bytes
- *        v2 = load from "match" by sizeof(lnog) bytes
- *        v3 = v1 xor v2
- *        match-bit = little-endian-machine(yes-for-x86) ?
- *                     count-trailing-zero(v3) :
- *                     count-leading-zero(v3);
- *
- *        match-byte = match-bit/8
- *
- *        "scan" and "match" advance if necessary
- *       -------------------------------------------------
- */
-
-ZLIB_INTERNAL unsigned longest_match(deflate_state *const s, IPos cur_match) {
-    unsigned int strstart = s->strstart;
-    unsigned chain_length = s->max_chain_length;/* max hash chain length */
-    unsigned char *window = s->window;
-    register unsigned char *scan = window + strstart; /* current string */
-    register unsigned char *match;                       /* matched string */
-    register unsigned int len;                  /* length of current match */
-    unsigned int best_len = s->prev_length;     /* best match length so far */
-    unsigned int nice_match = s->nice_match;    /* stop if match long enough */
-    IPos limit = strstart > (IPos)MAX_DIST(s) ?
-        strstart - (IPos)MAX_DIST(s) : NIL;
-    /* Stop when cur_match becomes <= limit. To simplify the code,
-     * we prevent matches with the string of window index 0.
-     */
-    Pos *prev = s->prev;
-    unsigned int wmask = s->w_mask;
-
-    register unsigned char *strend = window + strstart + MAX_MATCH;
-
-    uint16_t scan_start, scan_end;
-
-    memcpy(&scan_start, scan, sizeof(scan_start));
-    memcpy(&scan_end, scan+best_len-1, sizeof(scan_end));
-
-    /* The code is optimized for HASH_BITS >= 8 and MAX_MATCH-2 multiple of 16.
-     * It is easy to get rid of this optimization if necessary.
-     */
-    Assert(s->hash_bits >= 8 && MAX_MATCH == 258, "Code too clever");
-
-    /* Do not waste too much time if we already have a good match: */
-    if (s->prev_length >= s->good_match) {
-        chain_length >>= 2;
-    }
-    /* Do not look for matches beyond the end of the input. This is necessary
-     * to make deflate deterministic.
-     */
-    if ((unsigned int)nice_match > s->lookahead) nice_match = s->lookahead;
-
-    Assert((unsigned long)strstart <= s->window_size-MIN_LOOKAHEAD, "need lookahead");
+/* compare258_unaligned compares sizeof(long) bytes at a time, so it reads up to
+ * 264 bytes of each string. */
+static inline unsigned compare258_unaligned(const unsigned char *src0, const unsigned char *src1) {
+    unsigned len = 0;
 
     do {
-        if (cur_match >= strstart) {
-          break;
-        }
+        unsigned long sv, mv, xor;
 
-        /* Skip to next match if the match length cannot increase
-         * or if the match length is less than 2.  Note that the checks below
-         * for insufficient lookahead only occur occasionally for performance
-         * reasons.  Therefore uninitialized memory will be accessed, and
-         * conditional jumps will be made that depend on those values.
-         * However the length of the match is limited to the lookahead, so
-         * the output of deflate is not affected by the uninitialized values.
-         */
-        int cont = 1;
-        do {
-            match = window + cur_match;
-            if (likely(memcmp(match+best_len-1, &scan_end, sizeof(scan_end)) != 0)) {
-                if ((cur_match = prev[cur_match & wmask]) > limit
-                    && --chain_length != 0) {
-                    continue;
-                } else {
-                    cont = 0;
-                }
-            }
-            break;
-        } while (1);
+        memcpy(&sv, src0 + len, sizeof(sv));
+        memcpy(&mv, src1 + len, sizeof(mv));
 
-        if (!cont)
-            break;
+        xor = sv ^ mv;
 
-        if (memcmp(match, &scan_start, sizeof(scan_start)) != 0)
-            continue;
-
-        /* It is not necessary to compare scan[2] and match[2] since they are
-         * always equal when the other bytes match, given that the hash keys
-         * are equal and that HASH_BITS >= 8. Compare 2 bytes at a time at
-         * strstart+3, +5, ... up to strstart+257. We check for insufficient
-         * lookahead only every 4th comparison; the 128th check will be made
-         * at strstart+257. If MAX_MATCH-2 is not a multiple of 8, it is
-         * necessary to put more guard bytes at the end of the window, or
-         * to check more often for insufficient lookahead.
-         */
-        scan += 2, match+=2;
-        Assert(*scan == *match, "match[2]?");
-        do {
-            unsigned long sv, mv, xor;
-
-            memcpy(&sv, scan, sizeof(sv));
-            memcpy(&mv, match, sizeof(mv));
+        if (xor) {
+            len += __builtin_ctzl(xor) / 8;
+            break;
+        }
+        len += sizeof(unsigned long);
+    } while (len < MAX_MATCH);
 
-            xor = sv ^ mv;
+    return len < MAX_MATCH ? len : MAX_MATCH;
+}
 
-            if (xor) {
-                int match_byte = __builtin_ctzl(xor) / 8;
-                scan += match_byte;
-                break;
-            } else {
-                scan += sizeof(unsigned long);
-                match += sizeof(unsigned long);
-            }
-        } while (scan < strend);
+ZLIB_INTERNAL unsigned compare258_c(const unsigned char *src0, const unsigned char *src1) {
+    return compare258_unaligned(src0, src1);
+}
 
-        if (scan > strend)
-            scan = strend;
+#define LONGEST_MATCH      longest_match_c
+#define LONGEST_MATCH_ATTR ZLIB_INTERNAL
+#define COMPARE258         compare258_unaligned
+#include "match_tpl.h"
 
-        Assert(scan <= window + (unsigned)(s->window_size-1), "wild scan");
+#else
 
-        len = MAX_MATCH - (int)(strend - scan);
-        scan = strend - MAX_MATCH;
+ZLIB_INTERNAL unsigned compare258_c(const unsigned char *src0, const unsigned char *src1) {
+    unsigned len = 0;
 
-        if (len > best_len) {
-            s->match_start = cur_match;
-            best_len = len;
-            if (len >= nice_match)
-                break;
-            memcpy(&scan_end, scan+best_len-1, sizeof(scan_end));
-        } else {
-            /*
-             * The probability of finding a match later if we here
-             * is pretty low, so for performance it's best to
-             * outright stop here for the lower compression levels
-             */
-            if (s->level < TRIGGER_LEVEL)
-                break;
-        }
-    } while ((cur_match = prev[cur_match & wmask]) > limit && --chain_length != 0);
-
-    if ((unsigned int)best_len <= s->lookahead)
-        return (unsigned int)best_len;
-    return s->lookahead;
+    while (len < MAX_MATCH && src0[len] == src1[len])
+        len++;
+    return len;
 }
 #endif
@@ -1,6 +1,15 @@
 #ifndef MATCH_H_
 #define MATCH_H_
 
-unsigned int longest_match  (deflate_state *s, IPos cur_match);
+/* longest_match and compare258 variants. deflate calls them through
+ * zng_functable, which picks one at runtime. */
+unsigned int longest_match_c     (deflate_state *const s, IPos cur_match);
+unsigned int longest_match_avx2  (deflate_state *const s, IPos cur_match);
+unsigned int longest_match_avx512(deflate_state *const s, IPos cur_match);
+
+unsigned int compare258_c     (const unsigned char *src0, const unsigned char *src1);
+unsigned int compare258_sse   (const unsigned char *src0, const unsigned char *src1);
+unsigned int compare258_avx2  (const unsigned char *src0, const unsigned char *src1);
+unsigned int compare258_avx512(const unsigned char *src0, const unsigned char *src1);
 
 #endif /* MATCH_H_ */
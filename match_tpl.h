@@ -0,0 +1,195 @@
+/* match_tpl.h -- longest_match() template
+ *
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * The includer defines:
+ *   LONGEST_MATCH       the name of the function.
+ *   LONGEST_MATCH_ATTR  its attributes, e.g. ZLIB_INTERNAL.
+ *   COMPARE258          a function or macro that returns the length of the
+ *                       common prefix of two strings, up to MAX_MATCH bytes.
+ *                       It may read past the end of the prefix, and past
+ *                       MAX_MATCH bytes: compare258_unaligned reads up to 264
+ *                       bytes from each string. The window has WINDOW_PADDING
+ *                       spare bytes for this.
+ */
+
+/* longest_match() with minor change to improve performance (in terms of
+ * execution time).
+ *
+ * The pristine longest_match() function is sketched below (strip the
+ * then-clause of the "#ifdef UNALIGNED_OK"-directive)
+ *
+ * ------------------------------------------------------------
+ * unsigned int longest_match(...) {
+ *    ...
+ *    do {
+ *        match = s->window + cur_match;                //s0
+ *        if (*(ushf*)(match+best_len-1) != scan_end || //s1
+ *            *(ushf*)match != scan_start) continue;    //s2
+ *        ...
+ *
+ *        do {
+ *        } while (*(ushf*)(scan+=2) == *(ushf*)(match+=2) &&
+ *                 *(ushf*)(scan+=2) == *(ushf*)(match+=2) &&
+ *                 *(ushf*)(scan+=2) == *(ushf*)(match+=2) &&
+ *                 *(ushf*)(scan+=2) == *(ushf*)(match+=2) &&
+ *                 scan < strend); //s3
+ *
+ *        ...
+ *    } while(cond); //s4
+ *
+ * -------------------------------------------------------------
+ *
+ * The change include:
+ *
+ *  1) The hottest statements of the function is: s0, s1 and s4. Pull them
+ *     together to form a new loop. The benefit is two-fold:
+ *
+ *    o. Ease the compiler to yield good code layout: the conditional-branch
+ *       corresponding to s1 and its biased target s4 become very close (likely,
+ *       fit in the same cache-line), hence improving instruction-fetching
+ *       efficiency.
+ *
+ *    o. Ease the compiler to promote "s->window" into register. "s->window"
+ *       is loop-invariant; it is supposed to be promoted into register and keep
+ *       the value throughout the entire loop. However, there are many such
+ *       loop-invariant, and x86-family has small register file; "s->window" is
+ *       likely to be chosen as register-allocation victim such that its value
+ *       is reloaded from memory in every single iteration. By forming a new loop,
+ *       "s->window" is loop-invariant of that newly created tight loop. It is
+ *       lot easier for compiler to promote this quantity to register and keep
+ *       its value throughout the entire small loop.
+ *
+ * 2) Transfrom s3 such that it examines many bytes at a time, in COMPARE258.
+ *    compare258_c does this by:
+ *        ------------------------------------------------
+ *        v1 = load from "scan" by sizeof(long) bytes
+ *        v2 = load from "match" by sizeof(lnog) bytes
+ *        v3 = v1 xor v2
+ *        match-bit = little-endian-machine(yes-for-x86) ?
+ *                     count-trailing-zero(v3) :
+ *                     count-leading-zero(v3);
+ *
+ *        match-byte = match-bit/8
+ *
+ *        "scan" and "match" advance if necessary
+ *       -------------------------------------------------
+ */
+
+LONGEST_MATCH_ATTR unsigned LONGEST_MATCH(deflate_state *const s, IPos cur_match) {
+    unsigned int strstart = s->strstart;
+    unsigned chain_length = s->max_chain_length;/* max hash chain length */
+    unsigned char *window = s->window;
+    register unsigned char *scan = window + strstart; /* current string */
+    register unsigned char *match;                       /* matched string */
+    register unsigned int len;                  /* length of current match */
+    unsigned int best_len = s->prev_length;     /* best match length so far */
+    unsigned int nice_match = s->nice_match;    /* stop if match long enough */
+    IPos limit = strstart > (IPos)MAX_DIST(s) ?
+        strstart - (IPos)MAX_DIST(s) : NIL;
+    /* Stop when cur_match becomes <= limit. To simplify the code,
+     * we prevent matches with the string of window index 0.
+     */
+    Pos *prev = s->prev;
+    unsigned int wmask = s->w_mask;
+    /* The chain is walked with the positions of prev, which are the window
+     * indexes plus base, see ABS_POS(). The entries from before the window
+     * are <= base, so they also end the walk.
+     */
+    IPos base = ABS_POS(s, 0);
+    IPos end = strstart + base;
+
+    limit += base;
+    cur_match += base;
+
+    uint16_t scan_start, scan_end;
+
+    memcpy(&scan_start, scan, sizeof(scan_start));
+    memcpy(&scan_end, scan+best_len-1, sizeof(scan_end));
+
+    /* The code is optimized for HASH_BITS >= 8 and MAX_MATCH-2 multiple of 16.
+     * It is easy to get rid of this optimization if necessary.
+     */
+    Assert(s->hash_bits >= 8 && MAX_MATCH == 258, "Code too clever");
+
+    /* Do not waste too much time if we already have a good match: */
+    if (s->prev_length >= s->good_match) {
+        chain_length >>= 2;
+    }
+    /* Do not look for matches beyond the end of the input. This is necessary
+     * to make deflate deterministic.
+     */
+    if ((unsigned int)nice_match > s->lookahead) nice_match = s->lookahead;
+
+    Assert((unsigned long)strstart <= s->window_size-MIN_LOOKAHEAD, "need lookahead");
+
+    do {
+        if (cur_match >= end) {
+          break;
+        }
+
+        /* Skip to next match if the match length cannot increase
+         * or if the match length is less than 2.  Note that the checks below
+         * for insufficient lookahead only occur occasionally for performance
+         * reasons.  Therefore uninitialized memory will be accessed, and
+         * conditional jumps will be made that depend on those values.
+         * However the length of the match is limited to the lookahead, so
+         * the output of deflate is not affected by the uninitialized values.
+         */
+        int cont = 1;
+        do {
+            match = window + (cur_match - base);
+            if (likely(memcmp(match+best_len-1, &scan_end, sizeof(scan_end)) != 0)) {
+                if ((cur_match = prev[cur_match & wmask]) > limit
+                    && --chain_length != 0) {
+                    continue;
+                } else {
+                    cont = 0;
+                }
+            }
+            break;
+        } while (1);
+
+        if (!cont)
+            break;
+
+        if (memcmp(match, &scan_start, sizeof(scan_start)) != 0)
+            continue;
+
+        /* It is not necessary to compare scan[2] and match[2] since they are
+         * always equal when the other bytes match, given that the hash keys
+         * are equal and that HASH_BITS >= 8. COMPARE258 compares them anyway:
+         * it is simpler than offsetting, and it costs nothing with wide loads.
+         * COMPARE258 may read up to 264 bytes from either string. scan is at
+         * least MIN_LOOKAHEAD (262) bytes before the end of the window, so
+         * this needs the 2 bytes of WINDOW_PADDING.
+         */
+        Assert(scan[2] == match[2], "match[2]?");
+        len = COMPARE258(scan, match);
+        Assert(scan + len <= window + (unsigned)(s->window_size-1), "wild scan");
+
+        if (len > best_len) {
+            s->match_start = cur_match - base;
+            best_len = len;
+            if (len >= nice_match)
+                break;
+            memcpy(&scan_end, scan+best_len-1, sizeof(scan_end));
+        } else {
+            /*
+             * The probability of finding a match later if we here
+             * is pretty low, so for performance it's best to
+             * outright stop here for the lower compression levels
+             */
+            if (s->level < TRIGGER_LEVEL)
+                break;
+        }
+    } while ((cur_match = prev[cur_match & wmask]) > limit && --chain_length != 0);
+
+    if ((unsigned int)best_len <= s->lookahead)
+        return (unsigned int)best_len;
+    return s->lookahead;
+}
+
+#undef LONGEST_MATCH
+#undef LONGEST_MATCH_ATTR
+#undef COMPARE258
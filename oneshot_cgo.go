@@ -0,0 +1,235 @@
+// +build cgo,amd64
+
+package zlibng
+
+/*
+#include "./zlib-ng.h"
+#include "./zstream.h"
+*/
+import "C"
+
+import (
+	"encoding/binary"
+	"errors"
+	"io"
+	"math"
+	"runtime"
+	"sync"
+	"unsafe"
+)
+
+var errTooLarge = errors.New("zlibng: buffer larger than 2GiB")
+
+// streamParams identifies the parameters a pooled stream was created with.
+type streamParams struct {
+	level, windowBits, memLevel, strategy int
+	blockSplit, storeIncompressible       bool
+	quickDynamic                          bool
+}
+
+// pooledStream is a deflate or inflate stream cached in a sync.Pool. It is
+// reset, not reallocated, between uses. The finalizer releases the C state
+// once the pool drops the stream.
+type pooledStream struct {
+	zs      zstream
+	deflate bool
+	outLen  C.int // out-param of C calls, kept here so that it doesn't escape to the heap.
+}
+
+// Pools of *pooledStream, keyed by streamParams. sync.Pool keeps a per-P
+// cache, so Get and Put rarely contend.
+var deflaterPools, inflaterPools sync.Map
+
+func freePooledStream(s *pooledStream) {
+	if s.deflate {
+		C.zs_deflate_free(&s.zs[0])
+	} else {
+		C.zs_inflate_end(&s.zs[0])
+	}
+}
+
+func streamPool(pools *sync.Map, key streamParams) *sync.Pool {
+	if p, ok := pools.Load(key); ok {
+		return p.(*sync.Pool)
+	}
+	p, _ := pools.LoadOrStore(key, &sync.Pool{})
+	return p.(*sync.Pool)
+}
+
+func getDeflater(opt Opts) (*pooledStream, *sync.Pool, error) {
+	key := streamParams{
+		level:      opt.Level,
+		windowBits: opt.WindowBits,
+		memLevel:   opt.MemLevel,
+		strategy:   opt.Strategy,
+		blockSplit: opt.BlockSplit,
+		// A one-shot call passes all of src to deflate at once, so it is
+		// sampled as a single Write.
+		storeIncompressible: opt.StoreIncompressible,
+		quickDynamic:        opt.QuickDynamic,
+	}
+	pool := streamPool(&deflaterPools, key)
+	if s, ok := pool.Get().(*pooledStream); ok {
+		return s, pool, nil
+	}
+	s := &pooledStream{deflate: true}
+	if ec := C.zs_deflate_init(&s.zs[0], C.int(key.level), C.int(key.windowBits),
+		C.int(key.memLevel), C.int(key.strategy), 0); ec != 0 {
+		return nil, nil, zlibReturnCodeToError(ec)
+	}
+	if ec := setDeflateFlags(&s.zs, opt); ec != 0 {
+		C.zs_deflate_free(&s.zs[0])
+		return nil, nil, zlibReturnCodeToError(ec)
+	}
+	runtime.SetFinalizer(s, freePooledStream)
+	return s, pool, nil
+}
+
+func getInflater(windowBits int) (*pooledStream, *sync.Pool, error) {
+	pool := streamPool(&inflaterPools, streamParams{windowBits: windowBits})
+	if s, ok := pool.Get().(*pooledStream); ok {
+		return s, pool, nil
+	}
+	s := &pooledStream{}
+	var getHeaderStatus C.int
+	if ec := C.zs_inflate_init(&s.zs[0], C.int(windowBits), 0, nil, &getHeaderStatus); ec != 0 {
+		return nil, nil, zlibReturnCodeToError(ec)
+	}
+	runtime.SetFinalizer(s, freePooledStream)
+	return s, pool, nil
+}
+
+// compressInto implements CompressInto with a pooled stream. The compression
+// is a single cgo call.
+func compressInto(dst, src []byte, opt Opts) (int, error) {
+	if opt.WindowBits == 0 {
+		opt.WindowBits = Gzip
+	}
+	if opt.MemLevel == 0 {
+		opt.MemLevel = 8
+	}
+	if opt.Strategy == 0 {
+		opt.Strategy = DefaultStrategy
+	}
+	if len(src) > math.MaxInt32 || len(dst) > math.MaxInt32 {
+		return 0, errTooLarge
+	}
+	if len(dst) == 0 {
+		return 0, io.ErrShortBuffer
+	}
+	s, pool, err := getDeflater(opt)
+	if err != nil {
+		return 0, err
+	}
+	var in unsafe.Pointer
+	if len(src) > 0 {
+		in = unsafe.Pointer(&src[0])
+	}
+	s.outLen = C.int(len(dst))
+	ret := C.zs_deflate_member(&s.zs[0], in, C.int(len(src)), bufPtr(dst), &s.outLen)
+	outLen := s.outLen
+	pool.Put(s)
+	if ret == C.Z_BUF_ERROR {
+		return 0, io.ErrShortBuffer
+	}
+	if ret != 0 {
+		return 0, zlibReturnCodeToError(ret)
+	}
+	return len(dst) - int(outLen), nil
+}
+
+// decompressInto implements DecompressInto with a pooled stream. The
+// decompression is a single cgo call.
+func decompressInto(dst, src []byte, windowBits int) (int, error) {
+	if windowBits == 0 {
+		windowBits = 32 + 15 // autodetect gzip/zlib
+	}
+	if len(src) > math.MaxInt32 || len(dst) > math.MaxInt32 {
+		return 0, errTooLarge
+	}
+	if len(src) == 0 {
+		return 0, nil
+	}
+	s, pool, err := getInflater(windowBits)
+	if err != nil {
+		return 0, err
+	}
+	var out unsafe.Pointer
+	if len(dst) > 0 {
+		out = unsafe.Pointer(&dst[0])
+	}
+	s.outLen = C.int(len(dst))
+	ret := C.zs_inflate_into(&s.zs[0], bufPtr(src), C.int(len(src)), out, &s.outLen)
+	outLen := s.outLen
+	pool.Put(s)
+	if ret == C.Z_BUF_ERROR {
+		return 0, io.ErrShortBuffer
+	}
+	if ret != 0 {
+		return 0, zlibReturnCodeToError(ret)
+	}
+	return len(dst) - int(outLen), nil
+}
+
+// Compress appends the gzip compression of src to dst, and returns the
+// extended buffer. Level is as in Opts.Level. It is meant for small messages:
+// it uses a pooled compressor, and it crosses into C only once.
+func Compress(dst, src []byte, level int) ([]byte, error) {
+	n := len(dst)
+	bound := CompressBound(len(src))
+	if cap(dst)-n < bound {
+		buf := make([]byte, n, n+bound)
+		copy(buf, dst)
+		dst = buf
+	}
+	m, err := compressInto(dst[n:n+bound], src, Opts{Level: level})
+	return dst[:n+m], err
+}
+
+const (
+	// maxDeflateRatio is the largest expansion of deflate: a 258-byte match
+	// takes at least two bits.
+	maxDeflateRatio = 1032
+	// maxSizeHint caps the buffer that Decompress allocates up front.
+	maxSizeHint = 64 << 20
+)
+
+// Decompress appends the decompression of src, which holds one or more gzip or
+// zlib members, to dst, and returns the extended buffer. It uses a pooled
+// decompressor. For a single gzip member, the output size is taken from the
+// trailer so that the decompression crosses into C only once.
+func Decompress(dst, src []byte) ([]byte, error) {
+	n := len(dst)
+	size := 4 * len(src)
+	if len(src) >= 18 && src[0] == 0x1f && src[1] == 0x8b {
+		// ISIZE, the uncompressed size mod 2^32, is in the last four bytes.
+		// It is not checked until the end, so it is capped by what src can
+		// expand to, and by maxSizeHint. The loop below grows the buffer if
+		// the output is larger.
+		size = int(binary.LittleEndian.Uint32(src[len(src)-4:]))
+		if size > maxDeflateRatio*len(src) {
+			size = maxDeflateRatio * len(src)
+		}
+		if size > maxSizeHint {
+			size = maxSizeHint
+		}
+	}
+	for {
+		if size < 64 {
+			size = 64
+		}
+		if cap(dst)-n < size {
+			buf := make([]byte, n, n+size)
+			copy(buf, dst)
+			dst = buf
+		}
+		m, err := decompressInto(dst[n:cap(dst)], src, 0)
+		if err != io.ErrShortBuffer {
+			return dst[:n+m], err
+		}
+		if cap(dst)-n >= math.MaxInt32 {
+			return dst[:n], errTooLarge
+		}
+		size = 2 * (cap(dst) - n)
+	}
+}
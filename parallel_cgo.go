@@ -0,0 +1,645 @@
+// +build cgo,amd64
+
+package zlibng
+
+/*
+#include "./zlib-ng.h"
+#include "./zstream.h"
+*/
+import "C"
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"io"
+	"runtime"
+	"sync"
+	"time"
+	"unsafe"
+)
+
+// maxDictSize is the size of the deflate window. Each block is primed with
+// this many trailing bytes of the preceding block.
+const maxDictSize = 32 * 1024
+
+// ParallelWriter is a gzip/flate writer that splits the input into
+// Opts.BlockSize chunks and compresses them concurrently, pigz style. Each
+// chunk is primed with the last 32KiB of the preceding chunk, and chunks are
+// joined with Z_SYNC_FLUSH boundaries, so the output is a single standard
+// gzip member (or a flate stream) readable by any inflater. It implements
+// io.WriteCloser. Close must be called to release the compressor threads.
+type ParallelWriter struct {
+	out       io.Writer
+	opt       Opts
+	header    GzipHeader
+	hasHeader bool // true if SetHeader was called.
+	streams   []*zstream
+	cur       *parallelBlock      // block being filled by Write.
+	dict      []byte              // trailing bytes of the last dispatched block.
+	jobs      chan *parallelBlock // blocks waiting to be compressed.
+	results   chan *parallelBlock // blocks waiting to be written, in input order.
+	free      chan *parallelBlock // recycled blocks.
+	wg        sync.WaitGroup      // counts the compressor goroutines.
+	done      chan struct{}       // closed when the output goroutine exits.
+	closed    bool
+	crc       uint32 // CRC-32 of the input written so far. Owned by the output goroutine.
+	inBytes   int64  // total input bytes. Owned by the output goroutine.
+	mu        sync.Mutex
+	err       error
+}
+
+type parallelBlock struct {
+	in, dict, out []byte
+	last          bool
+	crc           uint32
+	err           error
+	done          chan struct{}
+}
+
+// NewParallelWriter creates a gzip/flate writer that compresses using
+// Opts.Concurrency threads. There can be at most one options arg.  If opts is
+// empty, NewParallelWriter will use Opts{Format:Gzip,Level:-1}.
+//
+// REQUIRES: Opts.WindowBits is Gzip or Flate.
+func NewParallelWriter(w io.Writer, opts ...Opts) (*ParallelWriter, error) {
+	opt, err := getOpts(opts...)
+	if err != nil {
+		return nil, err
+	}
+	if opt.WindowBits == 0 {
+		opt.WindowBits = Gzip
+	}
+	if opt.WindowBits != Gzip && opt.WindowBits != Flate {
+		return nil, errors.New("zlibng.NewParallelWriter: WindowBits must be Gzip or Flate")
+	}
+	if opt.MemLevel == 0 {
+		opt.MemLevel = 8
+	}
+	if opt.Strategy == 0 {
+		opt.Strategy = DefaultStrategy
+	}
+	z := &ParallelWriter{
+		out:     w,
+		opt:     opt,
+		jobs:    make(chan *parallelBlock, opt.Concurrency),
+		results: make(chan *parallelBlock, opt.Concurrency),
+		free:    make(chan *parallelBlock, opt.Concurrency+2),
+		done:    make(chan struct{}),
+	}
+	for i := 0; i < opt.Concurrency; i++ {
+		zs := &zstream{}
+		// Blocks are always raw deflate; the gzip wrapper is written by the
+		// output goroutine.
+		ec := C.zs_deflate_init(&zs[0], C.int(opt.Level),
+			C.int(Flate), C.int(opt.MemLevel), C.int(opt.Strategy), slabFlag(opt))
+		if ec == 0 {
+			if ec = setDeflateFlags(zs, opt); ec != 0 {
+				C.zs_deflate_free(&zs[0])
+			}
+		}
+		if ec != 0 {
+			for _, zs := range z.streams {
+				C.zs_deflate_free(&zs[0])
+			}
+			return nil, zlibReturnCodeToError(ec)
+		}
+		z.streams = append(z.streams, zs)
+	}
+	z.wg.Add(len(z.streams))
+	for _, zs := range z.streams {
+		go z.compressLoop(zs)
+	}
+	go z.outputLoop()
+	return z, nil
+}
+
+// SetHeader sets the Gzip header contents.
+//
+// REQUIRES: No Write nor Close has been called yet.
+// REQUIRES: The archive format is Gzip.
+func (z *ParallelWriter) SetHeader(h GzipHeader) error {
+	if z.opt.WindowBits != Gzip {
+		return zlibReturnCodeToError(C.Z_STREAM_ERROR)
+	}
+	z.header = h
+	z.hasHeader = true
+	return nil
+}
+
+func (z *ParallelWriter) getErr() error {
+	z.mu.Lock()
+	err := z.err
+	z.mu.Unlock()
+	return err
+}
+
+func (z *ParallelWriter) setErr(err error) {
+	z.mu.Lock()
+	if z.err == nil {
+		z.err = err
+	}
+	z.mu.Unlock()
+}
+
+func (z *ParallelWriter) newBlock() *parallelBlock {
+	select {
+	case b := <-z.free:
+		b.in = b.in[:0]
+		return b
+	default:
+		return &parallelBlock{
+			in:   make([]byte, 0, z.opt.BlockSize),
+			done: make(chan struct{}, 1),
+		}
+	}
+}
+
+// Write implements io.Writer.
+func (z *ParallelWriter) Write(in []byte) (int, error) {
+	if z.closed {
+		return 0, errors.New("zlibng.ParallelWriter: write after close")
+	}
+	if err := z.getErr(); err != nil {
+		return 0, err
+	}
+	n := len(in)
+	for len(in) > 0 {
+		if z.cur == nil {
+			z.cur = z.newBlock()
+		}
+		room := z.opt.BlockSize - len(z.cur.in)
+		if room > len(in) {
+			room = len(in)
+		}
+		z.cur.in = append(z.cur.in, in[:room]...)
+		in = in[room:]
+		if len(z.cur.in) == z.opt.BlockSize {
+			z.dispatch(false)
+		}
+	}
+	return n, nil
+}
+
+// dispatch hands the current block to the compressors.
+func (z *ParallelWriter) dispatch(last bool) {
+	b := z.cur
+	if b == nil {
+		b = z.newBlock()
+	}
+	z.cur = nil
+	b.last = last
+	b.dict = append(b.dict[:0], z.dict...)
+	if tail := len(b.in) - maxDictSize; tail > 0 {
+		z.dict = append(z.dict[:0], b.in[tail:]...)
+	} else {
+		z.dict = append(z.dict, b.in...)
+		if extra := len(z.dict) - maxDictSize; extra > 0 {
+			z.dict = append(z.dict[:0], z.dict[extra:]...)
+		}
+	}
+	// Enqueue to results first so that the output goroutine sees the blocks in
+	// input order. This also bounds the number of in-flight blocks.
+	z.results <- b
+	z.jobs <- b
+}
+
+func (z *ParallelWriter) compressLoop(zs *zstream) {
+	defer z.wg.Done()
+	for b := range z.jobs {
+		b.err = compressBlock(zs, b)
+		b.done <- struct{}{}
+	}
+}
+
+func compressBlock(zs *zstream, b *parallelBlock) error {
+	var (
+		inPtr, dictPtr unsafe.Pointer
+		last           C.int
+	)
+	if len(b.in) > 0 {
+		inPtr = unsafe.Pointer(&b.in[0])
+	}
+	if len(b.dict) > 0 {
+		dictPtr = unsafe.Pointer(&b.dict[0])
+	}
+	if b.last {
+		last = 1
+	}
+	bound := int(C.zs_deflate_bound(&zs[0], C.int(len(b.in))))
+	for {
+		if cap(b.out) < bound {
+			b.out = make([]byte, bound)
+		}
+		b.out = b.out[:cap(b.out)]
+		var (
+			outLen = C.int(len(b.out))
+			crc    C.uint32_t
+		)
+		ret := C.zs_deflate_block(&zs[0], dictPtr, C.int(len(b.dict)), inPtr, C.int(len(b.in)),
+			unsafe.Pointer(&b.out[0]), &outLen, last, &crc)
+		if ret == C.Z_BUF_ERROR && bound < 4*len(b.in)+maxDictSize {
+			bound *= 2
+			continue
+		}
+		if ret != 0 {
+			return zlibReturnCodeToError(ret)
+		}
+		b.out = b.out[:len(b.out)-int(outLen)]
+		b.crc = uint32(crc)
+		return nil
+	}
+}
+
+func (z *ParallelWriter) write(data []byte) {
+	if z.getErr() != nil {
+		return
+	}
+	n, err := z.out.Write(data)
+	if err == nil && n < len(data) {
+		err = io.ErrShortWrite
+	}
+	if err != nil {
+		z.setErr(err)
+	}
+}
+
+func (z *ParallelWriter) outputLoop() {
+	defer close(z.done)
+	first := true
+	for b := range z.results {
+		<-b.done
+		if first && z.opt.WindowBits == Gzip {
+			z.write(z.gzipHeader())
+		}
+		first = false
+		if b.err != nil {
+			z.setErr(b.err)
+		}
+		z.write(b.out)
+		z.crc = uint32(C.zs_crc32_combine(C.uint32_t(z.crc), C.uint32_t(b.crc), C.int64_t(len(b.in))))
+		z.inBytes += int64(len(b.in))
+		select {
+		case z.free <- b:
+		default:
+		}
+	}
+}
+
+// gzipHeader serializes the gzip member header, cf. RFC1952 Section 2.3.
+func (z *ParallelWriter) gzipHeader() []byte {
+	const (
+		flagExtra   = 4
+		flagName    = 8
+		flagComment = 16
+	)
+	var (
+		h     = z.header
+		buf   = make([]byte, 10, 10+len(h.Extra)+len(h.Name)+len(h.Comment)+4)
+		level = z.opt.Level
+	)
+	if level == -1 {
+		level = 6
+	}
+	buf[0], buf[1], buf[2] = 0x1f, 0x8b, 8
+	if len(h.Extra) > 0 {
+		buf[3] |= flagExtra
+	}
+	if len(h.Name) > 0 {
+		buf[3] |= flagName
+	}
+	if len(h.Comment) > 0 {
+		buf[3] |= flagComment
+	}
+	if h.ModTime.After(time.Unix(0, 0)) {
+		binary.LittleEndian.PutUint32(buf[4:8], uint32(h.ModTime.Unix()))
+	}
+	if level >= 9 {
+		buf[8] = 2
+	} else if z.opt.Strategy >= HuffmanOnlyStrategy || level < 2 {
+		buf[8] = 4
+	}
+	if z.hasHeader {
+		buf[9] = h.OS
+	} else {
+		// Same as the OS_CODE used by deflate.
+		buf[9] = 3 // Unix
+		if runtime.GOOS == "darwin" {
+			buf[9] = 19
+		}
+	}
+	if len(h.Extra) > 0 {
+		buf = append(buf, byte(len(h.Extra)), byte(len(h.Extra)>>8))
+		buf = append(buf, h.Extra...)
+	}
+	if len(h.Name) > 0 {
+		buf = append(buf, h.Name...)
+		buf = append(buf, 0)
+	}
+	if len(h.Comment) > 0 {
+		buf = append(buf, h.Comment...)
+		buf = append(buf, 0)
+	}
+	return buf
+}
+
+// Close implements io.Closer. It flushes the remaining data and waits for the
+// compressor threads to finish.
+func (z *ParallelWriter) Close() error {
+	if z.closed {
+		return z.getErr()
+	}
+	z.closed = true
+	z.dispatch(true)
+	close(z.jobs)
+	close(z.results)
+	<-z.done
+	z.wg.Wait()
+	for _, zs := range z.streams {
+		C.zs_deflate_free(&zs[0])
+	}
+	z.streams = nil
+	if z.opt.WindowBits == Gzip {
+		var trailer [8]byte
+		binary.LittleEndian.PutUint32(trailer[0:4], z.crc)
+		binary.LittleEndian.PutUint32(trailer[4:8], uint32(z.inBytes))
+		z.write(trailer[:])
+	}
+	return z.getErr()
+}
+
+// ParallelReader is a gzip reader that decompresses the members of a BGZF
+// (or any multi-member gzip file whose members carry the BGZF "BC" size
+// subfield) on Opts.Concurrency threads. A scanner thread locates member
+// boundaries ahead of the consumer, and the decompressed members are
+// delivered in order. If the reader encounters a member without the size
+// subfield, it decompresses the rest of the input speculatively: see
+// specReader. It implements io.ReadCloser.
+type ParallelReader struct {
+	in      *bufio.Reader
+	opt     Opts
+	streams []*zstream
+	jobs    chan *parallelBlock // members waiting to be decompressed.
+	results chan *parallelBlock // members waiting to be read, in input order.
+	free    chan *parallelBlock // recycled blocks.
+	stop    chan struct{}       // closed by Close to stop the scanner.
+	wg      sync.WaitGroup      // counts the decompressor goroutines.
+	scanErr error               // set by the scanner before closing results.
+	cur     *parallelBlock      // block being consumed by Read.
+	curOut  []byte              // unread part of cur.out.
+	serial  *specReader         // reads the input after a non-BGZF member.
+	closed  bool
+	err     error
+}
+
+// NewParallelReader creates a gzip/flate reader that decompresses using
+// Opts.Concurrency threads. There can be at most one options arg. Opts.BlockSize
+// is the number of compressed bytes that each thread decodes speculatively.
+//
+// REQUIRES: Opts.WindowBits is unset, Gzip or Flate.
+func NewParallelReader(in io.Reader, opts ...Opts) (*ParallelReader, error) {
+	opt, err := getOpts(opts...)
+	if err != nil {
+		return nil, err
+	}
+	if opt.WindowBits == 0 {
+		opt.WindowBits = Gzip
+	}
+	if opt.WindowBits != Gzip && opt.WindowBits != Flate {
+		return nil, errors.New("zlibng.NewParallelReader: WindowBits must be Gzip or Flate")
+	}
+	if opt.WindowBits == Flate {
+		// A flate stream has no member boundaries.
+		results := make(chan *parallelBlock)
+		close(results)
+		return &ParallelReader{
+			opt:     opt,
+			results: results,
+			stop:    make(chan struct{}),
+			serial:  newSpecReader(in, opt),
+		}, nil
+	}
+	z := &ParallelReader{
+		in:      bufio.NewReaderSize(in, opt.Buffer),
+		opt:     opt,
+		jobs:    make(chan *parallelBlock, opt.Concurrency+1),
+		results: make(chan *parallelBlock, opt.Concurrency),
+		free:    make(chan *parallelBlock, opt.Concurrency+2),
+		stop:    make(chan struct{}),
+	}
+	for i := 0; i < opt.Concurrency; i++ {
+		zs := &zstream{}
+		var getHeaderStatus C.int
+		ec := C.zs_inflate_init(&zs[0], C.int(Gzip), slabFlag(opt), nil, &getHeaderStatus)
+		if ec == 0 && opt.MultiLiteral {
+			if ec = C.zs_inflate_multi_literal(&zs[0]); ec != 0 {
+				C.zs_inflate_end(&zs[0])
+			}
+		}
+		if ec != 0 {
+			for _, zs := range z.streams {
+				C.zs_inflate_end(&zs[0])
+			}
+			return nil, zlibReturnCodeToError(ec)
+		}
+		z.streams = append(z.streams, zs)
+	}
+	z.wg.Add(len(z.streams))
+	for _, zs := range z.streams {
+		go z.decompressLoop(zs)
+	}
+	go z.scanLoop()
+	return z, nil
+}
+
+func (z *ParallelReader) newBlock() *parallelBlock {
+	select {
+	case b := <-z.free:
+		b.in, b.last, b.err = b.in[:0], false, nil
+		return b
+	default:
+		return &parallelBlock{done: make(chan struct{}, 1)}
+	}
+}
+
+// readMember reads the next gzip member into b.in. If the member does not
+// carry the BGZF size subfield, it sets b.last and b.in holds the bytes read
+// so far. It returns io.EOF at the clean end of the input.
+func (z *ParallelReader) readMember(b *parallelBlock) error {
+	const (
+		fixedHeaderSize = 12 // fixed gzip header plus XLEN
+		flagExtra       = 4
+	)
+	b.in = append(b.in[:0], make([]byte, fixedHeaderSize)...)
+	if n, err := io.ReadFull(z.in, b.in); err != nil {
+		if err == io.EOF {
+			return io.EOF
+		}
+		if err == io.ErrUnexpectedEOF && n >= 2 && b.in[0] == 0x1f && b.in[1] == 0x8b {
+			return err
+		}
+		// Not a gzip member. Let the serial reader diagnose the error.
+		b.in, b.last = b.in[:n], true
+		return nil
+	}
+	if b.in[0] != 0x1f || b.in[1] != 0x8b || b.in[3]&flagExtra == 0 {
+		b.last = true
+		return nil
+	}
+	xlen := int(binary.LittleEndian.Uint16(b.in[10:]))
+	b.in = append(b.in, make([]byte, xlen)...)
+	if _, err := io.ReadFull(z.in, b.in[fixedHeaderSize:]); err != nil {
+		return io.ErrUnexpectedEOF
+	}
+	blockSize := -1
+	for extra := b.in[fixedHeaderSize:]; len(extra) >= 4; {
+		slen := int(binary.LittleEndian.Uint16(extra[2:]))
+		if extra[0] == 'B' && extra[1] == 'C' && slen == 2 && len(extra) >= 6 {
+			blockSize = int(binary.LittleEndian.Uint16(extra[4:])) + 1
+			break
+		}
+		if 4+slen > len(extra) {
+			break
+		}
+		extra = extra[4+slen:]
+	}
+	if blockSize < len(b.in)+8 {
+		b.last = true
+		return nil
+	}
+	n := len(b.in)
+	b.in = append(b.in, make([]byte, blockSize-n)...)
+	if _, err := io.ReadFull(z.in, b.in[n:]); err != nil {
+		return io.ErrUnexpectedEOF
+	}
+	return nil
+}
+
+func (z *ParallelReader) scanLoop() {
+	defer close(z.results)
+	defer close(z.jobs)
+	for {
+		b := z.newBlock()
+		if err := z.readMember(b); err != nil {
+			if err != io.EOF {
+				z.scanErr = err
+			}
+			return
+		}
+		select {
+		case z.results <- b:
+		case <-z.stop:
+			return
+		}
+		if b.last {
+			// The rest of the input is read by the consumer.
+			return
+		}
+		z.jobs <- b
+	}
+}
+
+func (z *ParallelReader) decompressLoop(zs *zstream) {
+	defer z.wg.Done()
+	for b := range z.jobs {
+		b.err = decompressBlock(zs, b)
+		b.done <- struct{}{}
+	}
+}
+
+func decompressBlock(zs *zstream, b *parallelBlock) error {
+	// ISIZE, the uncompressed size mod 2^32, is in the last four bytes.
+	size := int(binary.LittleEndian.Uint32(b.in[len(b.in)-4:]))
+	if size > BGZFMaxBlockSize*16 {
+		return zlibReturnCodeToError(C.Z_DATA_ERROR)
+	}
+	if cap(b.out) < size+1 {
+		b.out = make([]byte, size+1)
+	}
+	b.out = b.out[:size+1] // +1 to detect a wrong ISIZE.
+	outLen := C.int(len(b.out))
+	ret := C.zs_inflate_member(&zs[0], unsafe.Pointer(&b.in[0]), C.int(len(b.in)),
+		unsafe.Pointer(&b.out[0]), &outLen)
+	if ret != 0 {
+		return zlibReturnCodeToError(ret)
+	}
+	b.out = b.out[:len(b.out)-int(outLen)]
+	if len(b.out) != size {
+		return zlibReturnCodeToError(C.Z_DATA_ERROR)
+	}
+	return nil
+}
+
+// next advances z.cur to the next block.
+func (z *ParallelReader) next() {
+	if z.cur != nil {
+		select {
+		case z.free <- z.cur:
+		default:
+		}
+		z.cur = nil
+	}
+	b, ok := <-z.results
+	if !ok {
+		z.err = z.scanErr
+		if z.err == nil {
+			z.err = io.EOF
+		}
+		return
+	}
+	if b.last {
+		z.serial = newSpecReader(io.MultiReader(bytes.NewReader(b.in), z.in), z.opt)
+		return
+	}
+	<-b.done
+	z.cur = b
+	if b.err != nil {
+		z.err = b.err
+		return
+	}
+	z.curOut = b.out
+}
+
+// Read implements io.Reader.
+func (z *ParallelReader) Read(out []byte) (int, error) {
+	for len(z.curOut) == 0 {
+		if z.serial != nil {
+			return z.serial.Read(out)
+		}
+		if z.err != nil {
+			return 0, z.err
+		}
+		if len(out) == 0 {
+			return 0, nil
+		}
+		z.next()
+	}
+	n := copy(out, z.curOut)
+	z.curOut = z.curOut[n:]
+	return n, nil
+}
+
+// Close implements io.Closer. It stops the background threads.
+func (z *ParallelReader) Close() error {
+	if z.closed {
+		return nil
+	}
+	z.closed = true
+	close(z.stop)
+	for range z.results {
+	}
+	z.wg.Wait()
+	for _, zs := range z.streams {
+		C.zs_inflate_end(&zs[0])
+	}
+	z.streams = nil
+	var err error
+	if z.serial != nil {
+		err = z.serial.Close()
+	}
+	if z.err != nil && z.err != io.EOF {
+		err = z.err
+	}
+	return err
+}
@@ -0,0 +1,367 @@
+// +build cgo,amd64
+
+package zlibng
+
+/*
+#include "./zlib-ng.h"
+#include "./inflate_spec.h"
+*/
+import "C"
+
+import (
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"hash/crc32"
+	"io"
+	"sync"
+	"unsafe"
+)
+
+// specReader decompresses single-member gzip files and flate streams on
+// multiple threads without an index, cf. rapidgzip. Each round splits the
+// next Opts.Concurrency*Opts.BlockSize compressed bytes into chunks. A thread
+// per chunk guesses the first deflate block boundary in the chunk, and then
+// decodes from it up to the boundary guessed for the next chunk. Bytes
+// copied from the unknown 32KiB window before a boundary are recorded as
+// markers, which are resolved in order once the preceding output is known.
+// A chunk whose guess turns out to be wrong is decoded serially. Multiple
+// gzip members are decoded one after another.
+type specReader struct {
+	in       io.Reader
+	opt      Opts
+	gzip     bool   // false for a raw flate stream.
+	buf      []byte // compressed input. Bit offsets are relative to buf[0].
+	inEOF    bool   // true if in reached io.EOF.
+	pos      int64  // bit offset in buf of the next deflate block.
+	inMember bool   // true if pos is inside a deflate stream.
+	done     bool   // true after the flate stream ended.
+	window   []byte // last (up to 32KiB) bytes of the current member.
+	crc      uint32 // CRC-32 of the current member.
+	size     uint32 // size of the current member, mod 2^32.
+	chunks   []C.zng_spec_chunk
+	outBuf   []byte
+	out      []byte // unread part of outBuf.
+	err      error
+}
+
+// specSlack is the number of compressed bytes read beyond a round, so that
+// the deflate block that straddles the end of the round can be decoded.
+const specSlack = 256 * 1024
+
+var errShortGzipHeader = errors.New("zlibng: short gzip header")
+
+func newSpecReader(in io.Reader, opt Opts) *specReader {
+	return &specReader{
+		in:   in,
+		opt:  opt,
+		gzip: opt.WindowBits != Flate,
+	}
+}
+
+// fill reads the input until buf has at least n bytes or the input ends.
+func (z *specReader) fill(n int) error {
+	if cap(z.buf) < n {
+		buf := make([]byte, len(z.buf), n)
+		copy(buf, z.buf)
+		z.buf = buf
+	}
+	for len(z.buf) < n && !z.inEOF {
+		m, err := z.in.Read(z.buf[len(z.buf):n])
+		z.buf = z.buf[:len(z.buf)+m]
+		if err == io.EOF {
+			z.inEOF = true
+		} else if err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// compact drops the bytes of buf before pos.
+func (z *specReader) compact() {
+	k := int(z.pos >> 3)
+	n := copy(z.buf, z.buf[k:])
+	z.buf = z.buf[:n]
+	z.pos -= int64(k) * 8
+}
+
+// gzipHeaderSize returns the size of the gzip header at the start of b.
+func gzipHeaderSize(b []byte) (int, error) {
+	const (
+		flagHCRC    = 2
+		flagExtra   = 4
+		flagName    = 8
+		flagComment = 16
+	)
+	if len(b) < 10 {
+		return 0, errShortGzipHeader
+	}
+	if b[0] != 0x1f || b[1] != 0x8b || b[2] != 8 {
+		return 0, zlibReturnCodeToError(C.Z_DATA_ERROR)
+	}
+	flag, n := b[3], 10
+	if flag&flagExtra != 0 {
+		if len(b) < n+2 {
+			return 0, errShortGzipHeader
+		}
+		n += 2 + int(binary.LittleEndian.Uint16(b[n:]))
+	}
+	for _, f := range []byte{flagName, flagComment} {
+		if flag&f != 0 && n <= len(b) {
+			i := bytes.IndexByte(b[n:], 0)
+			if i < 0 {
+				return 0, errShortGzipHeader
+			}
+			n += i + 1
+		}
+	}
+	if flag&flagHCRC != 0 {
+		n += 2
+	}
+	if n > len(b) {
+		return 0, errShortGzipHeader
+	}
+	return n, nil
+}
+
+// startMember reads the gzip header of the next member.
+func (z *specReader) startMember() error {
+	z.compact()
+	if z.gzip {
+		for {
+			n, err := gzipHeaderSize(z.buf)
+			if err == nil {
+				z.pos = int64(n) * 8
+				break
+			}
+			if err != errShortGzipHeader {
+				return err
+			}
+			if z.inEOF {
+				if len(z.buf) == 0 {
+					return io.EOF
+				}
+				return io.ErrUnexpectedEOF
+			}
+			if err := z.fill(len(z.buf) + 64*1024); err != nil {
+				return err
+			}
+		}
+	}
+	z.inMember = true
+	z.window = z.window[:0]
+	z.crc, z.size = 0, 0
+	return nil
+}
+
+// endMember verifies the gzip trailer that follows the deflate stream.
+func (z *specReader) endMember() error {
+	z.inMember = false
+	trailer := int((z.pos + 7) >> 3)
+	if !z.gzip {
+		z.done = true
+		return nil
+	}
+	if err := z.fill(trailer + 8); err != nil {
+		return err
+	}
+	if len(z.buf) < trailer+8 {
+		return io.ErrUnexpectedEOF
+	}
+	if binary.LittleEndian.Uint32(z.buf[trailer:]) != z.crc ||
+		binary.LittleEndian.Uint32(z.buf[trailer+4:]) != z.size {
+		return zlibReturnCodeToError(C.Z_DATA_ERROR)
+	}
+	z.pos = int64(trailer+8) * 8
+	return nil
+}
+
+// decode runs zng_inflate_spec_decode on buf.
+func (z *specReader) decode(c *C.zng_spec_chunk, start, stop, soft int64) C.int {
+	if len(z.buf) == 0 {
+		return C.Z_BUF_ERROR
+	}
+	return C.zng_inflate_spec_decode(c, (*C.uchar)(unsafe.Pointer(&z.buf[0])), C.size_t(len(z.buf)),
+		C.int64_t(start), C.int64_t(stop), C.int64_t(soft))
+}
+
+// decodeSerial decodes from start to the first block boundary at or after
+// soft. It reads more input if the block at soft extends beyond buf.
+func (z *specReader) decodeSerial(c *C.zng_spec_chunk, start, soft int64) (C.int, error) {
+	for {
+		ret := z.decode(c, start, -1, soft)
+		if ret != C.Z_BUF_ERROR || z.inEOF {
+			return ret, nil
+		}
+		if err := z.fill(len(z.buf) + specSlack); err != nil {
+			return ret, err
+		}
+	}
+}
+
+// emit resolves the symbols in c and appends them to outBuf.
+func (z *specReader) emit(c *C.zng_spec_chunk) error {
+	n := int(c.len)
+	if n == 0 {
+		return nil
+	}
+	off := len(z.outBuf)
+	if cap(z.outBuf) < off+n {
+		buf := make([]byte, off, 2*(off+n))
+		copy(buf, z.outBuf)
+		z.outBuf = buf
+	}
+	z.outBuf = z.outBuf[:off+n]
+	var window unsafe.Pointer
+	if len(z.window) > 0 {
+		window = unsafe.Pointer(&z.window[0])
+	}
+	if ret := C.zng_inflate_spec_resolve(c.sym, c.len, (*C.uchar)(window), C.size_t(len(z.window)),
+		(*C.uchar)(unsafe.Pointer(&z.outBuf[off]))); ret != C.Z_OK {
+		return zlibReturnCodeToError(ret)
+	}
+	data := z.outBuf[off:]
+	z.crc = crc32.Update(z.crc, crc32.IEEETable, data)
+	z.size += uint32(n)
+	if n >= maxDictSize {
+		z.window = append(z.window[:0], data[n-maxDictSize:]...)
+	} else {
+		z.window = append(z.window, data...)
+		if excess := len(z.window) - maxDictSize; excess > 0 {
+			z.window = z.window[:copy(z.window, z.window[excess:])]
+		}
+	}
+	return nil
+}
+
+// round decodes the next Opts.Concurrency chunks of the current member.
+func (z *specReader) round() error {
+	z.compact()
+	var (
+		nChunks   = z.opt.Concurrency
+		chunkBits = int64(z.opt.BlockSize) * 8
+		softLimit = z.pos + int64(nChunks)*chunkBits
+	)
+	if err := z.fill(nChunks*z.opt.BlockSize + specSlack); err != nil {
+		return err
+	}
+	inBits := int64(len(z.buf)) * 8
+
+	// Guess a block boundary near the start of each chunk.
+	found := make([]int64, nChunks)
+	wg := sync.WaitGroup{}
+	for i := 1; i < nChunks; i++ {
+		found[i] = -1
+		lo := z.pos + int64(i)*chunkBits
+		if lo >= inBits {
+			break
+		}
+		wg.Add(1)
+		go func(i int, lo int64) {
+			found[i] = int64(C.zng_inflate_spec_find((*C.uchar)(unsafe.Pointer(&z.buf[0])),
+				C.size_t(len(z.buf)), C.int64_t(lo), C.int64_t(lo+chunkBits)))
+			wg.Done()
+		}(i, lo)
+	}
+	wg.Wait()
+	starts := []int64{z.pos}
+	for _, start := range found[1:] {
+		if start > starts[len(starts)-1] {
+			starts = append(starts, start)
+		}
+	}
+
+	// Decode from each boundary up to the next one.
+	for len(z.chunks) < len(starts) {
+		z.chunks = append(z.chunks, C.zng_spec_chunk{})
+	}
+	rets := make([]C.int, len(starts))
+	wg.Add(len(starts))
+	for i := range starts {
+		go func(i int) {
+			stop := int64(-1)
+			if i+1 < len(starts) {
+				stop = starts[i+1]
+			}
+			rets[i] = z.decode(&z.chunks[i], starts[i], stop, softLimit)
+			wg.Done()
+		}(i)
+	}
+	wg.Wait()
+
+	// Resolve the chunks in order. A chunk is usable only if the preceding
+	// chunk ended exactly where it started.
+	z.outBuf = z.outBuf[:0]
+	cur := z.pos
+	for i := range starts {
+		limit := softLimit
+		if i+1 < len(starts) {
+			limit = starts[i+1]
+		}
+		c, ret := &z.chunks[i], rets[i]
+		if starts[i] != cur || (ret != C.Z_OK && ret != C.Z_STREAM_END) {
+			if cur >= limit {
+				continue
+			}
+			var err error
+			if ret, err = z.decodeSerial(c, cur, limit); err != nil {
+				return err
+			}
+		}
+		switch ret {
+		case C.Z_OK, C.Z_STREAM_END:
+		case C.Z_BUF_ERROR:
+			return io.ErrUnexpectedEOF
+		default:
+			return zlibReturnCodeToError(ret)
+		}
+		if err := z.emit(c); err != nil {
+			return err
+		}
+		cur = int64(c.end_bit)
+		if ret == C.Z_STREAM_END {
+			z.pos = cur
+			z.out = z.outBuf
+			return z.endMember()
+		}
+	}
+	z.pos = cur
+	z.out = z.outBuf
+	return nil
+}
+
+// Read implements io.Reader.
+func (z *specReader) Read(out []byte) (int, error) {
+	for len(z.out) == 0 {
+		if z.err != nil {
+			return 0, z.err
+		}
+		if len(out) == 0 {
+			return 0, nil
+		}
+		switch {
+		case z.done:
+			z.err = io.EOF
+		case !z.inMember:
+			z.err = z.startMember()
+		default:
+			z.err = z.round()
+		}
+	}
+	n := copy(out, z.out)
+	z.out = z.out[n:]
+	return n, nil
+}
+
+// Close implements io.Closer.
+func (z *specReader) Close() error {
+	for i := range z.chunks {
+		C.zng_inflate_spec_free(&z.chunks[i])
+	}
+	z.chunks = nil
+	if z.err == io.EOF {
+		return nil
+	}
+	return z.err
+}
@@ -0,0 +1,109 @@
+// +build cgo
+
+package zlibng_test
+
+import (
+	"bytes"
+	"compress/gzip"
+	"io/ioutil"
+	"math/rand"
+	"testing"
+
+	"github.com/grailbio/testutil/assert"
+	"github.com/yasushi-saito/zlibng"
+)
+
+func gzipData(t *testing.T, level int, data []byte) []byte {
+	compressed := bytes.Buffer{}
+	gz, err := gzip.NewWriterLevel(&compressed, level)
+	assert.NoError(t, err)
+	_, err = gz.Write(data)
+	assert.NoError(t, err)
+	assert.NoError(t, gz.Close())
+	return compressed.Bytes()
+}
+
+func testSpeculativeInflate(t *testing.T, r *rand.Rand, compressed, data []byte, opts zlibng.Opts) {
+	for _, concurrency := range []int{1, 4, 7} {
+		opts.Concurrency = concurrency
+		zin, err := zlibng.NewParallelReader(bytes.NewReader(compressed), opts)
+		assert.NoError(t, err)
+		got, err := readAllRandomly(t, r, zin)
+		assert.NoError(t, err)
+		assert.True(t, bytes.Equal(got, data))
+		assert.NoError(t, zin.Close())
+	}
+}
+
+func TestSpeculativeInflateGzip(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	data := compressibleData(r, 6<<20)
+	for _, level := range []int{1, 6, 9} {
+		compressed := gzipData(t, level, data)
+		testSpeculativeInflate(t, r, compressed, data, zlibng.Opts{BlockSize: 128 << 10})
+	}
+}
+
+func TestSpeculativeInflateFlate(t *testing.T) {
+	r := rand.New(rand.NewSource(1))
+	data := compressibleData(r, 4<<20)
+	compressed := bytes.Buffer{}
+	zout, err := zlibng.NewWriter(&compressed, zlibng.Opts{Level: 5, WindowBits: zlibng.Flate})
+	assert.NoError(t, err)
+	_, err = zout.Write(data)
+	assert.NoError(t, err)
+	assert.NoError(t, zout.Close())
+	testSpeculativeInflate(t, r, compressed.Bytes(), data,
+		zlibng.Opts{WindowBits: zlibng.Flate, BlockSize: 100 << 10})
+}
+
+func TestSpeculativeInflateMixedBlocks(t *testing.T) {
+	// Stored blocks of incompressible data between compressible data, and
+	// multiple members.
+	r := rand.New(rand.NewSource(2))
+	var data, compressed []byte
+	for i := 0; i < 3; i++ {
+		part := compressibleData(r, 1<<20)
+		noise := make([]byte, 300<<10)
+		r.Read(noise)
+		part = append(part, noise...)
+		part = append(part, compressibleData(r, 1<<20)...)
+		data = append(data, part...)
+		compressed = append(compressed, gzipData(t, 6, part)...)
+	}
+	testSpeculativeInflate(t, r, compressed, data, zlibng.Opts{BlockSize: 64 << 10})
+}
+
+func TestSpeculativeInflateCorrupt(t *testing.T) {
+	r := rand.New(rand.NewSource(3))
+	data := compressibleData(r, 2<<20)
+	compressed := gzipData(t, 6, data)
+	opts := zlibng.Opts{Concurrency: 4, BlockSize: 64 << 10}
+
+	// Truncated input.
+	zin, err := zlibng.NewParallelReader(bytes.NewReader(compressed[:len(compressed)/2]), opts)
+	assert.NoError(t, err)
+	_, err = ioutil.ReadAll(zin)
+	assert.NE(t, err, nil)
+	assert.NE(t, zin.Close(), nil)
+
+	// Bad CRC.
+	corrupt := append([]byte{}, compressed...)
+	corrupt[len(corrupt)-8] ^= 1
+	zin, err = zlibng.NewParallelReader(bytes.NewReader(corrupt), opts)
+	assert.NoError(t, err)
+	_, err = ioutil.ReadAll(zin)
+	assert.NE(t, err, nil)
+	assert.NE(t, zin.Close(), nil)
+
+	// Corrupt deflate data.
+	corrupt = append([]byte{}, compressed...)
+	for i := len(corrupt) / 3; i < len(corrupt)/3+100; i++ {
+		corrupt[i] ^= 0x55
+	}
+	zin, err = zlibng.NewParallelReader(bytes.NewReader(corrupt), opts)
+	assert.NoError(t, err)
+	_, err = ioutil.ReadAll(zin)
+	assert.NE(t, err, nil)
+	assert.NE(t, zin.Close(), nil)
+}
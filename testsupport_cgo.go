@@ -0,0 +1,192 @@
+// +build cgo,amd64
+
+package zlibng
+
+// This file holds the cgo helpers of the tests, which cannot use cgo
+// themselves. export_test.go exports them to the tests. They reach zlib-ng
+// entry points that the package does not otherwise use, so they are kept out
+// of zstream.c.
+
+/*
+#include <stdlib.h>
+#include <string.h>
+#include "./zlib-ng.h"
+#include "./zstream.h"
+
+typedef struct {
+  unsigned char* out;
+  uint32_t left;
+} zs_back_out;
+
+static uint32_t zs_back_in(void* desc, const unsigned char** buf) {
+  // All of the input is in next_in, so there is nothing more to read.
+  (void)desc;
+  (void)buf;
+  return 0;
+}
+
+static int zs_back_write(void* desc, unsigned char* buf, uint32_t len) {
+  zs_back_out* o = (zs_back_out*)desc;
+  if (len > o->left) {
+    return 1;
+  }
+  memcpy(o->out, buf, len);
+  o->out += len;
+  o->left -= len;
+  return 0;
+}
+
+// zs_inflate_back decompresses the raw deflate stream in[0,in_bytes) into out
+// with inflateBack. On entry *out_bytes is the size of out; on return it is
+// the number of unused bytes in out. Returns Z_BUF_ERROR if the output does
+// not fit in out, and Z_DATA_ERROR if the input is truncated.
+static int zs_inflate_back(void* in, int in_bytes, void* out, int* out_bytes) {
+  zng_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  unsigned char* window = malloc(1U << MAX_WBITS);
+  if (window == NULL) {
+    return Z_MEM_ERROR;
+  }
+  int ret = zng_inflateBackInit(&zs, MAX_WBITS, window);
+  if (ret != Z_OK) {
+    free(window);
+    return ret;
+  }
+  zs_back_out o = {out, (uint32_t)*out_bytes};
+  zs.next_in = in;
+  zs.avail_in = in_bytes;
+  ret = zng_inflateBack(&zs, zs_back_in, NULL, zs_back_write, &o);
+  zng_inflateBackEnd(&zs);
+  free(window);
+  *out_bytes = o.left;
+  if (ret == Z_STREAM_END) {
+    return Z_OK;
+  }
+  if (ret == Z_BUF_ERROR && zs.next_in == NULL) {
+    // The input is truncated.
+    return Z_DATA_ERROR;
+  }
+  return ret;
+}
+
+// zs_inflate_copy makes dest a copy of the stream source, including its window.
+// dest must be freed with zs_inflate_end independently of source.
+static int zs_inflate_copy(char* dest, char* source) {
+  return zng_inflateCopy((zng_stream*)dest, (zng_stream*)source);
+}
+
+// zs_deflate_sync_flush compresses in[0,in_bytes) into out as a raw deflate
+// stream, with a Z_SYNC_FLUSH after every flush_bytes of input.
+// *out_bytes is as in zs_inflate_back. Returns Z_BUF_ERROR if the output does
+// not fit in out.
+static int zs_deflate_sync_flush(void* in, int in_bytes, void* out,
+                                 int* out_bytes, int level, int flush_bytes) {
+  zng_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  int ret = zng_deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8,
+                             Z_DEFAULT_STRATEGY);
+  if (ret != Z_OK) {
+    return ret;
+  }
+  zs.next_in = in;
+  zs.next_out = out;
+  zs.avail_out = *out_bytes;
+  int left = in_bytes;
+  do {
+    int n = left < flush_bytes ? left : flush_bytes;
+    zs.avail_in = n;
+    left -= n;
+    ret = zng_deflate(&zs, left == 0 ? Z_FINISH : Z_SYNC_FLUSH);
+  } while (ret == Z_OK && zs.avail_in == 0 && left > 0);
+  *out_bytes = zs.avail_out;
+  zng_deflateEnd(&zs);
+  if (ret == Z_STREAM_END) {
+    return Z_OK;
+  }
+  return ret == Z_OK ? Z_BUF_ERROR : ret;
+}
+*/
+import "C"
+
+import (
+	"io"
+	"math"
+	"unsafe"
+)
+
+// inflateBack decompresses the raw deflate stream src into dst with
+// inflateBack, and returns the number of bytes written. inflateBack is
+// otherwise unreachable from Go.
+func inflateBack(dst, src []byte) (int, error) {
+	if len(src) > math.MaxInt32 || len(dst) > math.MaxInt32 {
+		return 0, errTooLarge
+	}
+	var out unsafe.Pointer
+	if len(dst) > 0 {
+		out = unsafe.Pointer(&dst[0])
+	}
+	outLen := C.int(len(dst))
+	ret := C.zs_inflate_back(bufPtr(src), C.int(len(src)), out, &outLen)
+	if ret == C.Z_BUF_ERROR {
+		return 0, io.ErrShortBuffer
+	}
+	if ret != 0 {
+		return 0, zlibReturnCodeToError(ret)
+	}
+	return len(dst) - int(outLen), nil
+}
+
+// inflateCopyAt decompresses src into dst. It feeds src[:at] to one stream,
+// and src[at:] to a copy of it made with inflateCopy, after freeing the
+// original. dst must be large enough, and at must be in (0, len(src)).
+func inflateCopyAt(dst, src []byte, at int) (int, error) {
+	var zs, clone zstream
+	var getHeaderStatus C.int
+	if ec := C.zs_inflate_init(&zs[0], 32+15, 0, nil, &getHeaderStatus); ec != 0 {
+		return 0, zlibReturnCodeToError(ec)
+	}
+	inflate := func(zs *zstream, dst, src []byte) (int, error) {
+		outLen := C.int(len(dst))
+		var inConsumed C.int
+		ret := C.zs_inflate(&zs[0], unsafe.Pointer(&src[0]), C.int(len(src)), unsafe.Pointer(&dst[0]), &outLen, &inConsumed)
+		if ret != C.Z_OK && ret != C.Z_STREAM_END {
+			return 0, zlibReturnCodeToError(ret)
+		}
+		if inConsumed == 0 {
+			return 0, io.ErrShortBuffer
+		}
+		return len(dst) - int(outLen), nil
+	}
+	n, err := inflate(&zs, dst, src[:at])
+	if err == nil {
+		if ec := C.zs_inflate_copy(&clone[0], &zs[0]); ec != 0 {
+			err = zlibReturnCodeToError(ec)
+		}
+	}
+	C.zs_inflate_end(&zs[0])
+	if err != nil {
+		return 0, err
+	}
+	defer C.zs_inflate_end(&clone[0])
+	m, err := inflate(&clone, dst[n:], src[at:])
+	return n + m, err
+}
+
+// deflateSyncFlush compresses src into dst as a raw deflate stream at level,
+// with a Z_SYNC_FLUSH after every flushBytes of src, and returns the number of
+// bytes written. Each flush ends a deflate block, so the blocks are small.
+func deflateSyncFlush(dst, src []byte, level, flushBytes int) (int, error) {
+	if len(src) > math.MaxInt32 || len(dst) > math.MaxInt32 {
+		return 0, errTooLarge
+	}
+	outLen := C.int(len(dst))
+	ret := C.zs_deflate_sync_flush(bufPtr(src), C.int(len(src)), bufPtr(dst), &outLen,
+		C.int(level), C.int(flushBytes))
+	if ret == C.Z_BUF_ERROR {
+		return 0, io.ErrShortBuffer
+	}
+	if ret != 0 {
+		return 0, zlibReturnCodeToError(ret)
+	}
+	return len(dst) - int(outLen), nil
+}
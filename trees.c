@@ -57,6 +57,12 @@
 #define REPZ_11_138  18
 /* repeat a zero length 11-138 times  (7 bits of repeat count) */
 
+#define SPLIT_SYMBOLS 1024
+/* symbols between two checks for a block split */
+
+#define SPLIT_TREE_BITS 4
+/* estimated bits of the trees of a block for each code it uses */
+
 static const int extra_lbits[LENGTH_CODES] /* extra bits for each length code */
     = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
 
@@ -135,10 +141,12 @@ static const static_tree_desc  static_bl_desc =
 
 static void tr_static_init   (void);
 static void init_block       (deflate_state *s);
-static void pqdownheap       (deflate_state *s, ct_data *tree, int k);
-static void gen_bitlen       (deflate_state *s, tree_desc *desc);
+static void sort_by_freq     (const ct_data *tree, int *sym, int *tmp, int n);
+static void gen_lengths      (int *A, int n);
+static void gen_bitlen       (deflate_state *s, tree_desc *desc, const int *sym, int n);
 static void gen_codes        (ct_data *tree, int max_code, uint16_t *bl_count);
 static void build_tree       (deflate_state *s, tree_desc *desc);
+static void tree_costs       (const ct_data *tree, const static_tree_desc *desc, unsigned char *cost);
 static void scan_tree        (deflate_state *s, ct_data *tree, int max_code);
 static void send_tree        (deflate_state *s, ct_data *tree, int max_code);
 static int  build_bl_tree    (deflate_state *s);
@@ -337,153 +345,190 @@ static void init_block(deflate_state *s) {
 
     s->dyn_ltree[END_BLOCK].Freq = 1;
     s->opt_len = s->static_len = 0L;
-    s->sym_next = s->matches = 0;
-}
-
-#define SMALLEST 1
-/* Index within the heap array of least frequent node in the Huffman tree */
+    s->sym_start = s->sym_next = s->matches = 0;
 
+    s->sym_check = s->sym_end;
+    if (s->block_split) {
+        memset(s->split_freq, 0, sizeof(s->split_freq));
+        s->split_sym = 0;
+        s->sym_check = s->sym_end > 3*SPLIT_SYMBOLS ? 3*SPLIT_SYMBOLS : s->sym_end;
+    }
+}
 
 /* ===========================================================================
- * Remove the smallest element from the heap and recreate the heap with
- * one less element. Updates heap and heap_len.
+ * Sort the n symbols in sym by increasing frequency. Short lists use an
+ * insertion sort, longer ones a radix sort on the bytes of the
+ * frequencies; both are stable. tmp has room for n entries.
  */
-#define pqremove(s, tree, top) \
-{\
-    top = s->heap[SMALLEST]; \
-    s->heap[SMALLEST] = s->heap[s->heap_len--]; \
-    pqdownheap(s, tree, SMALLEST); \
+static void sort_by_freq(const ct_data *tree, int *sym, int *tmp, int n) {
+    unsigned int count[256];
+    unsigned int max_freq = 0;
+    int i, j, shift;
+
+    if (n <= 32) {
+        for (i = 1; i < n; i++) {
+            int v = sym[i];
+            uint32_t f = tree[v].Freq;
+            for (j = i; j > 0 && tree[sym[j-1]].Freq > f; j--)
+                sym[j] = sym[j-1];
+            sym[j] = v;
+        }
+        return;
+    }
+
+    for (i = 0; i < n; i++)
+        max_freq |= tree[sym[i]].Freq;
+    for (shift = 0; shift < 32 && (max_freq >> shift) != 0; shift += 8) {
+        unsigned int pos = 0;
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < n; i++)
+            count[(tree[sym[i]].Freq >> shift) & 0xff]++;
+        for (i = 0; i < 256; i++) {
+            unsigned int c = count[i];
+            count[i] = pos;
+            pos += c;
+        }
+        for (i = 0; i < n; i++)
+            tmp[count[(tree[sym[i]].Freq >> shift) & 0xff]++] = sym[i];
+        memcpy(sym, tmp, n * sizeof(int));
+    }
 }
 
 /* ===========================================================================
- * Compares to subtrees, using the tree depth as tie breaker when
- * the subtrees have equal frequency. This minimizes the worst case length.
+ * Compute the optimal code lengths in place, following "In-Place Calculation
+ * of Minimum-Redundancy Codes", Moffat and Katajainen, 1995.
+ * IN assertion: A[0..n-1] holds n >= 2 weights in increasing order.
+ * OUT assertion: A[i] is the code length of the i-th weight. The lengths
+ *     decrease with i, and they are not limited.
  */
-#define smaller(tree, n, m, depth) \
-    (tree[n].Freq < tree[m].Freq || \
-    (tree[n].Freq == tree[m].Freq && depth[n] <= depth[m]))
+static void gen_lengths(int *A, int n) {
+    int root, leaf, next, avbl, used, dpth;
 
-/* ===========================================================================
- * Restore the heap property by moving down the tree starting at node k,
- * exchanging a node with the smallest of its two sons if necessary, stopping
- * when the heap property is re-established (each father smaller than its
- * two sons).
- */
-static void pqdownheap(deflate_state *s, ct_data *tree, int k) {
-    /* tree: the tree to restore */
-    /* k: node to move down */
-    int v = s->heap[k];
-    int j = k << 1;  /* left son of k */
-    while (j <= s->heap_len) {
-        /* Set j to the smallest of the two sons: */
-        if (j < s->heap_len && smaller(tree, s->heap[j+1], s->heap[j], s->depth)) {
-            j++;
+    /* Combine the two smallest of the leaves and the internal nodes n-1
+     * times. Internal nodes replace the leaves they consume, and store the
+     * index of their parent once they are consumed themselves. On ties,
+     * leaves come first, which keeps the tree shallow.
+     */
+    A[0] += A[1];
+    root = 0;
+    leaf = 2;
+    for (next = 1; next < n - 1; next++) {
+        if (leaf >= n || A[root] < A[leaf]) {
+            A[next] = A[root];
+            A[root++] = next;
+        } else {
+            A[next] = A[leaf++];
         }
-        /* Exit if v is smaller than both sons */
-        if (smaller(tree, v, s->heap[j], s->depth))
-            break;
+        if (leaf >= n || (root < next && A[root] < A[leaf])) {
+            A[next] += A[root];
+            A[root++] = next;
+        } else {
+            A[next] += A[leaf++];
+        }
+    }
 
-        /* Exchange v with the smallest son */
-        s->heap[k] = s->heap[j];
-        k = j;
+    /* Turn the parent indices into depths, from the root down. */
+    A[n - 2] = 0;
+    for (next = n - 3; next >= 0; next--)
+        A[next] = A[A[next]] + 1;
 
-        /* And continue down the tree, setting j to the left son of k */
-        j <<= 1;
+    /* Each level has twice as many nodes as the internal nodes of the level
+     * above; those that are not internal are leaves.
+     */
+    avbl = 1;
+    used = dpth = 0;
+    root = n - 2;
+    next = n - 1;
+    while (avbl > 0) {
+        while (root >= 0 && A[root] == dpth) {
+            used++;
+            root--;
+        }
+        while (avbl > used) {
+            A[next--] = dpth;
+            avbl--;
+        }
+        avbl = 2 * used;
+        dpth++;
+        used = 0;
     }
-    s->heap[k] = v;
 }
 
 /* ===========================================================================
- * Compute the optimal bit lengths for a tree and update the total bit length
- * for the current block.
- * IN assertion: the fields freq and dad are set, heap[heap_max] and
- *    above are the tree nodes sorted by increasing frequency.
- * OUT assertions: the field len is set to the optimal bit length, the
- *     array bl_count contains the frequencies for each bit length.
- *     The length opt_len is updated; static_len is also updated if stree is
- *     not null.
+ * Compute the bit lengths for a tree, limited to max_length, and update the
+ * total bit length for the current block.
+ * IN assertion: sym[0..n-1] are the n >= 2 leaves sorted by increasing
+ *     frequency.
+ * OUT assertions: the field len is set to the bit length, the array bl_count
+ *     contains the frequencies for each bit length. The length opt_len is
+ *     updated; static_len is also updated if stree is not null.
  */
-static void gen_bitlen(deflate_state *s, tree_desc *desc) {
+static void gen_bitlen(deflate_state *s, tree_desc *desc, const int *sym, int n) {
     /* desc: the tree descriptor */
     ct_data *tree           = desc->dyn_tree;
-    int max_code            = desc->max_code;
     const ct_data *stree    = desc->stat_desc->static_tree;
     const int *extra        = desc->stat_desc->extra_bits;
     int base                = desc->stat_desc->extra_base;
     unsigned int max_length = desc->stat_desc->max_length;
-    int h;              /* heap index */
-    int n, m;           /* iterate over the tree elements */
+    int len[L_CODES];   /* weights, then code lengths, by increasing frequency */
+    int i, m;           /* iterate over the leaves */
     unsigned int bits;  /* bit length */
     int xbits;          /* extra bits */
-    uint16_t f;         /* frequency */
-    int overflow = 0;   /* number of elements with bit length too large */
+    uint32_t f;         /* frequency */
+    int overflow = 0;   /* whether some length exceeds max_length */
+
+    for (i = 0; i < n; i++)
+        len[i] = tree[sym[i]].Freq;
+    gen_lengths(len, n);
 
     for (bits = 0; bits <= MAX_BITS; bits++)
         s->bl_count[bits] = 0;
-
-    /* In a first pass, compute the optimal bit lengths (which may
-     * overflow in the case of the bit length tree).
-     */
-    tree[s->heap[s->heap_max]].Len = 0; /* root of the heap */
-
-    for (h = s->heap_max+1; h < HEAP_SIZE; h++) {
-        n = s->heap[h];
-        bits = tree[tree[n].Dad].Len + 1;
+    for (i = 0; i < n; i++) {
+        bits = (unsigned int)len[i];
         if (bits > max_length)
-            bits = max_length, overflow++;
-        tree[n].Len = (uint16_t)bits;
-        /* We overwrite tree[n].Dad which is no longer needed */
-
-        if (n > max_code) /* not a leaf node */
-            continue;
-
+            bits = max_length, overflow = 1;
         s->bl_count[bits]++;
-        xbits = 0;
-        if (n >= base)
-            xbits = extra[n-base];
-        f = tree[n].Freq;
-        s->opt_len += (unsigned long)f * (unsigned int)(bits + xbits);
-        if (stree)
-            s->static_len += (unsigned long)f * (unsigned int)(stree[n].Len + xbits);
     }
-    if (overflow == 0)
-        return;
 
-    Trace((stderr, "\nbit length overflow\n"));
-    /* This happens for example on obj2 and pic of the Calgary corpus */
+    if (overflow) {
+        /* Kraft sum of the clamped lengths, in units of 2^-max_length. */
+        unsigned long kraft = 0;
 
-    /* Find the first bit length which could increase: */
-    do {
-        bits = max_length-1;
-        while (s->bl_count[bits] == 0)
-            bits--;
-        s->bl_count[bits]--;      /* move one leaf down the tree */
-        s->bl_count[bits+1] += 2; /* move one overflow item as its brother */
-        s->bl_count[max_length]--;
-        /* The brother of the overflow item also moves one step up,
-         * but this does not affect bl_count[max_length]
+        Trace((stderr, "\nbit length overflow\n"));
+        /* This happens for example on obj2 and pic of the Calgary corpus */
+        for (bits = 1; bits <= max_length; bits++)
+            kraft += (unsigned long)s->bl_count[bits] << (max_length - bits);
+
+        /* Each step moves one leaf down the tree, and one max_length leaf
+         * next to it as its brother, lowering the sum by one.
          */
-        overflow -= 2;
-    } while (overflow > 0);
+        while (kraft > (1UL << max_length)) {
+            bits = max_length-1;
+            while (s->bl_count[bits] == 0)
+                bits--;
+            s->bl_count[bits]--;
+            s->bl_count[bits+1] += 2;
+            s->bl_count[max_length]--;
+            kraft--;
+        }
+    }
 
-    /* Now recompute all bit lengths, scanning in increasing frequency.
-     * h is still equal to HEAP_SIZE. (It is simpler to reconstruct all
-     * lengths instead of fixing only the wrong ones. This idea is taken
-     * from 'ar' written by Haruhiko Okumura.)
+    /* Assign the lengths, the longest to the least frequent leaves. The
+     * optimal lengths already decrease with i, so this only changes them if
+     * they had to be limited.
      */
+    i = 0;
     for (bits = max_length; bits != 0; bits--) {
-        n = s->bl_count[bits];
-        while (n != 0) {
-            m = s->heap[--h];
-            if (m > max_code)
-                continue;
-            if (tree[m].Len != bits) {
-                Trace((stderr, "code %d bits %d->%u\n", m, tree[m].Len, bits));
-                s->opt_len += (unsigned long)(bits * tree[m].Freq);
-                s->opt_len -= (unsigned long)(tree[m].Len * tree[m].Freq);
-                tree[m].Len = (uint16_t)bits;
-            }
-            n--;
+        for (m = s->bl_count[bits]; m != 0; m--) {
+            int node = sym[i++];
+            tree[node].Len = (uint16_t)bits;
+            xbits = 0;
+            if (node >= base)
+                xbits = extra[node-base];
+            f = tree[node].Freq;
+            s->opt_len += (unsigned long)f * (unsigned int)(bits + xbits);
+            if (stree)
+                s->static_len += (unsigned long)f * (unsigned int)(stree[node].Len + xbits);
         }
     }
 }
@@ -543,20 +588,16 @@ static void build_tree(deflate_state *s, tree_desc *desc) {
     ct_data *tree         = desc->dyn_tree;
     const ct_data *stree  = desc->stat_desc->static_tree;
     int elems             = desc->stat_desc->elems;
-    int n, m;          /* iterate over heap elements */
+    int sym[L_CODES];  /* leaves, sorted by increasing frequency */
+    int tmp[L_CODES];  /* scratch space for the sort */
+    int n;             /* iterates over tree elements */
+    int nsym = 0;      /* number of leaves */
     int max_code = -1; /* largest code with non zero frequency */
-    int node;          /* new node being created */
-
-    /* Construct the initial heap, with least frequent element in
-     * heap[SMALLEST]. The sons of heap[n] are heap[2*n] and heap[2*n+1].
-     * heap[0] is not used.
-     */
-    s->heap_len = 0, s->heap_max = HEAP_SIZE;
+    int node;          /* forced leaf */
 
     for (n = 0; n < elems; n++) {
         if (tree[n].Freq != 0) {
-            s->heap[++(s->heap_len)] = max_code = n;
-            s->depth[n] = 0;
+            sym[nsym++] = max_code = n;
         } else {
             tree[n].Len = 0;
         }
@@ -567,10 +608,9 @@ static void build_tree(deflate_state *s, tree_desc *desc) {
      * possible code. So to avoid special checks later on we force at least
      * two codes of non zero frequency.
      */
-    while (s->heap_len < 2) {
-        node = s->heap[++(s->heap_len)] = (max_code < 2 ? ++max_code : 0);
+    while (nsym < 2) {
+        node = sym[nsym++] = (max_code < 2 ? ++max_code : 0);
         tree[node].Freq = 1;
-        s->depth[node] = 0;
         s->opt_len--;
         if (stree)
             s->static_len -= stree[node].Len;
@@ -578,48 +618,75 @@ static void build_tree(deflate_state *s, tree_desc *desc) {
     }
     desc->max_code = max_code;
 
-    /* The elements heap[heap_len/2+1 .. heap_len] are leaves of the tree,
-     * establish sub-heaps of increasing lengths:
-     */
-    for (n = s->heap_len/2; n >= 1; n--)
-        pqdownheap(s, tree, n);
+    sort_by_freq(tree, sym, tmp, nsym);
 
-    /* Construct the Huffman tree by repeatedly combining the least two
-     * frequent nodes.
-     */
-    node = elems;              /* next internal node of the tree */
-    do {
-        pqremove(s, tree, n);  /* n = node of least frequency */
-        m = s->heap[SMALLEST]; /* m = node of next least frequency */
-
-        s->heap[--(s->heap_max)] = n; /* keep the nodes sorted by frequency */
-        s->heap[--(s->heap_max)] = m;
-
-        /* Create a new node father of n and m */
-        tree[node].Freq = tree[n].Freq + tree[m].Freq;
-        s->depth[node] = (unsigned char)((s->depth[n] >= s->depth[m] ?
-                                          s->depth[n] : s->depth[m]) + 1);
-        tree[n].Dad = tree[m].Dad = (uint16_t)node;
-#ifdef DUMP_BL_TREE
-        if (tree == s->bl_tree) {
-            fprintf(stderr, "\nnode %d(%d), sons %d(%d) %d(%d)",
-                    node, tree[node].Freq, n, tree[n].Freq, m, tree[m].Freq);
+    /* Compute the bit lengths of the leaves. */
+    gen_bitlen(s, (tree_desc *)desc, sym, nsym);
+
+    /* The field len is now set, we can generate the bit codes */
+    gen_codes((ct_data *)tree, max_code, s->bl_count);
+}
+
+/* ===========================================================================
+ * Estimate the cost in bits of each code of a tree from its frequencies, as
+ * the optimal code lengths limited to max_length. Codes of zero frequency
+ * cost one bit more than the longest code. If tree is NULL or has fewer than
+ * two codes of non zero frequency, the lengths of the static tree are used.
+ */
+static void tree_costs(const ct_data *tree, const static_tree_desc *desc, unsigned char *cost) {
+    int sym[L_CODES];   /* leaves, sorted by increasing frequency */
+    int tmp[L_CODES];   /* scratch space for the sort */
+    int len[L_CODES];   /* code lengths, by increasing frequency */
+    int elems = desc->elems;
+    int max_length = (int)desc->max_length;
+    int n, nsym = 0;
+    int unseen;
+
+    if (tree != NULL) {
+        for (n = 0; n < elems; n++) {
+            if (tree[n].Freq != 0)
+                sym[nsym++] = n;
         }
-#endif
-        /* and insert the new node in the heap */
-        s->heap[SMALLEST] = node++;
-        pqdownheap(s, tree, SMALLEST);
-    } while (s->heap_len >= 2);
+    }
+    if (nsym < 2) {
+        for (n = 0; n < elems; n++)
+            cost[n] = (unsigned char)desc->static_tree[n].Len;
+        return;
+    }
 
-    s->heap[--(s->heap_max)] = s->heap[SMALLEST];
+    sort_by_freq(tree, sym, tmp, nsym);
+    for (n = 0; n < nsym; n++)
+        len[n] = tree[sym[n]].Freq;
+    gen_lengths(len, nsym);
 
-    /* At this point, the fields freq and dad are set. We can now
-     * generate the bit lengths.
-     */
-    gen_bitlen(s, (tree_desc *)desc);
+    unseen = len[0] < max_length ? len[0] + 1 : max_length;
+    for (n = 0; n < elems; n++)
+        cost[n] = (unsigned char)unseen;
+    for (n = 0; n < nsym; n++)
+        cost[sym[n]] = (unsigned char)(len[n] < max_length ? len[n] : max_length);
+}
 
-    /* The field len is now set, we can generate the bit codes */
-    gen_codes((ct_data *)tree, max_code, s->bl_count);
+/* ===========================================================================
+ * Estimate the cost in bits of each literal, match length and distance code,
+ * including the extra bits, if the current block were sent with trees built
+ * from the frequencies in ltree and dtree. ltree and dtree may be NULL for the
+ * costs with the static trees. len_cost is indexed by length - MIN_MATCH.
+ */
+void ZLIB_INTERNAL _zng_tr_costs(const ct_data *ltree, const ct_data *dtree, unsigned char *lit_cost,
+                                 unsigned char *len_cost, unsigned char *dist_cost) {
+    unsigned char lcost[L_CODES];
+    int n, code;
+
+    tree_costs(ltree, &static_l_desc, lcost);
+    tree_costs(dtree, &static_d_desc, dist_cost);
+
+    memcpy(lit_cost, lcost, LITERALS);
+    for (n = 0; n < MAX_MATCH-MIN_MATCH+1; n++) {
+        code = _zng_length_code[n];
+        len_cost[n] = (unsigned char)(lcost[code+LITERALS+1] + extra_lbits[code]);
+    }
+    for (code = 0; code < D_CODES; code++)
+        dist_cost[code] = (unsigned char)(dist_cost[code] + extra_dbits[code]);
 }
 
 /* ===========================================================================
@@ -948,7 +1015,156 @@ int ZLIB_INTERNAL _zng_tr_tally(deflate_state *s, unsigned dist, unsigned lc) {
         s->dyn_ltree[_zng_length_code[lc]+LITERALS+1].Freq++;
         s->dyn_dtree[d_code(dist)].Freq++;
     }
-    return (s->sym_next == s->sym_end);
+    return (s->sym_next == s->sym_check && _zng_tr_block_end(s));
+}
+
+/* ===========================================================================
+ * Block splitting. Every SPLIT_SYMBOLS symbols, the cost of the current block
+ * is estimated from the entropy of its literal/length and of its distance
+ * frequencies. If the block would take fewer bits with the symbols since the
+ * last check in a block of their own, trees included, the symbols before the
+ * last check are sent as a block right away. The others stay in sym_buf, from
+ * sym_start on, and begin the next block.
+ *
+ * This writes to pending_buf in the middle of a block, but the block was
+ * started with an empty pending_buf, since deflate() flushes it before calling
+ * the compression functions. The symbols sent so far were read from sym_buf
+ * ahead of the bytes written, and the next ones are further ahead, so the
+ * reasoning at the top of deflate.c on the overlay of sym_buf and pending_buf
+ * still holds for the two blocks together.
+ */
+/* log2_frac[i] is 65536*log2(1 + i/32) */
+static const uint32_t log2_frac[33] = {
+    0, 2909, 5732, 8473, 11136, 13727, 16248, 18704, 21098, 23433, 25711,
+    27936, 30109, 32234, 34312, 36346, 38336, 40286, 42196, 44068, 45904,
+    47705, 49472, 51207, 52911, 54584, 56229, 57845, 59434, 60997, 62534,
+    64047, 65536
+};
+
+/* Return 65536*log2(x) for x >= 1, within 1/4096 bit. The error is multiplied
+ * by the number of symbols of a block, so the fraction is interpolated.
+ */
+static uint32_t log2_fixed(uint32_t x) {
+    uint32_t m, e, i, r;
+
+#ifdef __GNUC__
+    e = 31 - (uint32_t)__builtin_clz(x);
+#else
+    m = x;
+    e = 0;
+    if (m >= 1U << 16) { m >>= 16; e += 16; }
+    if (m >= 1U << 8)  { m >>= 8;  e += 8; }
+    if (m >= 1U << 4)  { m >>= 4;  e += 4; }
+    if (m >= 1U << 2)  { m >>= 2;  e += 2; }
+    if (m >= 1U << 1)  { e += 1; }
+#endif
+    /* the 15 bits after the leading one of x */
+    m = (e >= 15 ? x >> (e - 15) : x << (15 - e)) & 0x7fff;
+    i = m >> 10;
+    r = m & 1023;
+    return (e << 16) + log2_frac[i] + ((log2_frac[i+1] - log2_frac[i]) * r >> 10);
+}
+
+/* Add to *whole the estimated bits, times 65536, to code the n frequencies of
+ * tree with a Huffman code, and to *since those of the frequencies since the
+ * last check, which are stored in last. prev holds the frequencies at the last
+ * check, and is updated. The number of codes used since the last check is
+ * added to *used.
+ */
+static void split_costs(const ct_data *tree, uint32_t *prev, uint32_t *last, int n,
+                        uint64_t *whole, uint64_t *since, unsigned int *used) {
+    uint64_t total = 0, cost = 0, last_total = 0, last_cost = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        uint32_t f = tree[i].Freq;
+        uint32_t g = f - prev[i];
+        uint64_t c;
+
+        prev[i] = f;
+        last[i] = g;
+        if (f == 0)
+            continue;
+        c = (uint64_t)f * log2_fixed(f);
+        total += f;
+        cost += c;
+        if (g != 0) {
+            last_total += g;
+            last_cost += g == f ? c : (uint64_t)g * log2_fixed(g);
+            (*used)++;
+        }
+    }
+    if (total != 0)
+        *whole += total * log2_fixed((uint32_t)total) - cost;
+    if (last_total != 0)
+        *since += last_total * log2_fixed((uint32_t)last_total) - last_cost;
+}
+
+/* ===========================================================================
+ * Send the symbols of the current block up to split_sym as a block. The
+ * symbols after split_sym, with the frequencies in last, begin a new block.
+ */
+static void split_block(deflate_state *s, const uint32_t *last) {
+    unsigned int sym_next = s->sym_next;
+    unsigned int split_sym = s->split_sym;
+    unsigned long stored_len = 0;
+    unsigned int sx;
+    int n;
+
+    for (sx = s->sym_start; sx < split_sym; sx += 3) {
+        if (s->sym_buf[sx] == 0 && s->sym_buf[sx+1] == 0)
+            stored_len++;
+        else
+            stored_len += (unsigned char)s->sym_buf[sx+2] + MIN_MATCH;
+    }
+    for (n = 0; n < L_CODES; n++)
+        s->dyn_ltree[n].Freq -= last[n];
+    for (n = 0; n < D_CODES; n++)
+        s->dyn_dtree[n].Freq -= last[L_CODES+n];
+    s->dyn_ltree[END_BLOCK].Freq = 1;
+    s->sym_next = split_sym;
+    Tracev((stderr, "\n[split after %u symbols]", (split_sym - s->sym_start) / 3));
+    _zng_tr_flush_block(s, s->block_start >= 0L ? (char *)&s->window[(unsigned)s->block_start] : NULL, stored_len, 0);
+    s->block_start += (long)stored_len;
+
+    for (n = 0; n < L_CODES; n++)
+        s->dyn_ltree[n].Freq = last[n];
+    for (n = 0; n < D_CODES; n++)
+        s->dyn_dtree[n].Freq = last[L_CODES+n];
+    s->dyn_ltree[END_BLOCK].Freq = 1;
+    s->sym_start = split_sym;
+    s->sym_next = sym_next;
+}
+
+/* ===========================================================================
+ * Called by the tally functions when sym_next reaches sym_check. Return true
+ * if the symbol buffer is full, and the current block must end. Otherwise,
+ * see whether the block is split at its last check.
+ */
+int ZLIB_INTERNAL _zng_tr_block_end(deflate_state *s) {
+    uint32_t last[L_CODES+D_CODES];   /* frequencies since the last check */
+    uint64_t whole = 0, since = 0;
+    unsigned int used = 0;            /* codes used since the last check */
+
+    if (s->sym_next == s->sym_end)
+        return 1;
+    Assert(s->block_split, "checking a block without splitting");
+
+    split_costs(s->dyn_ltree, s->split_freq, last, L_CODES, &whole, &since, &used);
+    split_costs(s->dyn_dtree, s->split_freq+L_CODES, last+L_CODES, D_CODES, &whole, &since, &used);
+
+    if (s->split_sym != s->sym_start &&
+        s->split_bits + since + ((uint64_t)used * SPLIT_TREE_BITS << 16) < whole) {
+        split_block(s, last);
+        memcpy(s->split_freq, last, sizeof(last));
+        s->split_freq[END_BLOCK] = 1;
+        whole = since;
+    }
+
+    s->split_bits = whole;
+    s->split_sym = s->sym_next;
+    s->sym_check = s->sym_end - s->sym_next > 3*SPLIT_SYMBOLS ? s->sym_next + 3*SPLIT_SYMBOLS : s->sym_end;
+    return 0;
 }
 
 /* ===========================================================================
@@ -959,11 +1175,11 @@ static void compress_block(deflate_state *s, const ct_data *ltree, const ct_data
     /* dtree: distance tree */
     unsigned dist;      /* distance of matched string */
     int lc;             /* match length or unmatched char (if dist == 0) */
-    unsigned sx = 0;    /* running index in sym_buf */
+    unsigned sx = s->sym_start; /* running index in sym_buf */
     int code;           /* the code to send */
     int extra;          /* number of extra bits to send */
 
-    if (s->sym_next != 0) {
+    if (s->sym_next != sx) {
         do {
             dist = s->sym_buf[sx++] & 0xff;
             dist += (unsigned)(s->sym_buf[sx++] & 0xff) << 8;
@@ -1059,11 +1275,17 @@ static unsigned bi_reverse(unsigned code, int len) {
  * Flush the bit buffer, keeping at most 7 bits in it.
  */
 static void bi_flush(deflate_state *s) {
-    if (s->bi_valid == 16) {
-        put_short(s, s->bi_buf);
-        s->bi_buf = 0;
-        s->bi_valid = 0;
-    } else if (s->bi_valid >= 8) {
+    if (s->bi_valid >= 32) {
+        put_uint32(s, (uint32_t)s->bi_buf);
+        s->bi_buf >>= 32;
+        s->bi_valid -= 32;
+    }
+    if (s->bi_valid >= 16) {
+        put_short(s, (uint16_t)s->bi_buf);
+        s->bi_buf >>= 16;
+        s->bi_valid -= 16;
+    }
+    if (s->bi_valid >= 8) {
         put_byte(s, (unsigned char)s->bi_buf);
         s->bi_buf >>= 8;
         s->bi_valid -= 8;
@@ -1074,10 +1296,21 @@ static void bi_flush(deflate_state *s) {
  * Flush the bit buffer and align the output on a byte boundary
  */
 ZLIB_INTERNAL void zng_bi_windup(deflate_state *s) {
-    if (s->bi_valid > 8) {
-        put_short(s, s->bi_buf);
-    } else if (s->bi_valid > 0) {
-        put_byte(s, (unsigned char)s->bi_buf);
+    if (s->bi_valid > 56) {
+        put_uint64(s, s->bi_buf);
+    } else {
+        if (s->bi_valid > 24) {
+            put_uint32(s, (uint32_t)s->bi_buf);
+            s->bi_buf >>= 32;
+            s->bi_valid -= 32;
+        }
+        if (s->bi_valid > 8) {
+            put_short(s, (uint16_t)s->bi_buf);
+            s->bi_buf >>= 16;
+            s->bi_valid -= 16;
+        }
+        if (s->bi_valid > 0)
+            put_byte(s, (unsigned char)s->bi_buf);
     }
     s->bi_buf = 0;
     s->bi_valid = 0;
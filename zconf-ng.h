@@ -46,6 +46,8 @@
  the default memory requirements from 256K to 128K, compile with
      make CFLAGS="-O -DMAX_WBITS=14 -DMAX_MEM_LEVEL=7"
  Of course this will generally degrade compression (there's no free lunch).
+ Compiling with -DDEFLATE_POS32 doubles the size of the hash tables, see
+ deflate.h, that is 64K more for windowBits=15 and 64K more for memLevel=8.
 
    The memory requirements for inflate are (in bytes) 1 << windowBits
  that is, 32K for windowBits=15 (default value) plus about 7 kilobytes
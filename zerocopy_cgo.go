@@ -0,0 +1,147 @@
+// +build cgo,amd64
+
+package zlibng
+
+/*
+#include "./zlib-ng.h"
+#include "./zstream.h"
+*/
+import "C"
+
+import (
+	"io"
+	"unsafe"
+)
+
+// CompressInto compresses src into dst as one complete member, and returns the
+// number of bytes written to dst. It returns io.ErrShortBuffer if dst is too
+// small; a dst of CompressBound(len(src)) bytes always suffices. There can be at
+// most one options arg. Opts.Buffer, Opts.BGZF, Opts.SlabAlloc and the
+// parallel-writer fields are ignored.
+func CompressInto(dst, src []byte, opts ...Opts) (int, error) {
+	opt, err := getOpts(opts...)
+	if err != nil {
+		return 0, err
+	}
+	return compressInto(dst, src, opt)
+}
+
+// DecompressInto decompresses src, which holds one or more complete members,
+// into dst, and returns the number of bytes written to dst. It returns
+// io.ErrShortBuffer if dst is too small. There can be at most one options arg;
+// only Opts.WindowBits is used.
+func DecompressInto(dst, src []byte, opts ...Opts) (int, error) {
+	opt, err := getOpts(opts...)
+	if err != nil {
+		return 0, err
+	}
+	return decompressInto(dst, src, opt.WindowBits)
+}
+
+// WriteTo implements io.WriterTo. If the underlying reader implements
+// io.WriterTo, as bytes.Reader and bytes.Buffer do, the compressed data is
+// passed to inflate as is, without being copied to the input buffer.
+func (z *Reader) WriteTo(w io.Writer) (int64, error) {
+	if z.err != nil {
+		if z.err == io.EOF {
+			return 0, nil
+		}
+		return 0, z.err
+	}
+	s := &inflateSink{z: z, w: w, out: make([]byte, z.bufSize)}
+	src, ok := z.in.(io.WriterTo)
+	if !ok || z.inEOF {
+		// Hide WriteTo so that io.CopyBuffer uses s.out.
+		n, err := io.CopyBuffer(w, struct{ io.Reader }{z}, s.out)
+		return n, err
+	}
+	if !z.inConsumed {
+		// Drain the input buffered by an earlier Read.
+		if _, err := s.Write(nil); err != nil {
+			return s.n, err
+		}
+	}
+	if _, err := src.WriteTo(s); err != nil {
+		if z.err == nil {
+			z.err = err
+		}
+		return s.n, z.err
+	}
+	z.inEOF = true
+	z.err = io.EOF
+	return s.n, nil
+}
+
+// inflateSink decompresses the data written to it into a Reader's stream,
+// and writes the result to w.
+type inflateSink struct {
+	z   *Reader
+	w   io.Writer
+	out []byte
+	n   int64 // # of bytes written to w.
+}
+
+// Write decompresses in. It consumes all of in before returning, so that the
+// stream does not retain a pointer to it. If in is empty, it consumes the
+// input buffered in the stream.
+func (s *inflateSink) Write(in []byte) (int, error) {
+	z := s.z
+	var (
+		inPtr = unsafe.Pointer(nil)
+		inLen = len(in)
+	)
+	if inLen > 0 {
+		inPtr = unsafe.Pointer(&in[0])
+		z.inOffset += int64(inLen)
+	} else if z.inConsumed {
+		return 0, nil
+	}
+	for {
+		var (
+			outLen     = &z.cArgs[0]
+			inConsumed = &z.cArgs[1]
+		)
+		*outLen = C.int(len(s.out))
+		ret := C.zs_inflate(&z.zs[0], inPtr, C.int(inLen), bufPtr(s.out), outLen, inConsumed)
+		inPtr, inLen = nil, 0
+		z.inConsumed = *inConsumed != 0
+		if ret != C.Z_STREAM_END && ret != C.Z_OK {
+			z.err = zlibReturnCodeToError(ret)
+			return 0, z.err
+		}
+		nOut := len(s.out) - int(*outLen)
+		z.blockOut += nOut
+		if nOut > 0 {
+			n, err := s.w.Write(s.out[:nOut])
+			s.n += int64(n)
+			if err != nil {
+				z.err = err
+				return 0, err
+			}
+		}
+		if ret == C.Z_STREAM_END {
+			z.blockStart = z.inOffset - int64(C.zs_inflate_avail_in(&z.zs[0]))
+			z.blockOut = 0
+			if ret = C.zs_inflate_reset(&z.zs[0]); ret != C.Z_OK {
+				z.err = zlibReturnCodeToError(ret)
+				return 0, z.err
+			}
+		}
+		if z.inConsumed {
+			return len(in), nil
+		}
+	}
+}
+
+// ReadFrom implements io.ReaderFrom. If r implements io.WriterTo, as
+// bytes.Reader and bytes.Buffer do, its data is compressed in place without
+// an intermediate copy. Otherwise the data is read in Opts.Buffer-sized
+// chunks.
+func (z *Writer) ReadFrom(r io.Reader) (int64, error) {
+	// Hide ReadFrom so that io.CopyBuffer does not recurse.
+	w := struct{ io.Writer }{z}
+	if src, ok := r.(io.WriterTo); ok {
+		return src.WriteTo(w)
+	}
+	return io.CopyBuffer(w, r, make([]byte, len(z.outBuf)))
+}
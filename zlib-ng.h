@@ -219,11 +219,14 @@ ZEXTERN int ZEXPORT zng_deflateInit (zng_stream *strm, int level);
    zalloc and zfree are set to NULL, deflateInit updates them to use default
    allocation functions.
 
-     The compression level must be Z_DEFAULT_COMPRESSION, or between 0 and 9:
+     The compression level must be Z_DEFAULT_COMPRESSION, or between 0 and 12:
    1 gives best speed, 9 gives best compression, 0 gives no compression at all
    (the input data is simply copied a block at a time).  Z_DEFAULT_COMPRESSION
    requests a default compromise between speed and compression (currently
-   equivalent to level 6).
+   equivalent to level 6).  As an extension, levels 10 to 12 search for an
+   optimal parse of the input, which is much slower than level 9 and gives a
+   few percent better compression; the output is still a standard deflate
+   stream.
 
      deflateInit returns Z_OK if success, Z_MEM_ERROR if there was not enough
    memory, Z_STREAM_ERROR if level is not a valid compression level, or
@@ -1823,6 +1826,10 @@ ZEXTERN const char     * ZEXPORT zng_zError           (int);
 ZEXTERN int              ZEXPORT zng_inflateSyncPoint (zng_stream *);
 ZEXTERN const uint32_t * ZEXPORT zng_get_crc_table    (void);
 ZEXTERN int              ZEXPORT zng_inflateUndermine (zng_stream *, int);
+ZEXTERN int              ZEXPORT zng_inflateMultiLiteral (zng_stream *, int);
+ZEXTERN int              ZEXPORT zng_deflateBlockSplit (zng_stream *, int);
+ZEXTERN int              ZEXPORT zng_deflateStoreIncompressible (zng_stream *, int);
+ZEXTERN int              ZEXPORT zng_deflateQuickDynamic (zng_stream *, int);
 ZEXTERN int              ZEXPORT zng_inflateValidate  (zng_stream *, int);
 ZEXTERN unsigned long    ZEXPORT zng_inflateCodesUsed (zng_stream *);
 ZEXTERN int              ZEXPORT zng_inflateResetKeep (zng_stream *);
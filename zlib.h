@@ -230,11 +230,14 @@ ZEXTERN int ZEXPORT deflateInit (z_stream *strm, int level);
    zalloc and zfree are set to NULL, deflateInit updates them to use default
    allocation functions.
 
-     The compression level must be Z_DEFAULT_COMPRESSION, or between 0 and 9:
+     The compression level must be Z_DEFAULT_COMPRESSION, or between 0 and 12:
    1 gives best speed, 9 gives best compression, 0 gives no compression at all
    (the input data is simply copied a block at a time).  Z_DEFAULT_COMPRESSION
    requests a default compromise between speed and compression (currently
-   equivalent to level 6).
+   equivalent to level 6).  As an extension, levels 10 to 12 search for an
+   optimal parse of the input, which is much slower than level 9 and gives a
+   few percent better compression; the output is still a standard deflate
+   stream.
 
      deflateInit returns Z_OK if success, Z_MEM_ERROR if there was not enough
    memory, Z_STREAM_ERROR if level is not a valid compression level, or
@@ -1831,6 +1834,10 @@ ZEXTERN const char     * ZEXPORT zError           (int);
 ZEXTERN int              ZEXPORT inflateSyncPoint (z_stream *);
 ZEXTERN const uint32_t * ZEXPORT get_crc_table    (void);
 ZEXTERN int              ZEXPORT inflateUndermine (z_stream *, int);
+ZEXTERN int              ZEXPORT inflateMultiLiteral (z_stream *, int);
+ZEXTERN int              ZEXPORT deflateBlockSplit (z_stream *, int);
+ZEXTERN int              ZEXPORT deflateStoreIncompressible (z_stream *, int);
+ZEXTERN int              ZEXPORT deflateQuickDynamic (z_stream *, int);
 ZEXTERN int              ZEXPORT inflateValidate  (z_stream *, int);
 ZEXTERN unsigned long    ZEXPORT inflateCodesUsed (z_stream *);
 ZEXTERN int              ZEXPORT inflateResetKeep (z_stream *);
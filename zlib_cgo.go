@@ -4,9 +4,9 @@ package zlibng
 
 /*
 
-#cgo linux CFLAGS: -march=ivybridge -std=c99 -Wall -D_LARGEFILE64_SOURCE=1 -DHAVE_HIDDEN -DHAVE_INTERNAL -DHAVE_BUILTIN_CTZL -DMEDIUM_STRATEGY -DX86_64 -DX86_NOCHECK_SSE2 -DUNALIGNED_OK -DUNROLL_LESS -DX86_CPUID -DX86_SSE2_FILL_WINDOW -DX86_SSE4_2_CRC_HASH -DX86_SSE4_2_CRC_INTRIN -DX86_PCLMULQDQ_CRC -DX86_QUICK_STRATEGY -I.
+#cgo linux CFLAGS: -std=c99 -Wall -D_LARGEFILE64_SOURCE=1 -DHAVE_HIDDEN -DHAVE_INTERNAL -DHAVE_BUILTIN_CTZL -DMEDIUM_STRATEGY -DX86_64 -DX86_NOCHECK_SSE2 -DUNALIGNED_OK -DUNROLL_LESS -DX86_CPUID -DX86_SSE2_FILL_WINDOW -DX86_SSE4_2_CRC_HASH -DX86_SSE4_2_CRC_INTRIN -DX86_PCLMULQDQ_CRC -DX86_VPCLMULQDQ_CRC -DX86_QUICK_STRATEGY -DX86_AVX2 -DX86_AVX512 -DX86_SSSE3_ADLER32 -DX86_AVX2_ADLER32 -DX86_SSE2_CHUNKCOPY -DX86_AVX2_CHUNKCOPY -DINFLATE_MULTILIT -I.
 
-#cgo darwin CFLAGS: -march=ivybridge -std=c99 -Wall -DHAVE_HIDDEN -DHAVE_INTERNAL -DHAVE_BUILTIN_CTZL -DMEDIUM_STRATEGY -DX86_64 -DX86_NOCHECK_SSE2 -DUNALIGNED_OK -DUNROLL_LESS -DX86_CPUID -DX86_SSE2_FILL_WINDOW -DX86_SSE4_2_CRC_HASH -DX86_SSE4_2_CRC_INTRIN -DX86_PCLMULQDQ_CRC -DX86_QUICK_STRATEGY -I.
+#cgo darwin CFLAGS: -std=c99 -Wall -DHAVE_HIDDEN -DHAVE_INTERNAL -DHAVE_BUILTIN_CTZL -DMEDIUM_STRATEGY -DX86_64 -DX86_NOCHECK_SSE2 -DUNALIGNED_OK -DUNROLL_LESS -DX86_CPUID -DX86_SSE2_FILL_WINDOW -DX86_SSE4_2_CRC_HASH -DX86_SSE4_2_CRC_INTRIN -DX86_PCLMULQDQ_CRC -DX86_VPCLMULQDQ_CRC -DX86_QUICK_STRATEGY -DX86_AVX2 -DX86_AVX512 -DX86_SSSE3_ADLER32 -DX86_AVX2_ADLER32 -DX86_SSE2_CHUNKCOPY -DX86_AVX2_CHUNKCOPY -DINFLATE_MULTILIT -I.
 
 #include <errno.h>
 #include <stdlib.h>
@@ -29,24 +29,39 @@ import (
 
 type zstream [unsafe.Sizeof(C.zng_stream{})]C.char
 
-// Reader is a gzip/zlib/flate reader. It implements io.ReadCloser.  Calling
-// Close is optional, though strongly recommended.  NewReader() also installs a
-// GC finalizer that closes the Reader, in case the application forgets to call
-// Close.
+// Reader is a gzip/zlib/flate reader. It implements io.ReadCloser. Close frees
+// the decompressor state; NewReader() also installs a GC finalizer that frees
+// it if Close is never called. Reset reuses the state, or creates a new one
+// after Close, so a Reader can be cached in a sync.Pool.
 type Reader struct {
 	in          io.Reader
+	opt         Opts
+	windowBits  int
+	freed       bool    // true if the decompressor state has been freed.
 	inConsumed  bool    // true if zstream has finished consuming the current input buffer.
 	inEOF       bool    // true if in reaches io.EOF
 	hasGzHeader bool    // true if gzHeader was successfully set.
 	zs          zstream // underlying zlib implementation.
 	gzHeader    C.zng_gz_header
-	inBuf       []byte
+	inBuf       []byte   // allocated on the first Read.
+	bufSize     int      // size of inBuf, and of the output buffer of WriteTo.
+	cArgs       [2]C.int // out-params of C calls, kept here so that they don't escape to the heap.
 	err         error
+
+	inOffset   int64 // # of bytes read from in.
+	blockStart int64 // offset of the current gzip member in in.
+	blockOut   int   // # of bytes produced from the current gzip member.
 }
 
 func freeReader(z *Reader) {
+	if z.freed {
+		return
+	}
 	_ = C.zs_inflate_end(&z.zs[0])
 	freeGzHeaderFields(&z.gzHeader)
+	z.gzHeader = C.zng_gz_header{}
+	z.hasGzHeader = false
+	z.freed = true
 }
 
 // NewReader creates a gzip/flate reader. There can be at most one options arg.
@@ -60,9 +75,20 @@ func NewReader(in io.Reader, opts ...Opts) (*Reader, error) {
 	}
 	z := &Reader{
 		in:         in,
-		inBuf:      make([]byte, opt.Buffer),
+		opt:        opt,
+		windowBits: opt.WindowBits,
+		bufSize:    opt.Buffer,
 		inConsumed: true, // force in.Read
 	}
+	if err := z.init(); err != nil {
+		return nil, err
+	}
+	runtime.SetFinalizer(z, freeReader)
+	return z, nil
+}
+
+// init creates the decompressor state and the gzip header buffers.
+func (z *Reader) init() error {
 	const maxStringLen = 256 // TODO(saito): allow setting the header length.
 	z.gzHeader.comment = (*C.uchar)(C.malloc(maxStringLen))
 	z.gzHeader.comm_max = maxStringLen
@@ -71,14 +97,19 @@ func NewReader(in io.Reader, opts ...Opts) (*Reader, error) {
 	z.gzHeader.extra = (*C.uchar)(C.malloc(maxStringLen))
 	z.gzHeader.extra_max = maxStringLen
 	var getHeaderStatus C.int
-	if ec := C.zs_inflate_init(&z.zs[0], C.int(opt.WindowBits), &z.gzHeader, &getHeaderStatus); ec != 0 {
-		return nil, zlibReturnCodeToError(ec)
+	if ec := C.zs_inflate_init(&z.zs[0], C.int(z.windowBits), slabFlag(z.opt), &z.gzHeader, &getHeaderStatus); ec != 0 {
+		freeGzHeaderFields(&z.gzHeader)
+		return zlibReturnCodeToError(ec)
 	}
-	if getHeaderStatus == 0 {
-		z.hasGzHeader = true
+	z.freed = false
+	if z.opt.MultiLiteral {
+		if ec := C.zs_inflate_multi_literal(&z.zs[0]); ec != 0 {
+			freeReader(z)
+			return zlibReturnCodeToError(ec)
+		}
 	}
-	runtime.SetFinalizer(z, freeReader)
-	return z, nil
+	z.hasGzHeader = getHeaderStatus == 0
+	return nil
 }
 
 // Header reads the gzip header contents. If the file is a multi-gzip
@@ -106,15 +137,45 @@ func (z *Reader) Header() (GzipHeader, error) {
 	return h, nil
 }
 
-// Close implements io.Closer.
+// Reset discards the state of z and makes it read from in, as NewReader does
+// with the original options. It reuses the decompressor state and the
+// buffers, so it does not allocate. Reset can be called after Close, in which
+// case it creates a new decompressor state, from the slab allocator if
+// Opts.SlabAlloc is set.
+func (z *Reader) Reset(in io.Reader) error {
+	z.in = in
+	z.inConsumed = true
+	z.inEOF = false
+	z.inOffset = 0
+	z.blockStart = 0
+	z.blockOut = 0
+	if z.freed {
+		z.err = z.init()
+		return z.err
+	}
+	var ec C.int
+	if z.hasGzHeader {
+		ec = C.zs_inflate_reset2(&z.zs[0], C.int(z.windowBits), &z.gzHeader)
+	} else {
+		ec = C.zs_inflate_reset2(&z.zs[0], C.int(z.windowBits), nil)
+	}
+	z.err = zlibReturnCodeToError(ec)
+	return z.err
+}
+
+// Close implements io.Closer. It frees the decompressor state. Reads after
+// Close fail until Reset is called.
 func (z *Reader) Close() error {
-	runtime.SetFinalizer(z, nil)
-	ec := C.zs_inflate_end(&z.zs[0])
-	freeGzHeaderFields(&z.gzHeader)
-	if z.err == io.EOF {
-		return zlibReturnCodeToError(ec)
+	if z.freed {
+		return nil
 	}
-	return z.err
+	err := z.err
+	if err == io.EOF {
+		err = nil
+	}
+	freeReader(z)
+	z.err = errClosed
+	return err
 }
 
 // Read implements io.Reader.
@@ -122,18 +183,23 @@ func (z *Reader) Read(out []byte) (int, error) {
 	var orgOut = out
 	for z.err == nil && len(out) > 0 {
 		var (
-			outLen     = C.int(len(out))
+			outLen     = &z.cArgs[0]
 			ret        C.int
-			inConsumed C.int
+			inConsumed = &z.cArgs[1]
 		)
+		*outLen = C.int(len(out))
 		if !z.inConsumed {
-			ret = C.zs_inflate(&z.zs[0], nil, 0, unsafe.Pointer(&out[0]), &outLen, &inConsumed)
+			ret = C.zs_inflate(&z.zs[0], nil, 0, bufPtr(out), outLen, inConsumed)
 		} else {
 			if z.inEOF {
 				z.err = io.EOF
 				break
 			}
+			if z.inBuf == nil {
+				z.inBuf = make([]byte, z.bufSize)
+			}
 			n, err := z.in.Read(z.inBuf)
+			z.inOffset += int64(n)
 			if err != nil {
 				if err != io.EOF {
 					z.err = err
@@ -149,16 +215,19 @@ func (z *Reader) Read(out []byte) (int, error) {
 				z.err = io.EOF
 				break
 			}
-			ret = C.zs_inflate(&z.zs[0], unsafe.Pointer(&z.inBuf[0]), C.int(n), unsafe.Pointer(&out[0]), &outLen, &inConsumed)
+			ret = C.zs_inflate(&z.zs[0], bufPtr(z.inBuf), C.int(n), bufPtr(out), outLen, inConsumed)
 		}
-		z.inConsumed = (inConsumed != 0)
+		z.inConsumed = (*inConsumed != 0)
 		if ret != C.Z_STREAM_END && ret != C.Z_OK {
 			z.err = zlibReturnCodeToError(ret)
 			break
 		}
-		nOut := len(out) - int(outLen)
+		nOut := len(out) - int(*outLen)
 		out = out[nOut:]
+		z.blockOut += nOut
 		if ret == C.Z_STREAM_END {
+			z.blockStart = z.inOffset - int64(C.zs_inflate_avail_in(&z.zs[0]))
+			z.blockOut = 0
 			ret = C.zs_inflate_reset(&z.zs[0])
 			if ret != C.Z_OK {
 				z.err = zlibReturnCodeToError(ret)
@@ -170,11 +239,22 @@ func (z *Reader) Read(out []byte) (int, error) {
 }
 
 // Writer is the gzip/flate writer. It implements io.WriterCloser.
+//
+// Like Reader, Close frees the compressor state, with a GC finalizer as a
+// backstop, and Reset reuses the state or creates a new one after Close.
 type Writer struct {
-	out      io.Writer
-	zs       zstream // underlying zlib implementation.
-	gzHeader C.zng_gz_header
-	outBuf   []byte
+	out       io.Writer
+	opt       Opts
+	freed     bool    // true if the compressor state has been freed.
+	zs        zstream // underlying zlib implementation.
+	gzHeader  C.zng_gz_header
+	hasHeader bool // true if SetHeader was called.
+	outBuf    []byte
+	cArgs     [2]C.int // out-params of C calls, kept here so that they don't escape to the heap.
+
+	bgzf      bool   // true if Opts.BGZF is set.
+	bgzfBuf   []byte // uncompressed data of the BGZF block being filled.
+	outOffset int64  // # of bytes written to out. Maintained only in BGZF mode.
 }
 
 // NewWriter creates a gzip/flate writer. There can be at most one options arg.
@@ -184,25 +264,75 @@ func NewWriter(w io.Writer, opts ...Opts) (*Writer, error) {
 	if err != nil {
 		return nil, err
 	}
+	if opt.BGZF && opt.Buffer < BGZFMaxBlockSize {
+		opt.Buffer = BGZFMaxBlockSize
+	}
 	z := &Writer{
 		out:    w,
 		outBuf: make([]byte, opt.Buffer),
+		bgzf:   opt.BGZF,
 	}
 	if opt.WindowBits == 0 {
 		opt.WindowBits = Gzip
 	}
+	if opt.BGZF && opt.WindowBits != Gzip {
+		return nil, errors.New("zlibng.NewWriter: BGZF requires the Gzip format")
+	}
 	if opt.MemLevel == 0 {
 		opt.MemLevel = 8
 	}
 	if opt.Strategy == 0 {
 		opt.Strategy = DefaultStrategy
 	}
+	z.opt = opt
+	if err := z.init(); err != nil {
+		return nil, err
+	}
+	runtime.SetFinalizer(z, freeWriter)
+	return z, nil
+}
+
+// setDeflateFlags applies the Opts fields that have no deflateInit2 arg to zs.
+// It must be called right after zs_deflate_init.
+func setDeflateFlags(zs *zstream, opt Opts) C.int {
+	if opt.BlockSplit {
+		if ec := C.zs_deflate_block_split(&zs[0]); ec != 0 {
+			return ec
+		}
+	}
+	if opt.StoreIncompressible {
+		if ec := C.zs_deflate_store_incompressible(&zs[0]); ec != 0 {
+			return ec
+		}
+	}
+	if opt.QuickDynamic {
+		if ec := C.zs_deflate_quick_dynamic(&zs[0]); ec != 0 {
+			return ec
+		}
+	}
+	return 0
+}
+
+// init creates the compressor state.
+func (z *Writer) init() error {
+	opt := z.opt
 	ec := C.zs_deflate_init(&z.zs[0], C.int(opt.Level),
-		C.int(opt.WindowBits), C.int(opt.MemLevel), C.int(opt.Strategy))
+		C.int(opt.WindowBits), C.int(opt.MemLevel), C.int(opt.Strategy), slabFlag(opt))
 	if ec != 0 {
-		return nil, zlibReturnCodeToError(ec)
+		return zlibReturnCodeToError(ec)
 	}
-	return z, nil
+	z.freed = false
+	if ec := setDeflateFlags(&z.zs, opt); ec != 0 {
+		freeWriter(z)
+		return zlibReturnCodeToError(ec)
+	}
+	if opt.BGZF {
+		if err := z.initBGZF(); err != nil {
+			freeWriter(z)
+			return err
+		}
+	}
+	return nil
 }
 
 // SetHeader sets the Gzip header contents.
@@ -210,6 +340,12 @@ func NewWriter(w io.Writer, opts ...Opts) (*Writer, error) {
 // REQUIRES: No Write nor Close has been called yet.
 // REQUIRES: The archive format is Gzip.
 func (z *Writer) SetHeader(h GzipHeader) error {
+	if z.freed {
+		return errClosed
+	}
+	if z.bgzf {
+		return errors.New("zlibng.SetHeader: not supported in BGZF mode")
+	}
 	// comment, extra, and name should be null unless the value is
 	// actually set to something.
 	if len(h.Comment) > 0 {
@@ -228,10 +364,33 @@ func (z *Writer) SetHeader(h GzipHeader) error {
 	if h.OS != 0 {
 		z.gzHeader.os = C.int(h.OS)
 	}
+	z.hasHeader = true
 	ec := C.zs_deflate_set_header(&z.zs[0], &z.gzHeader)
 	return zlibReturnCodeToError(ec)
 }
 
+// Reset discards the state of z and makes it write to w, as NewWriter does with
+// the original options. The header set by SetHeader is dropped. It reuses the
+// compressor state and the buffers, so it does not allocate. Reset can be
+// called after Close, in which case it creates a new compressor state, from the
+// slab allocator if Opts.SlabAlloc is set.
+func (z *Writer) Reset(w io.Writer) error {
+	z.out = w
+	z.outOffset = 0
+	z.bgzfBuf = z.bgzfBuf[:0]
+	if z.freed {
+		return z.init()
+	}
+	clearHeader := 0
+	if z.hasHeader {
+		freeGzHeaderFields(&z.gzHeader)
+		z.gzHeader = C.zng_gz_header{}
+		z.hasHeader = false
+		clearHeader = 1
+	}
+	return zlibReturnCodeToError(C.zs_deflate_reset(&z.zs[0], C.int(clearHeader)))
+}
+
 // Flush writes the data to the output.
 func (z *Writer) flush(data []byte) error {
 	n, err := z.out.Write(data)
@@ -247,25 +406,53 @@ func (z *Writer) flush(data []byte) error {
 func freeGzHeaderFields(h *C.zng_gz_header) {
 	if h.comment != nil {
 		C.free(unsafe.Pointer(h.comment))
+		h.comment = nil
 	}
 	if h.extra != nil {
 		C.free(unsafe.Pointer(h.extra))
+		h.extra = nil
 	}
 	if h.name != nil {
 		C.free(unsafe.Pointer(h.name))
+		h.name = nil
 	}
 }
 
-// Close implements io.Closer
+func freeWriter(z *Writer) {
+	if z.freed {
+		return
+	}
+	_ = C.zs_deflate_free(&z.zs[0])
+	freeGzHeaderFields(&z.gzHeader)
+	z.gzHeader = C.zng_gz_header{}
+	z.hasHeader = false
+	z.freed = true
+}
+
+// Close implements io.Closer. It writes the trailer and frees the compressor
+// state. Writes after Close fail until Reset is called.
 func (z *Writer) Close() error {
-	defer freeGzHeaderFields(&z.gzHeader)
+	if z.freed {
+		return nil
+	}
+	err := z.finish()
+	freeWriter(z)
+	return err
+}
+
+// finish writes the rest of the compressed data and the trailer.
+func (z *Writer) finish() error {
+	if z.bgzf {
+		return z.closeBGZF()
+	}
 	for {
-		outLen := C.int(len(z.outBuf))
-		ret := C.zs_deflate_end(&z.zs[0], unsafe.Pointer(&z.outBuf[0]), &outLen)
+		outLen := &z.cArgs[0]
+		*outLen = C.int(len(z.outBuf))
+		ret := C.zs_deflate_end(&z.zs[0], bufPtr(z.outBuf), outLen)
 		if ret != 0 && ret != C.Z_STREAM_END {
 			return zlibReturnCodeToError(ret)
 		}
-		nOut := len(z.outBuf) - int(outLen)
+		nOut := len(z.outBuf) - int(*outLen)
 		if err := z.flush(z.outBuf[:nOut]); err != nil {
 			return err
 		}
@@ -277,42 +464,64 @@ func (z *Writer) Close() error {
 
 // Write implements io.Writer.
 func (z *Writer) Write(in []byte) (int, error) {
+	if z.freed {
+		return 0, errClosed
+	}
 	if len(in) == 0 {
 		return 0, nil
 	}
+	if z.bgzf {
+		return z.writeBGZF(in)
+	}
 	var (
-		outLen     = C.int(len(z.outBuf))
-		inConsumed C.int
+		outLen     = &z.cArgs[0]
+		inConsumed = &z.cArgs[1]
 	)
-	ret := C.zs_deflate(&z.zs[0], unsafe.Pointer(&in[0]), C.int(len(in)),
-		unsafe.Pointer(&z.outBuf[0]), &outLen, &inConsumed)
+	*outLen = C.int(len(z.outBuf))
+	ret := C.zs_deflate(&z.zs[0], bufPtr(in), C.int(len(in)),
+		bufPtr(z.outBuf), outLen, inConsumed)
 	if ret != 0 {
 		return 0, zlibReturnCodeToError(ret)
 	}
-	nOut := len(z.outBuf) - int(outLen)
+	nOut := len(z.outBuf) - int(*outLen)
 	if err := z.flush(z.outBuf[:nOut]); err != nil {
 		return 0, err
 	}
-	if inConsumed != 0 {
+	if *inConsumed != 0 {
 		return len(in), nil
 	}
 	for {
-		outLen = C.int(len(z.outBuf))
-		ret = C.zs_deflate(&z.zs[0], nil, 0, unsafe.Pointer(&z.outBuf[0]), &outLen, &inConsumed)
+		*outLen = C.int(len(z.outBuf))
+		ret = C.zs_deflate(&z.zs[0], nil, 0, bufPtr(z.outBuf), outLen, inConsumed)
 		if ret != 0 {
 			return 0, zlibReturnCodeToError(ret)
 		}
-		nOut := len(z.outBuf) - int(outLen)
+		nOut := len(z.outBuf) - int(*outLen)
 		if err := z.flush(z.outBuf[:nOut]); err != nil {
 			return 0, err
 		}
-		if inConsumed != 0 { // outbuf didn't fillup, i.e., the input was fully consumed.
+		if *inConsumed != 0 { // outbuf didn't fillup, i.e., the input was fully consumed.
 			break
 		}
 	}
 	return len(in), nil
 }
 
+// slabFlag returns the slab arg of zs_inflate_init and zs_deflate_init.
+func slabFlag(opt Opts) C.int {
+	if opt.SlabAlloc {
+		return 1
+	}
+	return 0
+}
+
+// bufPtr returns a pointer to b[0]. Passing it to a C function, instead of
+// unsafe.Pointer(&b[0]), keeps cgo from copying the slice header to the heap
+// for its pointer check.
+func bufPtr(b []byte) unsafe.Pointer { return unsafe.Pointer(&b[0]) }
+
+var errClosed = errors.New("zlibng: use of a closed Reader or Writer")
+
 var zlibErrors = map[C.int]error{
 	C.Z_OK:            nil,
 	C.Z_STREAM_END:    io.EOF,
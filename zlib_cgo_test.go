@@ -4,11 +4,16 @@ package zlibng_test
 
 import (
 	"bytes"
+	"fmt"
 	"io"
+	"io/ioutil"
+	"math/rand"
+	"runtime"
 	"testing"
 	"time"
 
 	"github.com/grailbio/testutil/assert"
+	"github.com/klauspost/compress/flate"
 	"github.com/klauspost/compress/gzip"
 	"github.com/vitessio/vitess/go/cgzip"
 	"github.com/yasushi-saito/zlibng"
@@ -48,6 +53,403 @@ func TestDeflateHeader(t *testing.T) {
 	}
 }
 
+func TestReset(t *testing.T) {
+	out := bytes.Buffer{}
+	zout, err := zlibng.NewWriter(&out, zlibng.Opts{Level: 6})
+	assert.NoError(t, err)
+	wantHeader := zlibng.GzipHeader{Comment: "hello", Name: "blah", OS: 11}
+	assert.NoError(t, zout.SetHeader(wantHeader))
+	_, err = zout.Write([]byte("first"))
+	assert.NoError(t, err)
+	assert.NoError(t, zout.Close())
+	first := append([]byte{}, out.Bytes()...)
+
+	// Close frees the compressor state, so the Writer fails until Reset.
+	assert.NoError(t, zout.Close())
+	_, err = zout.Write([]byte("x"))
+	assert.NE(t, err, nil)
+	assert.EQ(t, out.Bytes(), first)
+
+	// The header does not carry over to the next stream.
+	out.Reset()
+	assert.NoError(t, zout.Reset(&out))
+	_, err = zout.Write([]byte("second"))
+	assert.NoError(t, err)
+	assert.NoError(t, zout.Close())
+	second := append([]byte{}, out.Bytes()...)
+	gzin, err := gzip.NewReader(bytes.NewReader(second))
+	assert.NoError(t, err)
+	assert.EQ(t, gzin.Header.Name, "")
+	got := bytes.Buffer{}
+	_, err = io.Copy(&got, gzin)
+	assert.NoError(t, err)
+	assert.EQ(t, got.String(), "second")
+
+	zin, err := zlibng.NewReader(bytes.NewReader(first))
+	assert.NoError(t, err)
+	var b [2]byte
+	got.Reset()
+	_, err = io.Copy(&got, zin)
+	assert.NoError(t, err)
+	assert.EQ(t, got.String(), "first")
+	gotHeader, err := zin.Header()
+	assert.NoError(t, err)
+	assert.EQ(t, gotHeader, wantHeader)
+	assert.NoError(t, zin.Close())
+	_, err = zin.Read(b[:])
+	assert.NE(t, err, nil)
+	assert.NoError(t, zin.Close())
+
+	// Reset after Close, and in the middle of a stream.
+	assert.NoError(t, zin.Reset(bytes.NewReader(second)))
+	got.Reset()
+	_, err = io.Copy(&got, zin)
+	assert.NoError(t, err)
+	assert.EQ(t, got.String(), "second")
+	gotHeader, err = zin.Header()
+	assert.NoError(t, err)
+	assert.EQ(t, gotHeader.Name, "")
+	assert.NoError(t, zin.Reset(bytes.NewReader(first)))
+	_, err = io.ReadFull(zin, b[:])
+	assert.NoError(t, err)
+	assert.NoError(t, zin.Reset(bytes.NewReader(first)))
+	got.Reset()
+	_, err = io.Copy(&got, zin)
+	assert.NoError(t, err)
+	assert.EQ(t, got.String(), "first")
+
+	// A corrupt stream does not poison the next one.
+	corrupt := append([]byte{}, first...)
+	corrupt[len(corrupt)-8] ^= 1 // CRC
+	assert.NoError(t, zin.Reset(bytes.NewReader(corrupt)))
+	_, err = io.Copy(ioutil.Discard, zin)
+	assert.NE(t, err, nil)
+	assert.NoError(t, zin.Reset(bytes.NewReader(second)))
+	got.Reset()
+	_, err = io.Copy(&got, zin)
+	assert.NoError(t, err)
+	assert.EQ(t, got.String(), "second")
+}
+
+func TestResetBGZF(t *testing.T) {
+	data := bytes.Repeat([]byte("bgzf"), 100000)
+	out := bytes.Buffer{}
+	zout, err := zlibng.NewWriter(&out, zlibng.Opts{BGZF: true})
+	assert.NoError(t, err)
+	for i := 0; i < 2; i++ {
+		out.Reset()
+		assert.NoError(t, zout.Reset(&out))
+		_, err = zout.Write(data)
+		assert.NoError(t, err)
+		assert.NoError(t, zout.Close())
+		zin, err := zlibng.NewParallelReader(bytes.NewReader(out.Bytes()), zlibng.Opts{Concurrency: 2})
+		assert.NoError(t, err)
+		got, err := ioutil.ReadAll(zin)
+		assert.NoError(t, err)
+		assert.True(t, bytes.Equal(got, data))
+		assert.NoError(t, zin.Close())
+	}
+}
+
+func TestResetAllocs(t *testing.T) {
+	data := bytes.Repeat([]byte("hello, world. "), 1000)
+	var (
+		compressed bytes.Buffer
+		src        bytes.Reader
+		out        = make([]byte, len(data)+1)
+	)
+	compressed.Grow(len(data))
+	zout, err := zlibng.NewWriter(&compressed)
+	assert.NoError(t, err)
+	zin, err := zlibng.NewReader(&src)
+	assert.NoError(t, err)
+	allocs := testing.AllocsPerRun(100, func() {
+		compressed.Reset()
+		if err := zout.Reset(&compressed); err != nil {
+			t.Fatal(err)
+		}
+		if _, err := zout.Write(data); err != nil {
+			t.Fatal(err)
+		}
+		if err := zout.Close(); err != nil {
+			t.Fatal(err)
+		}
+		src.Reset(compressed.Bytes())
+		if err := zin.Reset(&src); err != nil {
+			t.Fatal(err)
+		}
+		n, err := io.ReadFull(zin, out)
+		if n != len(data) || err != io.ErrUnexpectedEOF {
+			t.Fatal(n, err)
+		}
+	})
+	assert.EQ(t, allocs, 0.0)
+}
+
+// fastqData generates n bytes of FASTQ-like records: the reads and the quality
+// strings each use a few distinct bytes, and they repeat only by chance.
+func fastqData(r *rand.Rand, n int) []byte {
+	data := make([]byte, 0, n+512)
+	for i := 0; len(data) < n; i++ {
+		data = append(data, fmt.Sprintf("@read:%d:%d\n", i, r.Intn(100000))...)
+		for j := 0; j < 150; j++ {
+			data = append(data, "ACGT"[r.Intn(4)])
+		}
+		data = append(data, "\n+\n"...)
+		for j := 0; j < 150; j++ {
+			data = append(data, "FFFFFFFF:,#"[r.Intn(11)])
+		}
+		data = append(data, '\n')
+	}
+	return data[:n]
+}
+
+func TestQuickDynamic(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	data := fastqData(r, 1<<20)
+	// Level 1 sends the static Huffman codes, unless QuickDynamic asks it to
+	// build codes for each block. FixedStrategy still gets the static codes.
+	static := testDeflateOpts(t, r, zlibng.Opts{Level: 1}, data)
+	dynamic := testDeflateOpts(t, r, zlibng.Opts{Level: 1, QuickDynamic: true}, data)
+	fixed := testDeflateOpts(t, r, zlibng.Opts{Level: 1, Strategy: zlibng.FixedStrategy, QuickDynamic: true}, data)
+	assert.LT(t, len(dynamic), len(static)*3/4)
+	assert.LT(t, len(dynamic), len(fixed)*3/4)
+
+	out := make([]byte, zlibng.CompressBound(len(data)))
+	n, err := zlibng.CompressInto(out, data, zlibng.Opts{Level: 1, QuickDynamic: true})
+	assert.NoError(t, err)
+	assert.LT(t, n, len(static)*3/4)
+	testParallelDeflate(t, r, zlibng.Opts{Level: 1, QuickDynamic: true}, data)
+}
+
+// fibonacciData generates the bytes 0 to n-1 in random order, byte i repeated
+// as often as the (i+2)th Fibonacci number. With the end-of-block code, whose
+// frequency is 1, the frequencies of a block that holds all of them are the
+// Fibonacci numbers, and its optimal literal code is n bits deep.
+func fibonacciData(r *rand.Rand, n int) []byte {
+	var data []byte
+	for i, a, b := 0, 1, 2; i < n; i, a, b = i+1, b, a+b {
+		for j := 0; j < a; j++ {
+			data = append(data, byte(i))
+		}
+	}
+	r.Shuffle(len(data), func(i, j int) { data[i], data[j] = data[j], data[i] })
+	return data
+}
+
+func TestHuffmanLengthLimit(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	// 10944 bytes, which fit in one block. Without matches, the literal code
+	// is 18 bits deep, so gen_bitlen must limit it to 15 bits and repair the
+	// Kraft sum.
+	data := fibonacciData(r, 18)
+	for _, level := range []int{1, 6, 9} {
+		compressed := testDeflateOpts(t, r, zlibng.Opts{Level: level, Strategy: zlibng.HuffmanOnlyStrategy}, data)
+		// The optimal code takes 2.6 bits per byte, and limiting it costs
+		// little.
+		assert.LT(t, len(compressed), len(data)*11/32, "level %d", level)
+	}
+	testParallelDeflate(t, r, zlibng.Opts{Level: 6, Strategy: zlibng.HuffmanOnlyStrategy}, data)
+}
+
+// mixedData generates n bytes that alternate between segments of FASTQ
+// records, of compressibleData, of words and of random bytes, like a tar file
+// of different kinds of files.
+func mixedData(r *rand.Rand, n int) []byte {
+	words := []string{"the ", "of ", "deflate ", "block ", "and ", "a ", "stream ", "tree ", "\n"}
+	data := make([]byte, 0, n)
+	for len(data) < n {
+		segLen := 16<<10 + r.Intn(96<<10)
+		switch r.Intn(4) {
+		case 0:
+			data = append(data, fastqData(r, segLen)...)
+		case 1:
+			data = append(data, compressibleData(r, segLen)...)
+		case 2:
+			for end := len(data) + segLen; len(data) < end; {
+				data = append(data, words[r.Intn(len(words))]...)
+			}
+		case 3:
+			for i := 0; i < segLen; i++ {
+				data = append(data, byte(r.Intn(256)))
+			}
+		}
+	}
+	return data[:n]
+}
+
+func TestBlockSplit(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	data := mixedData(r, 2<<20)
+	for _, level := range []int{1, 6, 10} {
+		plain := testDeflateOpts(t, r, zlibng.Opts{Level: level}, data)
+		split := testDeflateOpts(t, r, zlibng.Opts{Level: level, BlockSplit: true}, data)
+		assert.LT(t, len(split), len(plain), "level %d", level)
+	}
+	testParallelDeflate(t, r, zlibng.Opts{Level: 6, BlockSplit: true}, data)
+
+	// CompressInto applies BlockSplit too, and does not mix up the pooled
+	// streams of the two settings.
+	compressInto := func(split bool) []byte {
+		out := make([]byte, zlibng.CompressBound(len(data)))
+		n, err := zlibng.CompressInto(out, data, zlibng.Opts{Level: 6, BlockSplit: split})
+		assert.NoError(t, err)
+		testInflate(t, r, zlibng.Gzip, out[:n], data)
+		return out[:n]
+	}
+	plain := compressInto(false)
+	split := compressInto(true)
+	assert.LT(t, len(split), len(plain))
+	assert.EQ(t, compressInto(false), plain)
+}
+
+func TestStoreIncompressible(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	mixed := mixedData(r, 2<<20)
+	random := make([]byte, 1<<20)
+	r.Read(random)
+	for _, level := range []int{1, 6, 10} {
+		plain := testDeflateOpts(t, r, zlibng.Opts{Level: level}, mixed)
+		stored := testDeflateOpts(t, r, zlibng.Opts{Level: level, StoreIncompressible: true}, mixed)
+		assert.LE(t, len(stored), len(plain)+len(plain)/1000, "level %d", level)
+
+		// Deflate also stores random input, so the sizes show whether the
+		// bypass ran only if deflate's own stored blocks are small. At
+		// MemLevel 1, deflate stores blocks of about 128 bytes, with 5 bytes
+		// of headers each, while the bypass stores blocks of up to 64KiB.
+		plain = testDeflateOpts(t, r, zlibng.Opts{Level: level, MemLevel: 1}, random)
+		stored = testDeflateOpts(t, r, zlibng.Opts{Level: level, MemLevel: 1, StoreIncompressible: true}, random)
+		assert.GT(t, len(plain), len(random)+len(random)/100, "level %d", level)
+		assert.LT(t, len(stored), len(random)+len(random)/1000, "level %d", level)
+	}
+	// deflate_quick leaves the end of its blocks pending, which must be
+	// written out before storing, also when the output buffer is small.
+	for _, memLevel := range []int{1, 2} {
+		testDeflateOpts(t, r, zlibng.Opts{Level: 1, Strategy: zlibng.FixedStrategy, MemLevel: memLevel,
+			Buffer: 97, StoreIncompressible: true}, mixed[:512<<10])
+	}
+	testParallelDeflate(t, r, zlibng.Opts{Level: 6, StoreIncompressible: true}, mixed)
+
+	// CompressInto applies StoreIncompressible too.
+	compressInto := func(store bool) []byte {
+		out := make([]byte, zlibng.CompressBound(len(random)))
+		n, err := zlibng.CompressInto(out, random, zlibng.Opts{Level: 6, MemLevel: 1, StoreIncompressible: store})
+		assert.NoError(t, err)
+		testInflate(t, r, zlibng.Gzip, out[:n], random)
+		return out[:n]
+	}
+	assert.GT(t, len(compressInto(false)), len(random)+len(random)/100)
+	assert.LT(t, len(compressInto(true)), len(random)+len(random)/1000)
+}
+
+func TestInflateBack(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	for _, data := range [][]byte{nil, compressibleData(r, 1<<20), fastqData(r, 1<<20), mixedData(r, 1<<20)} {
+		out := bytes.Buffer{}
+		zout, err := zlibng.NewWriter(&out, zlibng.Opts{Level: 6, WindowBits: zlibng.Flate})
+		assert.NoError(t, err)
+		_, err = zout.Write(data)
+		assert.NoError(t, err)
+		assert.NoError(t, zout.Close())
+		compressed := out.Bytes()
+
+		got := make([]byte, len(data)+1)
+		n, err := zlibng.InflateBack(got, compressed)
+		assert.NoError(t, err)
+		assert.True(t, bytes.Equal(got[:n], data), "size %d", len(data))
+		if len(data) == 0 {
+			continue
+		}
+		_, err = zlibng.InflateBack(got[:len(data)-1], compressed)
+		assert.EQ(t, err, io.ErrShortBuffer)
+		_, err = zlibng.InflateBack(got, compressed[:len(compressed)/2])
+		assert.NE(t, err, nil)
+	}
+}
+
+func TestInflateCopy(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	for _, data := range [][]byte{compressibleData(r, 1<<20), fastqData(r, 1<<20)} {
+		compressed, err := zlibng.Compress(nil, data, 6)
+		assert.NoError(t, err)
+		for _, at := range []int{1, 100, len(compressed) / 3, len(compressed) - 1} {
+			got := make([]byte, len(data)+1)
+			n, err := zlibng.InflateCopyAt(got, compressed, at)
+			assert.NoError(t, err)
+			assert.True(t, bytes.Equal(got[:n], data), "at %d", at)
+		}
+	}
+}
+
+// benchmarkDeflateMixed measures the speed and the compression ratio of
+// mixedData with the given options.
+func benchmarkDeflateMixed(b *testing.B, opts zlibng.Opts) {
+	data := mixedData(rand.New(rand.NewSource(0)), 8<<20)
+	out := bytes.Buffer{}
+	b.SetBytes(int64(len(data)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		out.Reset()
+		zout, err := zlibng.NewWriter(&out, opts)
+		if err != nil {
+			b.Fatal(err)
+		}
+		if _, err := zout.Write(data); err != nil {
+			b.Fatal(err)
+		}
+		if err := zout.Close(); err != nil {
+			b.Fatal(err)
+		}
+	}
+	b.ReportMetric(float64(len(data))/float64(out.Len()), "ratio")
+}
+
+// benchmarkDeflateSyncFlush compresses with a Z_SYNC_FLUSH after every
+// flushBytes of input. Each block then holds few symbols, so building its
+// Huffman trees takes a large share of the time.
+func benchmarkDeflateSyncFlush(b *testing.B, level, flushBytes int) {
+	data := mixedData(rand.New(rand.NewSource(0)), 1<<20)
+	out := make([]byte, 2*len(data))
+	n, err := zlibng.DeflateSyncFlush(out, data, level, flushBytes)
+	if err != nil {
+		b.Fatal(err)
+	}
+	got, err := ioutil.ReadAll(flate.NewReader(bytes.NewReader(out[:n])))
+	if err != nil || !bytes.Equal(got, data) {
+		b.Fatal("round trip failed", err)
+	}
+	b.SetBytes(int64(len(data)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if _, err := zlibng.DeflateSyncFlush(out, data, level, flushBytes); err != nil {
+			b.Fatal(err)
+		}
+	}
+	b.ReportMetric(float64(len(data))/float64(n), "ratio")
+}
+
+func BenchmarkDeflateLevel2SyncFlush1K(b *testing.B)  { benchmarkDeflateSyncFlush(b, 2, 1<<10) }
+func BenchmarkDeflateLevel6SyncFlush256(b *testing.B) { benchmarkDeflateSyncFlush(b, 6, 256) }
+func BenchmarkDeflateLevel6SyncFlush1K(b *testing.B)  { benchmarkDeflateSyncFlush(b, 6, 1<<10) }
+
+func BenchmarkDeflateLevel1(b *testing.B) { benchmarkDeflateMixed(b, zlibng.Opts{Level: 1}) }
+func BenchmarkDeflateLevel1BlockSplit(b *testing.B) {
+	benchmarkDeflateMixed(b, zlibng.Opts{Level: 1, BlockSplit: true})
+}
+func BenchmarkDeflateLevel1StoreIncompressible(b *testing.B) {
+	benchmarkDeflateMixed(b, zlibng.Opts{Level: 1, StoreIncompressible: true})
+}
+func BenchmarkDeflateLevel1QuickDynamic(b *testing.B) {
+	benchmarkDeflateMixed(b, zlibng.Opts{Level: 1, QuickDynamic: true})
+}
+func BenchmarkDeflateLevel6(b *testing.B) { benchmarkDeflateMixed(b, zlibng.Opts{Level: 6}) }
+func BenchmarkDeflateLevel6BlockSplit(b *testing.B) {
+	benchmarkDeflateMixed(b, zlibng.Opts{Level: 6, BlockSplit: true})
+}
+func BenchmarkDeflateLevel6StoreIncompressible(b *testing.B) {
+	benchmarkDeflateMixed(b, zlibng.Opts{Level: 6, StoreIncompressible: true})
+}
+
 func BenchmarkInflateCGZip(b *testing.B) {
 	benchmarkInflate(b, *testSmallPathFlag,
 		func(in io.Reader) (io.Reader, io.Closer, error) {
@@ -64,3 +466,30 @@ func BenchmarkDeflateCGZip(b *testing.B) {
 			return w
 		})
 }
+
+// BenchmarkCompressNewThread compresses a small message on a new OS thread
+// each time, so it includes any per-thread setup in the C library.
+// BenchmarkNewThread measures the thread alone.
+func BenchmarkCompressNewThread(b *testing.B) { benchmarkNewThread(b, true) }
+func BenchmarkNewThread(b *testing.B)         { benchmarkNewThread(b, false) }
+
+func benchmarkNewThread(b *testing.B, compress bool) {
+	data := bytes.Repeat([]byte("hello, world "), 80)
+	buf := make([]byte, 0, zlibng.CompressBound(len(data)))
+	done := make(chan error)
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		go func() {
+			// The thread exits with the goroutine, since it stays locked.
+			runtime.LockOSThread()
+			var err error
+			if compress {
+				_, err = zlibng.Compress(buf, data, 5)
+			}
+			done <- err
+		}()
+		if err := <-done; err != nil {
+			b.Fatal(err)
+		}
+	}
+}
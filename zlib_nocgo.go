@@ -3,18 +3,24 @@
 package zlibng
 
 import (
+	"bytes"
 	"errors"
 	"io"
 
 	"github.com/klauspost/compress/flate"
 	"github.com/klauspost/compress/gzip"
+	"github.com/klauspost/compress/zlib"
 )
 
+// isZlib checks if windowBits selects the zlib format (RFC1950).
+func isZlib(windowBits int) bool { return windowBits >= 8 && windowBits <= 15 }
+
 type reader struct {
 	io.ReadCloser
 }
 
-// NewReader creates a gzip/flate writer. There can be at most one options arg.
+// NewReader creates a gzip/zlib/flate reader. There can be at most one
+// options arg.
 func NewReader(in io.Reader, opts ...Opts) (reader, error) {
 	opt, err := getOpts(opts...)
 	if err != nil {
@@ -24,31 +30,172 @@ func NewReader(in io.Reader, opts ...Opts) (reader, error) {
 		z := flate.NewReader(in)
 		return reader{z}, nil
 	}
+	if isZlib(opt.WindowBits) {
+		z, err := zlib.NewReader(in)
+		return reader{z}, err
+	}
 	z, err := gzip.NewReader(in)
 	return reader{z}, err
 }
 
+// NewParallelReader creates a gzip reader. Without cgo, it decompresses
+// serially.
+func NewParallelReader(in io.Reader, opts ...Opts) (reader, error) {
+	return NewReader(in, opts...)
+}
+
 func (r reader) Header() (GzipHeader, error) {
 	return GzipHeader{}, errors.New("zlibng.Header: Not supported")
 }
 
+// Reset makes r read from in.
+func (r reader) Reset(in io.Reader) error {
+	switch z := r.ReadCloser.(type) {
+	case *gzip.Reader:
+		return z.Reset(in)
+	case flate.Resetter: // Also matches zlib.Resetter.
+		return z.Reset(in, nil)
+	}
+	return errors.New("zlibng.Reset: Not supported")
+}
+
 type writer struct{ io.WriteCloser }
 
-// NewWriter creates a gzip/flate writer. There can be at most one options arg.
+// NewWriter creates a gzip/zlib/flate writer. There can be at most one options arg.
 // If opts is empty, NewWriter will use Opts{Format:Gzip,Level:-1}.
 func NewWriter(w io.Writer, opts ...Opts) (writer, error) {
 	opt, err := getOpts(opts...)
 	if err != nil {
 		return writer{}, err
 	}
+	if opt.BGZF {
+		return writer{}, errors.New("zlibng.NewWriter: BGZF not supported")
+	}
+	if opt.Level > flate.BestCompression {
+		opt.Level = flate.BestCompression
+	}
 	if opt.WindowBits == Flate {
 		z, err := flate.NewWriter(w, opt.Level)
 		return writer{z}, err
 	}
+	if isZlib(opt.WindowBits) {
+		z, err := zlib.NewWriterLevel(w, opt.Level)
+		return writer{z}, err
+	}
 	z, err := gzip.NewWriterLevel(w, opt.Level)
 	return writer{z}, err
 }
 
+// NewParallelWriter creates a gzip/flate writer. Without cgo, it compresses
+// serially.
+func NewParallelWriter(w io.Writer, opts ...Opts) (writer, error) {
+	return NewWriter(w, opts...)
+}
+
 func (w writer) SetHeader(GzipHeader) error {
 	return errors.New("zlibng.SetHeader: Not supported")
 }
+
+// Reset makes w write to out.
+func (w writer) Reset(out io.Writer) error {
+	z, ok := w.WriteCloser.(interface{ Reset(io.Writer) })
+	if !ok {
+		return errors.New("zlibng.Reset: Not supported")
+	}
+	z.Reset(out)
+	return nil
+}
+
+// CompressInto compresses src into dst. Without cgo, it compresses into a
+// temporary buffer first.
+func CompressInto(dst, src []byte, opts ...Opts) (int, error) {
+	buf := bytes.Buffer{}
+	w, err := NewWriter(&buf, opts...)
+	if err != nil {
+		return 0, err
+	}
+	if _, err := w.Write(src); err != nil {
+		return 0, err
+	}
+	if err := w.Close(); err != nil {
+		return 0, err
+	}
+	if buf.Len() > len(dst) {
+		return 0, io.ErrShortBuffer
+	}
+	return copy(dst, buf.Bytes()), nil
+}
+
+// detectFormat returns the Opts to decompress src with. If Opts.WindowBits is
+// unset, it picks gzip or zlib from the header of src, as inflateInit2 does
+// for windowBits 32+15.
+func detectFormat(src []byte, opts ...Opts) (Opts, error) {
+	opt, err := getOpts(opts...)
+	if err != nil {
+		return opt, err
+	}
+	if opt.WindowBits == 0 && !(len(src) >= 2 && src[0] == 0x1f && src[1] == 0x8b) {
+		opt.WindowBits = 15
+	}
+	return opt, nil
+}
+
+// DecompressInto decompresses src into dst. If Opts.WindowBits is unset, src
+// may be in gzip or zlib format.
+func DecompressInto(dst, src []byte, opts ...Opts) (int, error) {
+	if len(src) == 0 {
+		return 0, nil
+	}
+	opt, err := detectFormat(src, opts...)
+	if err != nil {
+		return 0, err
+	}
+	r, err := NewReader(bytes.NewReader(src), opt)
+	if err != nil {
+		return 0, err
+	}
+	// Not io.ReadFull: it turns a short output into io.ErrUnexpectedEOF, which
+	// could not be told apart from truncated input.
+	n := 0
+	for n < len(dst) {
+		m, err := r.Read(dst[n:])
+		n += m
+		if err == io.EOF {
+			return n, nil
+		}
+		if err != nil {
+			return n, err
+		}
+	}
+	// dst is full. Check that there is no more output.
+	var b [1]byte
+	if m, _ := r.Read(b[:]); m > 0 {
+		return 0, io.ErrShortBuffer
+	}
+	return n, nil
+}
+
+// Compress appends the gzip compression of src to dst.
+func Compress(dst, src []byte, level int) ([]byte, error) {
+	buf := make([]byte, CompressBound(len(src)))
+	n, err := CompressInto(buf, src, Opts{Level: level})
+	return append(dst, buf[:n]...), err
+}
+
+// Decompress appends the decompression of src, in gzip or zlib format, to dst.
+func Decompress(dst, src []byte) ([]byte, error) {
+	if len(src) == 0 {
+		return dst, nil
+	}
+	opt, err := detectFormat(src)
+	if err != nil {
+		return dst, err
+	}
+	r, err := NewReader(bytes.NewReader(src), opt)
+	if err != nil {
+		return dst, err
+	}
+	buf := bytes.NewBuffer(dst)
+	_, err = io.Copy(buf, r)
+	return buf.Bytes(), err
+}
@@ -5,14 +5,18 @@ import (
 	"bytes"
 	"compress/flate"
 	"compress/gzip"
+	"compress/zlib"
+	"encoding/binary"
 	"flag"
 	"fmt"
 	"io"
 	"io/ioutil"
 	"log"
+	"math"
 	"math/rand"
 	"os"
 	"path/filepath"
+	"runtime"
 	"testing"
 
 	"github.com/grailbio/testutil/assert"
@@ -203,6 +207,415 @@ func TestDeflateRandom(t *testing.T) {
 	}
 }
 
+// compressibleData generates n bytes made of short random runs that repeat at
+// random distances, so that the deflate output contains back references.
+func compressibleData(r *rand.Rand, n int) []byte {
+	data := make([]byte, 0, n)
+	for len(data) < n {
+		runLen := r.Intn(64) + 1
+		if len(data) > 0 && r.Intn(4) != 0 {
+			start := len(data) - r.Intn(len(data)) - 1
+			for i := 0; i < runLen && len(data) < n; i++ {
+				data = append(data, data[start+i])
+			}
+			continue
+		}
+		for i := 0; i < runLen && len(data) < n; i++ {
+			data = append(data, "ACGTN"[r.Intn(5)])
+		}
+	}
+	return data
+}
+
+// testDeflateOpts compresses src with NewWriter, in Writes of random sizes up to
+// 64KiB, checks that the output decompresses to src, and returns the output.
+func testDeflateOpts(t *testing.T, r *rand.Rand, opts zlibng.Opts, src []byte) []byte {
+	out := bytes.Buffer{}
+	zout, err := zlibng.NewWriter(&out, opts)
+	assert.NoError(t, err)
+	for remaining := src; len(remaining) > 0; {
+		n := r.Intn(64 << 10)
+		if n > len(remaining) {
+			n = len(remaining)
+		}
+		_, err = zout.Write(remaining[:n])
+		assert.NoError(t, err)
+		remaining = remaining[n:]
+	}
+	assert.NoError(t, zout.Close())
+	windowBits := opts.WindowBits
+	if windowBits == 0 {
+		windowBits = zlibng.Gzip
+	}
+	testInflate(t, r, windowBits, out.Bytes(), src)
+	return out.Bytes()
+}
+
+func testParallelDeflate(t *testing.T, r *rand.Rand, opts zlibng.Opts, src []byte) {
+	out := bytes.Buffer{}
+	zout, err := zlibng.NewParallelWriter(&out, opts)
+	assert.NoError(t, err)
+	for remaining := src; len(remaining) > 0; {
+		n := r.Intn(256 << 10)
+		if n > len(remaining) {
+			n = len(remaining)
+		}
+		n2, err := zout.Write(remaining[:n])
+		assert.NoError(t, err)
+		assert.EQ(t, n, n2)
+		remaining = remaining[n:]
+	}
+	assert.NoError(t, zout.Close())
+
+	var zin io.Reader
+	if opts.WindowBits == zlibng.Flate {
+		zin = flate.NewReader(bytes.NewReader(out.Bytes()))
+	} else {
+		gz, err := gzip.NewReader(bytes.NewReader(out.Bytes()))
+		assert.NoError(t, err)
+		gz.Multistream(false)
+		zin = gz
+	}
+	got, err := ioutil.ReadAll(zin)
+	assert.NoError(t, err)
+	if !bytes.Equal(got, src) {
+		t.Fatalf("mismatch: got %d bytes, want %d", len(got), len(src))
+	}
+}
+
+func TestParallelDeflate(t *testing.T) {
+	for iter := 0; iter < 16; iter++ {
+		i := iter
+		t.Run(fmt.Sprintf("%d", i), func(t *testing.T) {
+			t.Parallel()
+			r := rand.New(rand.NewSource(int64(i)))
+			var data []byte
+			if i%2 == 0 {
+				data = compressibleData(r, r.Intn(8<<20))
+			} else {
+				data = make([]byte, r.Intn(4<<20))
+				_, err := r.Read(data)
+				assert.NoError(t, err)
+			}
+			opts := zlibng.Opts{
+				Level:       []int{-1, 1, 5, 9}[i%4],
+				Concurrency: r.Intn(4) + 1,
+				BlockSize:   []int{1 << 10, 40 << 10, 1 << 20, 0}[(i/4)%4],
+			}
+			if i%3 == 0 {
+				opts.WindowBits = zlibng.Flate
+			}
+			testParallelDeflate(t, r, opts, data)
+		})
+	}
+}
+
+func TestParallelDeflateEmpty(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	testParallelDeflate(t, r, zlibng.Opts{Level: -1}, nil)
+	testParallelDeflate(t, r, zlibng.Opts{Level: -1, WindowBits: zlibng.Flate}, nil)
+}
+
+func TestCompressInto(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	for _, n := range []int{0, 1, 1000, 1 << 20} {
+		data := compressibleData(r, n)
+		for _, windowBits := range []int{zlibng.Gzip, zlibng.Flate} {
+			opts := zlibng.Opts{Level: 5, WindowBits: windowBits}
+			compressed := make([]byte, zlibng.CompressBound(n))
+			cn, err := zlibng.CompressInto(compressed, data, opts)
+			assert.NoError(t, err)
+			compressed = compressed[:cn]
+
+			got := make([]byte, n+10)
+			dn, err := zlibng.DecompressInto(got, compressed, zlibng.Opts{WindowBits: windowBits})
+			assert.NoError(t, err)
+			assert.True(t, bytes.Equal(got[:dn], data))
+
+			if n > 0 {
+				_, err = zlibng.CompressInto(make([]byte, cn-1), data, opts)
+				assert.EQ(t, err, io.ErrShortBuffer)
+				_, err = zlibng.DecompressInto(got[:n-1], compressed, zlibng.Opts{WindowBits: windowBits})
+				assert.EQ(t, err, io.ErrShortBuffer)
+			}
+		}
+	}
+}
+
+func TestDecompressIntoMultiMember(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	data := compressibleData(r, 100000)
+	var compressed []byte
+	for _, part := range [][]byte{data[:30000], data[30000:]} {
+		buf := make([]byte, zlibng.CompressBound(len(part)))
+		n, err := zlibng.CompressInto(buf, part)
+		assert.NoError(t, err)
+		compressed = append(compressed, buf[:n]...)
+	}
+	got := make([]byte, len(data))
+	n, err := zlibng.DecompressInto(got, compressed)
+	assert.NoError(t, err)
+	assert.True(t, bytes.Equal(got[:n], data))
+
+	// Truncated input.
+	_, err = zlibng.DecompressInto(got, compressed[:len(compressed)-10])
+	assert.NE(t, err, nil)
+}
+
+func TestCompressDecompress(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	errs := make(chan error, 4)
+	for i := 0; i < 4; i++ {
+		seed := r.Int63()
+		go func() {
+			r := rand.New(rand.NewSource(seed))
+			for j := 0; j < 200; j++ {
+				data := compressibleData(r, r.Intn(64<<10))
+				prefix := []byte("prefix")
+				compressed, err := zlibng.Compress(prefix, data, r.Intn(10)-1)
+				if err != nil {
+					errs <- err
+					return
+				}
+				if !bytes.HasPrefix(compressed, prefix) {
+					errs <- fmt.Errorf("Compress dropped the prefix")
+					return
+				}
+				got, err := zlibng.Decompress(prefix, compressed[len(prefix):])
+				if err != nil {
+					errs <- err
+					return
+				}
+				if !bytes.Equal(got, append(prefix, data...)) {
+					errs <- fmt.Errorf("data mismatch, size %d", len(data))
+					return
+				}
+			}
+			errs <- nil
+		}()
+	}
+	for i := 0; i < 4; i++ {
+		assert.NoError(t, <-errs)
+	}
+
+	// A zlib stream has no size hint.
+	data := compressibleData(r, 1<<20)
+	compressed := bytes.Buffer{}
+	zout, err := zlib.NewWriterLevel(&compressed, 9)
+	assert.NoError(t, err)
+	_, err = zout.Write(data)
+	assert.NoError(t, err)
+	assert.NoError(t, zout.Close())
+	got, err := zlibng.Decompress(nil, compressed.Bytes())
+	assert.NoError(t, err)
+	assert.True(t, bytes.Equal(got, data))
+
+	// A corrupt ISIZE must not make Decompress allocate the size it claims.
+	small, err := zlibng.Compress(nil, data[:1000], 6)
+	assert.NoError(t, err)
+	binary.LittleEndian.PutUint32(small[len(small)-4:], math.MaxUint32)
+	var before, after runtime.MemStats
+	runtime.ReadMemStats(&before)
+	_, err = zlibng.Decompress(nil, small)
+	runtime.ReadMemStats(&after)
+	assert.NE(t, err, nil)
+	assert.LT(t, after.TotalAlloc-before.TotalAlloc, uint64(1<<20))
+}
+
+func TestZlibFormat(t *testing.T) {
+	// The zlib trailer is an Adler-32 checksum, so this covers the SIMD
+	// adler32 kernels on both sides, including lengths around their block
+	// sizes and NMAX.
+	r := rand.New(rand.NewSource(0))
+	for _, size := range []int{0, 1, 63, 64, 65, 127, 128, 129, 5551, 5552, 5553, 100000, 1 << 20} {
+		data := make([]byte, size)
+		if size%2 == 0 {
+			r.Read(data)
+		} else {
+			data = compressibleData(r, size)
+		}
+		compressed := bytes.Buffer{}
+		zout, err := zlibng.NewWriter(&compressed, zlibng.Opts{WindowBits: 15})
+		assert.NoError(t, err)
+		_, err = zout.Write(data)
+		assert.NoError(t, err)
+		assert.NoError(t, zout.Close())
+		zin, err := zlib.NewReader(bytes.NewReader(compressed.Bytes()))
+		assert.NoError(t, err)
+		got, err := ioutil.ReadAll(zin)
+		assert.NoError(t, err, "size %d", size)
+		assert.True(t, bytes.Equal(got, data))
+
+		compressed.Reset()
+		zw := zlib.NewWriter(&compressed)
+		_, err = zw.Write(data)
+		assert.NoError(t, err)
+		assert.NoError(t, zw.Close())
+		testInflate(t, r, 15, compressed.Bytes(), data)
+	}
+}
+
+func TestOptimalLevels(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	data := compressibleData(r, 256<<10)
+	level9, err := zlibng.Compress(nil, data, 9)
+	assert.NoError(t, err)
+	for level := 10; level <= 12; level++ {
+		compressed, err := zlibng.Compress(nil, data, level)
+		assert.NoError(t, err)
+		assert.LE(t, len(compressed), len(level9), "level %d", level)
+		zin, err := gzip.NewReader(bytes.NewReader(compressed))
+		assert.NoError(t, err)
+		got, err := ioutil.ReadAll(zin)
+		assert.NoError(t, err)
+		assert.True(t, bytes.Equal(got, data), "level %d", level)
+
+		// Small writes, so that deflate runs out of input in the middle of
+		// its chunks.
+		out := bytes.Buffer{}
+		zout, err := zlibng.NewWriter(&out, zlibng.Opts{Level: level, WindowBits: zlibng.Flate})
+		assert.NoError(t, err)
+		for off := 0; off < len(data); {
+			n := r.Intn(3000) + 1
+			if n > len(data)-off {
+				n = len(data) - off
+			}
+			_, err = zout.Write(data[off : off+n])
+			assert.NoError(t, err)
+			off += n
+		}
+		assert.NoError(t, zout.Close())
+		testInflate(t, r, zlibng.Flate, out.Bytes(), data)
+	}
+}
+
+// literalData generates n bytes of random DNA-like lines, and compresses them
+// with the given strategy.
+func literalData(t testing.TB, r *rand.Rand, n, strategy int) (data, compressed []byte) {
+	data = make([]byte, n)
+	for i := range data {
+		if i%151 == 150 {
+			data[i] = '\n'
+		} else {
+			data[i] = "ACGT"[r.Intn(4)]
+		}
+	}
+	buf := bytes.Buffer{}
+	zout, err := zlibng.NewWriter(&buf, zlibng.Opts{Level: 6, Strategy: strategy})
+	assert.NoError(t, err)
+	_, err = zout.Write(data)
+	assert.NoError(t, err)
+	assert.NoError(t, zout.Close())
+	return data, buf.Bytes()
+}
+
+func TestMultiLiteral(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	for _, strategy := range []int{zlibng.DefaultStrategy, zlibng.HuffmanOnlyStrategy, zlibng.FixedStrategy} {
+		for _, n := range []int{0, 1, 1000, 1 << 20} {
+			data, compressed := literalData(t, r, n, strategy)
+			testInflate(t, r, 0, compressed, data)
+			zin, err := zlibng.NewReader(bytes.NewReader(compressed), zlibng.Opts{MultiLiteral: true})
+			assert.NoError(t, err)
+			got, err := ioutil.ReadAll(zin)
+			assert.NoError(t, err)
+			assert.True(t, bytes.Equal(got, data), "strategy %d, size %d", strategy, n)
+			assert.NoError(t, zin.Close())
+		}
+	}
+	// Compressible data, mostly matches, with a small input buffer so that
+	// inflate switches between the fast and the slow decoder.
+	data := compressibleData(r, 1<<20)
+	compressed, err := zlibng.Compress(nil, data, 6)
+	assert.NoError(t, err)
+	zin, err := zlibng.NewReader(bytes.NewReader(compressed), zlibng.Opts{MultiLiteral: true, Buffer: 4096})
+	assert.NoError(t, err)
+	got, err := ioutil.ReadAll(zin)
+	assert.NoError(t, err)
+	assert.True(t, bytes.Equal(got, data))
+	assert.NoError(t, zin.Close())
+}
+
+func TestSlabAlloc(t *testing.T) {
+	errs := make(chan error, 8)
+	for i := 0; i < 8; i++ {
+		go func(i int) {
+			r := rand.New(rand.NewSource(int64(i)))
+			for j := 0; j < 20; j++ {
+				data := compressibleData(r, r.Intn(256<<10))
+				opts := zlibng.Opts{
+					SlabAlloc:  true,
+					Level:      r.Intn(10),
+					MemLevel:   r.Intn(9) + 1,
+					WindowBits: []int{zlibng.Gzip, zlibng.Flate}[r.Intn(2)],
+				}
+				compressed := bytes.Buffer{}
+				zout, err := zlibng.NewWriter(&compressed, opts)
+				if err != nil {
+					errs <- err
+					return
+				}
+				if _, err := zout.Write(data); err != nil {
+					errs <- err
+					return
+				}
+				if err := zout.Close(); err != nil {
+					errs <- err
+					return
+				}
+				zin, err := zlibng.NewReader(&compressed, opts)
+				if err != nil {
+					errs <- err
+					return
+				}
+				got, err := ioutil.ReadAll(zin)
+				if err != nil {
+					errs <- err
+					return
+				}
+				if !bytes.Equal(got, data) {
+					errs <- fmt.Errorf("data mismatch, opts %+v", opts)
+					return
+				}
+			}
+			errs <- nil
+		}(i)
+	}
+	for i := 0; i < 8; i++ {
+		assert.NoError(t, <-errs)
+	}
+}
+
+func TestReaderWriteTo(t *testing.T) {
+	r := rand.New(rand.NewSource(0))
+	data := compressibleData(r, 3<<20)
+	compressed := bytes.Buffer{}
+	zout, err := zlibng.NewWriter(&compressed)
+	assert.NoError(t, err)
+	n, err := io.Copy(zout, bytes.NewReader(data[:1<<20]))
+	assert.NoError(t, err)
+	assert.EQ(t, n, int64(1<<20))
+	// A reader without WriteTo.
+	n, err = io.Copy(zout, bufio.NewReaderSize(bytes.NewReader(data[1<<20:]), 4096))
+	assert.NoError(t, err)
+	assert.EQ(t, n, int64(2<<20))
+	assert.NoError(t, zout.Close())
+
+	for _, prefix := range []int{0, 1, 100000} {
+		zin, err := zlibng.NewReader(bytes.NewReader(compressed.Bytes()), zlibng.Opts{Buffer: 64 << 10})
+		assert.NoError(t, err)
+		got := make([]byte, prefix)
+		_, err = io.ReadFull(zin, got)
+		assert.NoError(t, err)
+		rest := bytes.Buffer{}
+		n, err := io.Copy(&rest, zin)
+		assert.NoError(t, err)
+		assert.EQ(t, n, int64(len(data)-prefix))
+		assert.True(t, bytes.Equal(append(got, rest.Bytes()...), data))
+		assert.NoError(t, zin.Close())
+	}
+}
+
 var (
 	testSmallPathFlag = flag.String("small-path",
 		"/scratch-nvme/cache_tmp/get-pip.py", "Plain-text file used for small tests")
@@ -411,3 +824,57 @@ func BenchmarkDeflateZlibNG(b *testing.B) {
 			return w
 		})
 }
+
+func benchmarkCompressSmall(b *testing.B, size int) {
+	data := compressibleData(rand.New(rand.NewSource(0)), size)
+	compressed, err := zlibng.Compress(nil, data, 5)
+	assert.NoError(b, err)
+	var (
+		cbuf = make([]byte, 0, zlibng.CompressBound(size))
+		dbuf = make([]byte, 0, size)
+	)
+	b.SetBytes(int64(size))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if _, err := zlibng.Compress(cbuf, data, 5); err != nil {
+			b.Fatal(err)
+		}
+		if _, err := zlibng.Decompress(dbuf, compressed); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkCompressSmall1K(b *testing.B)  { benchmarkCompressSmall(b, 1<<10) }
+func BenchmarkCompressSmall64K(b *testing.B) { benchmarkCompressSmall(b, 64<<10) }
+
+// benchmarkInflateLiterals measures the literal throughput of inflate, with
+// and without Opts.MultiLiteral.
+func benchmarkInflateLiterals(b *testing.B, multiLiteral bool) {
+	data, compressed := literalData(b, rand.New(rand.NewSource(0)), 4<<20, zlibng.HuffmanOnlyStrategy)
+	out := make([]byte, len(data))
+	b.SetBytes(int64(len(data)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		zin, err := zlibng.NewReader(bytes.NewReader(compressed), zlibng.Opts{MultiLiteral: multiLiteral})
+		if err != nil {
+			b.Fatal(err)
+		}
+		if _, err := io.ReadFull(zin, out); err != nil {
+			b.Fatal(err)
+		}
+		zin.Close()
+	}
+}
+
+func BenchmarkInflateLiterals(b *testing.B)             { benchmarkInflateLiterals(b, false) }
+func BenchmarkInflateLiteralsMultiLiteral(b *testing.B) { benchmarkInflateLiterals(b, true) }
+
+func BenchmarkDeflateZlibNGParallel(b *testing.B) {
+	benchmarkDeflate(b, *testPathFlag,
+		func(out io.Writer) io.WriteCloser {
+			w, err := zlibng.NewParallelWriter(out, zlibng.Opts{Level: 5})
+			assert.NoError(b, err)
+			return w
+		})
+}
@@ -4,26 +4,63 @@
 #include <stdlib.h>
 #include <string.h>
 #include "./zlib-ng.h"
+#include "./zbuild.h"
+#include "./zutil.h"
 
-int zs_inflate_init(char* stream, int window_bits, struct zng_gz_header_s* h,
-                    int* get_header_status) {
-  zng_stream* zs = (zng_stream*)stream;
+static void zs_init(zng_stream* zs, int slab) {
   memset(zs, 0, sizeof(*zs));
+  if (slab) {
+    zs->zalloc = zng_zcalloc_slab;
+    zs->zfree = zng_zcfree_slab;
+  }
+}
+
+int zs_inflate_init(char* stream, int window_bits, int slab,
+                    struct zng_gz_header_s* h, int* get_header_status) {
+  zng_stream* zs = (zng_stream*)stream;
+  zs_init(zs, slab);
   int ec = zng_inflateInit2(zs, window_bits);
   if (ec != 0) {
     return ec;
   }
-  *get_header_status = zng_inflateGetHeader(zs, h);
+  *get_header_status = h == NULL ? Z_STREAM_ERROR : zng_inflateGetHeader(zs, h);
   return 0;
 }
 
 int zs_inflate_end(char* stream) { return zng_inflateEnd((zng_stream*)stream); }
 
+int zs_inflate_multi_literal(char* stream) {
+  return zng_inflateMultiLiteral((zng_stream*)stream, 1);
+}
+
 int zs_inflate_reset(char* stream) {
   zng_stream* zs = (zng_stream*)stream;
   return zng_inflateReset(zs);
 }
 
+int zs_inflate_reset2(char* stream, int window_bits, zng_gz_header* h) {
+  zng_stream* zs = (zng_stream*)stream;
+  zs->avail_in = 0;
+  zs->next_in = NULL;
+  int ret = zng_inflateReset2(zs, window_bits);
+  if (ret != Z_OK || h == NULL) {
+    return ret;
+  }
+  // inflateReset forgets the header buffer.
+  return zng_inflateGetHeader(zs, h);
+}
+
+int zs_inflate_discard(char* stream) {
+  zng_stream* zs = (zng_stream*)stream;
+  zs->avail_in = 0;
+  zs->next_in = NULL;
+  return zng_inflateReset(zs);
+}
+
+int zs_inflate_avail_in(char* stream) {
+  return ((zng_stream*)stream)->avail_in;
+}
+
 int zs_get_errno() { return errno; }
 
 int zs_inflate(char* stream, void* in, int in_bytes, void* out, int* out_bytes,
@@ -50,14 +87,132 @@ int zs_inflate(char* stream, void* in, int in_bytes, void* out, int* out_bytes,
   return ret;
 }
 
+int zs_inflate_block(char* stream, void* in, int in_bytes, void* out,
+                     int* out_bytes, int* in_remaining, int* data_type) {
+  zng_stream* zs = (zng_stream*)stream;
+  if (in_bytes > 0) {
+    if (zs->avail_in != 0) {
+      abort();
+    }
+    zs->avail_in = in_bytes;
+    zs->next_in = in;
+  }
+  zs->next_out = out;
+  zs->avail_out = *out_bytes;
+  int ret = zng_inflate(zs, Z_BLOCK);
+  *out_bytes = zs->avail_out;
+  *in_remaining = zs->avail_in;
+  *data_type = zs->data_type;
+  return ret;
+}
+
+int zs_inflate_get_window(char* stream, void* window, int* window_bytes) {
+  unsigned len = 0;
+  int ret = zng_inflateGetDictionary((zng_stream*)stream, window, &len);
+  *window_bytes = len;
+  return ret;
+}
+
+int zs_inflate_resume(char* stream, int bits, int value, void* window,
+                      int window_bytes) {
+  zng_stream* zs = (zng_stream*)stream;
+  int ret = zs_inflate_discard(stream);
+  if (ret != Z_OK) {
+    return ret;
+  }
+  if (bits > 0) {
+    ret = zng_inflatePrime(zs, bits, value);
+    if (ret != Z_OK) {
+      return ret;
+    }
+  }
+  if (window_bytes > 0) {
+    ret = zng_inflateSetDictionary(zs, window, window_bytes);
+  }
+  return ret;
+}
+
+int zs_inflate_member(char* stream, void* in, int in_bytes, void* out,
+                      int* out_bytes) {
+  zng_stream* zs = (zng_stream*)stream;
+  int ret = zng_inflateReset(zs);
+  if (ret != Z_OK) {
+    return ret;
+  }
+  zs->next_in = in;
+  zs->avail_in = in_bytes;
+  zs->next_out = out;
+  zs->avail_out = *out_bytes;
+  ret = zng_inflate(zs, Z_FINISH);
+  *out_bytes = zs->avail_out;
+  zs->next_in = NULL;
+  zs->next_out = NULL;
+  if (ret == Z_STREAM_END) {
+    return zs->avail_in == 0 ? Z_OK : Z_DATA_ERROR;
+  }
+  if (ret == Z_OK || ret == Z_BUF_ERROR) {
+    // Either the output is larger than expected, or the input is truncated.
+    return Z_DATA_ERROR;
+  }
+  return ret;
+}
+
+int zs_inflate_into(char* stream, void* in, int in_bytes, void* out,
+                    int* out_bytes) {
+  zng_stream* zs = (zng_stream*)stream;
+  unsigned char dummy;
+  int ret = zng_inflateReset(zs);
+  if (ret != Z_OK) {
+    return ret;
+  }
+  zs->next_in = in;
+  zs->avail_in = in_bytes;
+  // inflate rejects a NULL next_out even when avail_out is zero.
+  zs->next_out = *out_bytes > 0 ? out : &dummy;
+  zs->avail_out = *out_bytes;
+  for (;;) {
+    ret = zng_inflate(zs, Z_FINISH);
+    if (ret != Z_STREAM_END || zs->avail_in == 0) {
+      break;
+    }
+    // Decompress the next member.
+    if ((ret = zng_inflateReset(zs)) != Z_OK) {
+      break;
+    }
+  }
+  *out_bytes = zs->avail_out;
+  zs->next_in = NULL;
+  zs->next_out = NULL;
+  if (ret == Z_STREAM_END) {
+    return Z_OK;
+  }
+  if (ret == Z_BUF_ERROR && zs->avail_out > 0) {
+    // The input is truncated.
+    return Z_DATA_ERROR;
+  }
+  return ret == Z_NEED_DICT ? Z_DATA_ERROR : ret;
+}
+
 int zs_deflate_init(char* stream, int level, int window_bits, int mem_level,
-                    int strategy) {
+                    int strategy, int slab) {
   zng_stream* zs = (zng_stream*)stream;
-  memset(zs, 0, sizeof(*zs));
+  zs_init(zs, slab);
   return zng_deflateInit2(zs, level, Z_DEFLATED, window_bits, mem_level,
                           strategy);
 }
 
+int zs_deflate_block_split(char* stream) {
+  return zng_deflateBlockSplit((zng_stream*)stream, 1);
+}
+
+int zs_deflate_store_incompressible(char* stream) {
+  return zng_deflateStoreIncompressible((zng_stream*)stream, 1);
+}
+
+int zs_deflate_quick_dynamic(char* stream) {
+  return zng_deflateQuickDynamic((zng_stream*)stream, 1);
+}
+
 int zs_deflate(char* stream, void* in, int in_bytes, void* out, int* out_bytes,
                int* consumed_input) {
   zng_stream* zs = (zng_stream*)stream;
@@ -87,12 +242,101 @@ int zs_deflate_end(char* stream, void* out, int* out_bytes) {
   zs->avail_out = *out_bytes;
   int ret = zng_deflate(zs, Z_FINISH);
   *out_bytes = zs->avail_out;
-  if (ret != Z_OK) {
-    zng_deflateEnd(zs);
-  }
   return ret;
 }
 
+int zs_deflate_free(char* stream) {
+  return zng_deflateEnd((zng_stream*)stream);
+}
+
+int zs_deflate_reset(char* stream, int clear_header) {
+  zng_stream* zs = (zng_stream*)stream;
+  zs->avail_in = 0;
+  zs->next_in = NULL;
+  int ret = zng_deflateReset(zs);
+  if (ret != Z_OK || !clear_header) {
+    return ret;
+  }
+  return zng_deflateSetHeader(zs, NULL);
+}
+
 int zs_deflate_set_header(char* stream, zng_gz_header* h) {
   return zng_deflateSetHeader((zng_stream*)stream, h);
 }
+
+int zs_deflate_member(char* stream, void* in, int in_bytes, void* out,
+                      int* out_bytes) {
+  zng_stream* zs = (zng_stream*)stream;
+  int ret = zng_deflateReset(zs);
+  if (ret != Z_OK) {
+    return ret;
+  }
+  zs->next_in = in;
+  zs->avail_in = in_bytes;
+  zs->next_out = out;
+  zs->avail_out = *out_bytes;
+  do {
+    ret = zng_deflate(zs, Z_FINISH);
+  } while (ret == Z_OK && zs->avail_out > 0);
+  *out_bytes = zs->avail_out;
+  zs->next_in = NULL;
+  zs->next_out = NULL;
+  if (ret == Z_OK) {
+    return Z_BUF_ERROR;
+  }
+  return ret == Z_STREAM_END ? Z_OK : ret;
+}
+
+int zs_deflate_block(char* stream, void* dict, int dict_bytes, void* in,
+                     int in_bytes, void* out, int* out_bytes, int last,
+                     uint32_t* crc) {
+  zng_stream* zs = (zng_stream*)stream;
+  int ret = zng_deflateReset(zs);
+  if (ret != Z_OK) {
+    return ret;
+  }
+  if (dict_bytes > 0) {
+    ret = zng_deflateSetDictionary(zs, dict, dict_bytes);
+    if (ret != Z_OK) {
+      return ret;
+    }
+  }
+  zs->next_in = in;
+  zs->avail_in = in_bytes;
+  zs->next_out = out;
+  zs->avail_out = *out_bytes;
+  do {
+    ret = zng_deflate(zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+  } while (ret == Z_OK && zs->avail_out > 0 && (last || zs->avail_in > 0));
+  *out_bytes = zs->avail_out;
+  zs->next_in = NULL;
+  zs->next_out = NULL;
+  if (last) {
+    if (ret != Z_STREAM_END) {
+      return ret == Z_OK ? Z_BUF_ERROR : ret;
+    }
+  } else {
+    if (ret != Z_OK) {
+      return ret;
+    }
+    // With Z_SYNC_FLUSH, a full output buffer means the flush may be
+    // incomplete.
+    if (zs->avail_out == 0) {
+      return Z_BUF_ERROR;
+    }
+  }
+  if (zs->avail_in != 0) {
+    return Z_BUF_ERROR;
+  }
+  *crc = zng_crc32_z(*crc, in, in_bytes);
+  return Z_OK;
+}
+
+int zs_deflate_bound(char* stream, int in_bytes) {
+  // The extra bytes cover the empty stored block emitted by Z_SYNC_FLUSH.
+  return (int)zng_deflateBound((zng_stream*)stream, in_bytes) + 16;
+}
+
+uint32_t zs_crc32_combine(uint32_t crc1, uint32_t crc2, int64_t len2) {
+  return zng_crc32_combine(crc1, crc2, (z_off_t)len2);
+}
@@ -1,20 +1,106 @@
 #ifndef ZSTREAM_H
 #define ZSTREAM_H
 
+#include <stdint.h>
+
 struct zng_gz_header_s;
-extern int zs_inflate_init(char* stream, int window_bits, struct zng_gz_header_s* h, int* get_header_status);
+// If slab!=0, the stream state is allocated by the slab allocator in zutil.c.
+extern int zs_inflate_init(char* stream, int window_bits, int slab, struct zng_gz_header_s* h, int* get_header_status);
 extern int zs_inflate_reset(char* stream);
+// zs_inflate_multi_literal makes the stream decode literals through
+// multi-literal tables, up to three per table lookup. It must be called right
+// after zs_inflate_init.
+extern int zs_inflate_multi_literal(char* stream);
+// zs_inflate_reset2 discards the buffered input and resets the stream for a
+// new input, keeping its memory. If h is not NULL, the gzip header is stored
+// in h as in zs_inflate_init.
+extern int zs_inflate_reset2(char* stream, int window_bits,
+                             struct zng_gz_header_s* h);
 extern int zs_inflate_end(char* stream);
+// zs_inflate_discard drops the buffered input and resets the stream so that
+// it can start reading a new member, e.g., after seeking the input.
+extern int zs_inflate_discard(char* stream);
+// zs_inflate_avail_in returns the number of buffered input bytes not yet
+// consumed by the stream.
+extern int zs_inflate_avail_in(char* stream);
 extern int zs_inflate(char* stream, void* in, int in_bytes, void* out,
                       int* out_bytes, int* consumed_input);
 
-// format is one of Gzip or Flate.
+// zs_inflate_block is similar to zs_inflate, but it runs inflate with
+// Z_BLOCK so that it stops at deflate block boundaries. It sets *in_remaining
+// to the number of unconsumed input bytes and *data_type to
+// zng_stream.data_type.
+extern int zs_inflate_block(char* stream, void* in, int in_bytes, void* out,
+                            int* out_bytes, int* in_remaining, int* data_type);
+// zs_inflate_get_window copies the last (up to 32KiB) bytes of the
+// uncompressed data to window.
+extern int zs_inflate_get_window(char* stream, void* window, int* window_bytes);
+// zs_inflate_resume prepares a raw-deflate stream to start decompressing in the
+// middle of a deflate stream. The first "bits" bits of the input are taken from
+// value, and window holds the preceding uncompressed data.
+extern int zs_inflate_resume(char* stream, int bits, int value, void* window,
+                             int window_bytes);
+// zs_inflate_member decompresses in[0,in_bytes), which must contain exactly
+// one complete member. On entry *out_bytes is the size of out; on return it is
+// the number of unused bytes in out. Returns Z_DATA_ERROR if the member does
+// not fit in out.
+extern int zs_inflate_member(char* stream, void* in, int in_bytes, void* out,
+                             int* out_bytes);
+// zs_inflate_into decompresses in[0,in_bytes), which holds one or more
+// complete members, into out. On entry *out_bytes is the size of out; on return
+// it is the number of unused bytes in out. Returns Z_BUF_ERROR if the output
+// does not fit in out, and Z_DATA_ERROR if the input is truncated.
+extern int zs_inflate_into(char* stream, void* in, int in_bytes, void* out,
+                           int* out_bytes);
+
+// format is one of Gzip or Flate. slab is as in zs_inflate_init.
 extern int zs_deflate_init(char* stream, int level, int window_bits,
-                           int mem_level, int strategy);
+                           int mem_level, int strategy, int slab);
+// zs_deflate_block_split makes the stream also end its blocks where the
+// statistics of the input change, with a larger symbol buffer. It must be
+// called right after zs_deflate_init.
+extern int zs_deflate_block_split(char* stream);
+// zs_deflate_store_incompressible makes the stream store the input that looks
+// random instead of compressing it. It must be called right after
+// zs_deflate_init.
+extern int zs_deflate_store_incompressible(char* stream);
+// zs_deflate_quick_dynamic makes level 1 send its blocks with Huffman trees
+// built for each block. It must be called right after zs_deflate_init.
+extern int zs_deflate_quick_dynamic(char* stream);
 extern int zs_deflate_set_header(char* stream, struct zng_gz_header_s* h);
 extern int zs_deflate(char* stream, void* in, int in_bytes, void* out,
                       int* out_bytes, int* consumed_input);
+// zs_deflate_end finishes the stream. The stream stays allocated, so that it
+// can be reused by zs_deflate_reset.
 extern int zs_deflate_end(char* stream, void* out, int* out_bytes);
+// zs_deflate_reset discards the buffered input and resets the stream for a new
+// output, keeping its memory and parameters. If clear_header!=0, the gzip
+// header set by zs_deflate_set_header is dropped.
+extern int zs_deflate_reset(char* stream, int clear_header);
+// zs_deflate_free releases the stream without writing the trailer.
+extern int zs_deflate_free(char* stream);
+
+// zs_deflate_member compresses in[0,in_bytes) into one complete member,
+// including the header and trailer. On entry *out_bytes is the size of out; on
+// return it is the number of unused bytes in out. Returns Z_BUF_ERROR if out is
+// too small.
+extern int zs_deflate_member(char* stream, void* in, int in_bytes, void* out,
+                             int* out_bytes);
+// zs_deflate_block compresses in[0,in_bytes) as one independent chunk of a
+// raw deflate stream. dict, if nonempty, primes the window with the preceding
+// uncompressed bytes. The chunk ends with a Z_SYNC_FLUSH marker, or with the
+// final block if last!=0. On entry *out_bytes is the size of out; on return it
+// is the number of unused bytes in out. *crc is updated with the CRC-32 of the
+// input. Returns Z_BUF_ERROR if out is too small.
+//
+// REQUIRES: stream is created with a negative window_bits.
+extern int zs_deflate_block(char* stream, void* dict, int dict_bytes, void* in,
+                            int in_bytes, void* out, int* out_bytes, int last,
+                            uint32_t* crc);
+// zs_deflate_bound returns an upper bound of the output size of
+// zs_deflate_block.
+extern int zs_deflate_bound(char* stream, int in_bytes);
+extern uint32_t zs_crc32_combine(uint32_t crc1, uint32_t crc2, int64_t len2);
 
 extern int zs_get_errno();
 
@@ -13,6 +13,7 @@
 #ifndef UNALIGNED_OK
 #  include "malloc.h"
 #endif
+#include <sched.h>
 
 const char * const zng_z_errmsg[10] = {
     (const char *)"need dictionary",     /* Z_NEED_DICT       2  */
@@ -138,3 +139,137 @@ void ZLIB_INTERNAL zng_zcfree (void *opaque, void *ptr)
 }
 
 #endif /* MY_ZCALLOC */
+
+/* Slab allocator for the deflate and inflate state. A stream allocates the
+ * same few block sizes for given parameters: the state, the window, and for
+ * deflate prev, head and pending_buf. Freed blocks are kept on a free list per
+ * block size, and are handed to the next stream that asks for the same size,
+ * so that streams created one after another do not go to malloc. Each block
+ * is preceded by a header that records its list. The cached blocks of all the
+ * lists hold at most SLAB_CACHE_BYTES; blocks freed beyond that go back to
+ * malloc.
+ */
+
+#define SLAB_LISTS        32           /* max # of distinct block sizes */
+#define SLAB_CACHE_BYTES  (64 << 20)   /* max bytes cached in all the lists */
+#define SLAB_HEADER       16           /* keeps the malloc alignment */
+#define SLAB_SPINS        64           /* lock polls before yielding the CPU */
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define slab_pause() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#  define slab_pause() __asm__ __volatile__("yield")
+#else
+#  define slab_pause() ((void)0)
+#endif
+
+typedef struct slab_block_s {
+    struct slab_block_s *next;   /* valid while on a free list */
+    int list;                    /* index of the free list, or -1 */
+} slab_block;
+
+typedef struct {
+    size_t size;                 /* block size, excluding the header */
+    slab_block *free;
+    char lock;
+} slab_list;
+
+static slab_list slab_lists[SLAB_LISTS];
+static int slab_nlists;          /* # of slab_lists in use; they are never removed */
+static char slab_lists_lock;
+static size_t slab_cached;       /* # of bytes on all the free lists */
+
+/* The lock is held for a few pointer updates, so a waiter spins briefly, and
+ * then yields in case the holder was preempted.
+ */
+static void slab_lock(char *lock) {
+    unsigned spins = 0;
+    while (__atomic_test_and_set(lock, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {
+            if (++spins < SLAB_SPINS)
+                slab_pause();
+            else
+                sched_yield();
+        }
+    }
+}
+
+static void slab_unlock(char *lock) {
+    __atomic_clear(lock, __ATOMIC_RELEASE);
+}
+
+/* slab_find returns the index of the free list for size, creating it if
+ * needed. Returns -1 if all the lists are in use by other sizes.
+ */
+static int slab_find(size_t size) {
+    int i, n = __atomic_load_n(&slab_nlists, __ATOMIC_ACQUIRE);
+    for (i = 0; i < n; i++) {
+        if (slab_lists[i].size == size)
+            return i;
+    }
+    slab_lock(&slab_lists_lock);
+    n = slab_nlists;
+    for (; i < n; i++) {
+        if (slab_lists[i].size == size)
+            break;
+    }
+    if (i == n) {
+        if (n == SLAB_LISTS) {
+            i = -1;
+        } else {
+            slab_lists[n].size = size;
+            __atomic_store_n(&slab_nlists, n + 1, __ATOMIC_RELEASE);
+        }
+    }
+    slab_unlock(&slab_lists_lock);
+    return i;
+}
+
+void ZLIB_INTERNAL *zng_zcalloc_slab(void *opaque, unsigned items, unsigned size)
+{
+    size_t bytes = (size_t)items * size;
+    int list = slab_find(bytes);
+    slab_block *b = NULL;
+    (void)opaque;
+
+    if (list >= 0) {
+        slab_list *l = &slab_lists[list];
+        slab_lock(&l->lock);
+        b = l->free;
+        if (b != NULL)
+            l->free = b->next;
+        slab_unlock(&l->lock);
+        if (b != NULL)
+            __atomic_sub_fetch(&slab_cached, bytes, __ATOMIC_RELAXED);
+    }
+    if (b == NULL) {
+        b = (slab_block *)malloc(SLAB_HEADER + bytes);
+        if (b == NULL)
+            return NULL;
+    }
+    b->list = list;
+    return (unsigned char *)b + SLAB_HEADER;
+}
+
+void ZLIB_INTERNAL zng_zcfree_slab(void *opaque, void *ptr)
+{
+    slab_block *b = (slab_block *)((unsigned char *)ptr - SLAB_HEADER);
+    (void)opaque;
+
+    if (b->list >= 0) {
+        slab_list *l = &slab_lists[b->list];
+        /* Reserve the room first, so that the lists never hold more than
+         * SLAB_CACHE_BYTES between them.
+         */
+        if (__atomic_add_fetch(&slab_cached, l->size, __ATOMIC_RELAXED) <= SLAB_CACHE_BYTES) {
+            slab_lock(&l->lock);
+            b->next = l->free;
+            l->free = b;
+            slab_unlock(&l->lock);
+            b = NULL;
+        } else {
+            __atomic_sub_fetch(&slab_cached, l->size, __ATOMIC_RELAXED);
+        }
+    }
+    free(b);
+}
@@ -161,6 +161,12 @@ extern const char * const zng_z_errmsg[10]; /* indexed by 2-zlib_error */
 void ZLIB_INTERNAL *zng_zcalloc(void *opaque, unsigned items, unsigned size);
 void ZLIB_INTERNAL   zng_zcfree(void *opaque, void *ptr);
 
+/* Slab allocator for zalloc/zfree. Freed blocks are cached for reuse by
+ * the next allocation of the same size.
+ */
+void ZLIB_INTERNAL *zng_zcalloc_slab(void *opaque, unsigned items, unsigned size);
+void ZLIB_INTERNAL   zng_zcfree_slab(void *opaque, void *ptr);
+
 #define ZALLOC(strm, items, size) (*((strm)->zalloc))((strm)->opaque, (items), (size))
 #define ZFREE(strm, addr)         (*((strm)->zfree))((strm)->opaque, (void *)(addr))
 #define TRY_FREE(s, p) {if (p) ZFREE(s, p);}